@@ -0,0 +1,359 @@
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+/* benchmarking helper for bench/run.sh
+ *   gen:     generates a synthetic ftag store (tags file, index file and optionally the tree of files it points at)
+ *   time:    runs a command and reports its wall time and peak RSS as JSON
+ *   compare: sets two builds' runs from run.sh's results side by side */
+
+#define ERR_EXIT(A, ...) { /* NOLINT */ \
+    std::fputs("ftag-bench: error: ", stderr); \
+    std::fprintf(stderr, __VA_ARGS__); \
+    std::fputc('\n', stderr); \
+    std::exit(static_cast<int>(A)); \
+}
+
+struct gen_opts_t {
+    std::uint64_t files = 1000;
+    std::uint64_t tags = 100;
+    std::uint32_t depth = 4; /* levels in the tag DAG */
+    std::uint32_t fan_out = 2; /* max supertags of every tag below the first level */
+    std::uint64_t files_per_tag = 10;
+    std::uint32_t path_depth = 3; /* directories between the tree root and each file */
+    std::uint32_t dir_fan_out = 16; /* subdirectories per directory */
+    std::uint64_t cycles = 0;
+    double disabled = 0; /* fraction of tags disabled */
+    double stale = 0; /* fraction of files indexed and tagged under a wrong inode number, for fix */
+    std::uint64_t seed = 1;
+    bool make_tree = true;
+};
+
+struct gen_tag_t {
+    std::string name;
+    std::uint32_t level = 0;
+    std::vector<std::uint64_t> super; /* positions in the tag list */
+    std::vector<std::uint64_t> files; /* positions in the file list */
+    bool enabled = true;
+};
+
+std::string file_dir(const gen_opts_t &opts, std::uint64_t i) {
+    std::string dir;
+    for (std::uint32_t d = 0; d < opts.path_depth; d++) {
+        dir += "/d" + std::to_string(i % opts.dir_fan_out);
+        i /= opts.dir_fan_out;
+    }
+    return dir;
+}
+
+/* prints {"seconds": ..., "max_rss_kb": ..., "exit": ...}, output of the command goes to /dev/null */
+int time_main(int argc, char **argv) {
+    if (argc < 1) {
+        ERR_EXIT(1, "time: expected a command");
+    }
+    const auto start = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid < 0) {
+        ERR_EXIT(1, "time: could not fork: %s", std::strerror(errno));
+    }
+    if (pid == 0) {
+        int devnull = open("/dev/null", O_WRONLY); /* NOLINT */
+        dup2(devnull, STDOUT_FILENO);
+        dup2(devnull, STDERR_FILENO);
+        execvp(argv[0], argv);
+        std::_Exit(127);
+    }
+    int status = 0;
+    struct rusage usage{};
+    wait4(pid, &status, 0, &usage);
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    int code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    std::printf("{\"seconds\": %.6f, \"max_rss_kb\": %ld, \"exit\": %d}\n", elapsed.count(), usage.ru_maxrss, code);
+    return 0;
+}
+
+/* the value of "key" in one of run.sh's result lines, unquoted, empty if it has none */
+std::string result_field(const std::string &line, const std::string &key) {
+    const std::string prefix = '"' + key + "\": ";
+    std::size_t pos = line.find(prefix);
+    if (pos == std::string::npos) { return {}; }
+    pos += prefix.size();
+    if (pos < line.size() && line[pos] == '"') {
+        return line.substr(pos + 1, line.find('"', pos + 1) - pos - 1);
+    }
+    return line.substr(pos, line.find_first_of(",}", pos) - pos);
+}
+
+/* prints, for every size and command both builds ran, the fastest run's seconds and the lowest peak RSS of each */
+int compare_main(int argc, char **argv) {
+    if (argc < 3) {
+        ERR_EXIT(1, "compare: expected <results file> <build a> <build b>");
+    }
+    std::ifstream file(argv[0]);
+    if (!file) {
+        ERR_EXIT(1, "compare: could not read \"%s\"", argv[0]);
+    }
+    struct best_t {
+        double seconds = 0;
+        long max_rss_kb = 0;
+        bool seen = false;
+    };
+    std::vector<std::pair<std::uint64_t, std::string>> order; /* size, command as first seen */
+    std::map<std::pair<std::uint64_t, std::string>, best_t[2]> runs;
+    std::string line;
+    while (std::getline(file, line)) {
+        const std::string build = result_field(line, "build");
+        const int side = build == argv[1] ? 0 : build == argv[2] ? 1 : -1;
+        if (side == -1 || result_field(line, "exit") != "0") { continue; }
+        const std::pair<std::uint64_t, std::string> key{std::strtoull(result_field(line, "size").c_str(), nullptr, 10), result_field(line, "command")};
+        if (runs.find(key) == runs.end()) {
+            order.push_back(key);
+        }
+        best_t &best = runs[key][side];
+        const double seconds = std::strtod(result_field(line, "seconds").c_str(), nullptr);
+        const long max_rss_kb = std::strtol(result_field(line, "max_rss_kb").c_str(), nullptr, 10);
+        best.seconds = best.seen ? std::min(best.seconds, seconds) : seconds;
+        best.max_rss_kb = best.seen ? std::min(best.max_rss_kb, max_rss_kb) : max_rss_kb;
+        best.seen = true;
+    }
+    std::printf("%10s  %-20s  %10s  %10s  %7s  %12s  %12s  %7s\n", "size", "command", "seconds a", "seconds b", "change", "max_rss_kb a", "max_rss_kb b", "change");
+    for (const auto &key : order) {
+        const best_t *best = runs[key];
+        if (!best[0].seen || !best[1].seen) { continue; }
+        std::printf("%10lu  %-20s  %10.4f  %10.4f  %+6.1f%%  %12ld  %12ld  %+6.1f%%\n", static_cast<unsigned long>(key.first), key.second.c_str(),
+            best[0].seconds, best[1].seconds, best[0].seconds > 0 ? (best[1].seconds / best[0].seconds - 1) * 100 : 0.0,
+            best[0].max_rss_kb, best[1].max_rss_kb, best[0].max_rss_kb > 0 ? (static_cast<double>(best[1].max_rss_kb) / static_cast<double>(best[0].max_rss_kb) - 1) * 100 : 0.0);
+    }
+    return 0;
+}
+
+int gen_main(int argc, char **argv) { /* NOLINT */
+    if (argc < 2 || !std::strcmp(argv[1], "-h") || !std::strcmp(argv[1], "--help")) {
+        std::cout << R"(usage: ftag-bench gen <outdir> [flags]
+
+writes <outdir>/main.tags, <outdir>/.fileindex (and its shard <outdir>/.fileindex.<device>) and the files they
+reference under <outdir>/tree
+
+flags:
+    --files <n>            : number of indexed files (default 1000)
+    --tags <n>             : number of tags (default 100)
+    --depth <n>            : levels in the tag graph (default 4)
+    --fan-out <n>          : max supertags of each tag below the first level, picked from the level above (default 2)
+    --files-per-tag <n>    : files tagged with each tag (default 10)
+    --path-depth <n>       : directories between the tree root and each file (default 3)
+    --dir-fan-out <n>      : subdirectories per directory (default 16)
+    --cycles <n>           : extra supertag edges that each close a cycle in the tag graph (default 0)
+    --disabled <fraction>  : fraction of tags that are disabled (default 0)
+    --stale <fraction>     : fraction of files indexed and tagged under a wrong inode number, for fix (default 0)
+    --seed <n>             : random seed (default 1)
+    --no-tree              : don't create any files, index made up inode numbers with paths that don't exist
+)";
+        return 0;
+    }
+
+    gen_opts_t opts;
+    const std::filesystem::path outdir = argv[1];
+    for (int i = 2; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--no-tree") {
+            opts.make_tree = false;
+            continue;
+        }
+        if (i >= argc - 1) {
+            ERR_EXIT(1, "expected argument after \"%s\"", argv[i]);
+        }
+        const char *val = argv[++i];
+        if (arg == "--files") {
+            opts.files = std::strtoull(val, nullptr, 0);
+        } else if (arg == "--tags") {
+            opts.tags = std::strtoull(val, nullptr, 0);
+        } else if (arg == "--depth") {
+            opts.depth = std::max<std::uint32_t>(1, std::strtoul(val, nullptr, 0));
+        } else if (arg == "--fan-out") {
+            opts.fan_out = std::strtoul(val, nullptr, 0);
+        } else if (arg == "--files-per-tag") {
+            opts.files_per_tag = std::strtoull(val, nullptr, 0);
+        } else if (arg == "--path-depth") {
+            opts.path_depth = std::strtoul(val, nullptr, 0);
+        } else if (arg == "--dir-fan-out") {
+            opts.dir_fan_out = std::max<std::uint32_t>(1, std::strtoul(val, nullptr, 0));
+        } else if (arg == "--cycles") {
+            opts.cycles = std::strtoull(val, nullptr, 0);
+        } else if (arg == "--disabled") {
+            opts.disabled = std::strtod(val, nullptr);
+        } else if (arg == "--stale") {
+            opts.stale = std::strtod(val, nullptr);
+        } else if (arg == "--seed") {
+            opts.seed = std::strtoull(val, nullptr, 0);
+        } else {
+            ERR_EXIT(1, "flag \"%s\" was not recognized", arg.c_str());
+        }
+    }
+    if (opts.files == 0) {
+        ERR_EXIT(1, "need at least one file");
+    }
+
+    std::mt19937_64 engine(opts.seed);
+    const auto random_below = [&engine](std::uint64_t n) { return std::uniform_int_distribution<std::uint64_t>(0, n - 1)(engine); };
+
+    std::filesystem::create_directories(outdir);
+    const std::filesystem::path tree = std::filesystem::absolute(outdir / "tree");
+    /* everything is indexed on outdir's device, made up inode numbers included */
+    struct stat outdir_buffer{};
+    stat(outdir.c_str(), &outdir_buffer);
+    const dev_t dev = outdir_buffer.st_dev;
+
+    /* files, the first dir_count of them land in distinct directories */
+    std::uint64_t dir_count = 1;
+    for (std::uint32_t d = 0; d < opts.path_depth && dir_count < opts.files; d++) {
+        dir_count *= opts.dir_fan_out;
+    }
+    std::vector<std::uint64_t> inos(opts.files);
+    std::vector<std::string> paths(opts.files);
+    for (std::uint64_t i = 0; i < opts.files; i++) {
+        const std::string dir = tree.string() + file_dir(opts, i);
+        paths[i] = dir + "/f" + std::to_string(i);
+        if (!opts.make_tree) {
+            inos[i] = i + 1;
+            continue;
+        }
+        if (i < dir_count) {
+            std::filesystem::create_directories(dir);
+        }
+        int fd = open(paths[i].c_str(), O_CREAT | O_WRONLY, 0644); /* NOLINT */
+        if (fd < 0) {
+            ERR_EXIT(1, "could not create \"%s\": %s", paths[i].c_str(), std::strerror(errno));
+        }
+        struct stat buffer{};
+        fstat(fd, &buffer);
+        close(fd);
+        inos[i] = buffer.st_ino;
+    }
+
+    /* stale entries get an inode number no real file has */
+    for (std::uint64_t i = 0; i < opts.files; i++) {
+        if (std::uniform_real_distribution<double>(0, 1)(engine) < opts.stale) {
+            inos[i] += 1ULL << 48U;
+        }
+    }
+
+    /* tag graph, every tag below the first level descends from up to fan_out tags of the level above */
+    std::vector<gen_tag_t> tags(opts.tags);
+    std::vector<std::vector<std::uint64_t>> levels(opts.depth);
+    for (std::uint64_t i = 0; i < opts.tags; i++) {
+        tags[i].name = "tag-" + std::to_string(i);
+        tags[i].level = static_cast<std::uint32_t>(i * opts.depth / opts.tags);
+        tags[i].enabled = std::uniform_real_distribution<double>(0, 1)(engine) >= opts.disabled;
+        levels[tags[i].level].push_back(i);
+    }
+    for (gen_tag_t &tag : tags) {
+        if (tag.level == 0 || levels[tag.level - 1].empty()) { continue; }
+        const std::vector<std::uint64_t> &above = levels[tag.level - 1];
+        std::uint64_t n = std::min<std::uint64_t>(1 + random_below(std::max<std::uint32_t>(1, opts.fan_out)), above.size());
+        std::sample(above.begin(), above.end(), std::back_inserter(tag.super), n, engine);
+    }
+    /* a cycle is closed by making the root a deep tag descends from also descend from that deep tag */
+    for (std::uint64_t c = 0; c < opts.cycles && opts.depth > 1 && !levels[opts.depth - 1].empty(); c++) {
+        std::uint64_t deep = levels[opts.depth - 1][random_below(levels[opts.depth - 1].size())];
+        std::uint64_t root = deep;
+        while (tags[root].level > 0) {
+            root = tags[root].super[random_below(tags[root].super.size())];
+        }
+        tags[root].super.push_back(deep);
+    }
+    for (gen_tag_t &tag : tags) {
+        std::uint64_t n = std::min(opts.files_per_tag, opts.files);
+        if (n * 2 > opts.files) {
+            tag.files.resize(opts.files);
+            std::iota(tag.files.begin(), tag.files.end(), 0);
+            std::shuffle(tag.files.begin(), tag.files.end(), engine);
+            tag.files.resize(n);
+        } else {
+            /* sparse, cheaper to retry duplicates than to shuffle every file */
+            std::vector<std::uint64_t> picked;
+            while (picked.size() < n) {
+                std::uint64_t f = random_below(opts.files);
+                if (std::find(picked.begin(), picked.end(), f) == picked.end()) {
+                    picked.push_back(f);
+                }
+            }
+            tag.files = std::move(picked);
+        }
+    }
+
+    /* declare tags in a shuffled order so the parser sees supertags both before and after their subtags */
+    std::vector<std::uint64_t> order(opts.tags);
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), engine);
+    {
+        std::ofstream file(outdir / "main.tags");
+        for (const std::uint64_t &ti : order) {
+            const gen_tag_t &tag = tags[ti];
+            file << tag.name;
+            if (!tag.enabled) {
+                file << " [d]";
+            }
+            if (ti % 3 == 0) {
+                file << " (#" << std::setfill('0') << std::setw(6) << std::hex << ((ti * 2654435761U) & 0xFFFFFFU) << std::dec << ')';
+            }
+            if (!tag.super.empty()) {
+                file << ':';
+                for (const std::uint64_t &si : tag.super) {
+                    file << ' ' << tags[si].name;
+                }
+            }
+            file << '\n';
+            for (const std::uint64_t &fi : tag.files) {
+                file << "  -" << dev << ':' << inos[fi] << '\n';
+            }
+        }
+    }
+    {
+        std::ofstream empty(outdir / ".fileindex"); /* only has files with no device */
+        std::ofstream file(outdir / (".fileindex." + std::to_string(dev)));
+        for (std::uint64_t i = 0; i < opts.files; i++) {
+            file << inos[i] << ':' << paths[i] << std::string{'\0'} + "\n";
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc >= 2 && !std::strcmp(argv[1], "gen")) {
+        return gen_main(argc - 1, argv + 1);
+    }
+    if (argc >= 2 && !std::strcmp(argv[1], "time")) {
+        return time_main(argc - 2, argv + 2);
+    }
+    if (argc >= 2 && !std::strcmp(argv[1], "compare")) {
+        return compare_main(argc - 2, argv + 2);
+    }
+    std::cout << "usage: " << argv[0] << R"( <command> [args]
+
+commands:
+    gen <outdir> [flags]   : generates a synthetic store, see gen --help
+    time <command> [args]  : runs <command> and prints its wall time, peak RSS and exit code as JSON
+    compare <results file> <build a> <build b>
+                           : for every size and command in <results file> (as bench/run.sh writes it) that both builds
+                             ran, prints the fastest run's seconds and the lowest peak RSS of each and b's change
+)";
+    return argc >= 2 && (!std::strcmp(argv[1], "-h") || !std::strcmp(argv[1], "--help")) ? 0 : 1;
+}
@@ -0,0 +1,4 @@
+mkdir -p bin
+${CXX:-clang++} -o bin/ftag-release src/ftag.cc src/libftag.cc src/util.cc -O2 -std=c++20 -pthread
+${CXX:-clang++} -o bin/ftag-bench bench/bench.cc -O2 -std=c++20
+${CXX:-clang++} -o bin/ftag-micro bench/micro.cc src/util.cc -O2 -std=c++20
@@ -0,0 +1,250 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <cstring>
+
+#include "../src/util.hh"
+
+
+/* microbenchmarks for the primitives in src/util.hh
+ *
+ * every case runs at a few sizes and reports the best time per item over several repeats as a JSON line. a case
+ * fails when it is slower than its threshold, in which case the exit code is 1. thresholds are generous budgets for
+ * an optimized build (bench/compile.sh), meant to catch regressions by multiples rather than percents */
+
+template <typename T>
+void keep(const T &value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+struct micro_case_t {
+    std::string name;
+    std::string item; /* what one item is, ns are reported per item */
+    std::vector<std::pair<std::size_t, double>> sizes; /* size, threshold in ns per item */
+    /* sets up for size and returns the work to time, which returns how many items it processed */
+    std::function<std::function<std::size_t()>(std::size_t)> setup;
+};
+
+std::string repeat_str(const std::string &s, std::size_t n) {
+    std::string ret;
+    ret.reserve(s.size() * n);
+    for (std::size_t i = 0; i < n; i++) {
+        ret += s;
+    }
+    return ret;
+}
+
+std::vector<micro_case_t> make_cases() {
+    std::vector<micro_case_t> cases;
+
+    cases.push_back({"split", "token", {{16, 150}, {1024, 150}, {65536, 200}}, [](std::size_t n) {
+        std::string s = repeat_str("tag-name,", n);
+        return std::function<std::size_t()>([s]() {
+            std::vector<std::string> outs;
+            split(s, ",", outs);
+            keep(outs);
+            return outs.size();
+        });
+    }});
+
+    cases.push_back({"split_no_rep_delims", "token", {{16, 200}, {1024, 200}, {65536, 200}}, [](std::size_t n) {
+        std::string s = repeat_str("tag-name   ", n);
+        return std::function<std::size_t()>([s]() {
+            std::vector<std::string> outs;
+            split_no_rep_delims(s, " ", outs);
+            keep(outs);
+            return outs.size();
+        });
+    }});
+
+    cases.push_back({"trim_whitespace", "byte", {{16, 40}, {1024, 25}, {65536, 25}}, [](std::size_t n) {
+        std::string s = std::string(n / 2, ' ') + "x" + std::string(n / 2, '\t');
+        return std::function<std::size_t()>([s]() {
+            std::string t = s;
+            trim_whitespace(t);
+            keep(t);
+            return s.size();
+        });
+    }});
+
+    cases.push_back({"remove_whitespace", "byte", {{16, 30}, {1024, 15}, {65536, 15}}, [](std::size_t n) {
+        std::string s = repeat_str("ab c", n / 4);
+        return std::function<std::size_t()>([s]() {
+            std::string t = s;
+            remove_whitespace(t);
+            keep(t);
+            return s.size();
+        });
+    }});
+
+    cases.push_back({"tag_name_bad", "byte", {{16, 20}, {256, 10}, {4096, 10}}, [](std::size_t n) {
+        std::string s = repeat_str("a-b", n / 3 + 1).substr(0, n);
+        return std::function<std::size_t()>([s]() {
+            bool bad = tag_name_bad(s);
+            keep(bad);
+            return s.size();
+        });
+    }});
+
+    cases.push_back({"hex_to_rgb", "call", {{1, 700}}, [](std::size_t) {
+        return std::function<std::size_t()>([]() {
+            color_t color;
+            std::int32_t n = hex_to_rgb("7f3a9c", color);
+            keep(n);
+            keep(color);
+            return static_cast<std::size_t>(1);
+        });
+    }});
+
+    cases.push_back({"filename", "call", {{2, 200}, {8, 200}, {32, 200}}, [](std::size_t n) {
+        file_info_t file_info{{0, 1}, repeat_str("/directory", n) + "/file.txt"};
+        return std::function<std::size_t()>([file_info]() {
+            std::string_view name = file_info.filename();
+            keep(name);
+            return static_cast<std::size_t>(1);
+        });
+    }});
+
+    cases.push_back({"tagcmp", "comparison", {{16, 50}, {1024, 50}, {16384, 50}}, [](std::size_t n) {
+        static std::unordered_map<tid_t, std::uint32_t> ordinals;
+        ordinals.clear();
+        for (std::size_t i = 0; i < n; i++) {
+            ordinals.emplace(i + 1, i);
+        }
+        std::mt19937_64 engine(1);
+        std::vector<tid_t> ids(256);
+        for (tid_t &id : ids) {
+            id = std::uniform_int_distribution<tid_t>(1, n)(engine);
+        }
+        return std::function<std::size_t()>([ids]() {
+            std::size_t less = 0;
+            for (std::size_t i = 1; i < ids.size(); i++) {
+                less += tagcmp_t{&ordinals}(ids[i - 1], ids[i]);
+            }
+            keep(less);
+            return ids.size() - 1;
+        });
+    }});
+
+    cases.push_back({"hash_bytes", "byte", {{64, 4}, {65536, 1}, {196608, 1}}, [](std::size_t n) {
+        std::string s = repeat_str("fingerprint", n / 11 + 1).substr(0, n);
+        return std::function<std::size_t()>([s]() {
+            std::uint64_t hash = hash_bytes(s.data(), s.size());
+            keep(hash);
+            return s.size();
+        });
+    }});
+
+    cases.push_back({"radix_sort_order", "key", {{1024, 60}, {65536, 100}, {1048576, 250}}, [](std::size_t n) {
+        std::mt19937_64 engine(1);
+        std::vector<std::uint64_t> keys(n);
+        for (std::uint64_t &key : keys) {
+            key = engine() >> 24U; /* 40 bits, like sizes and mtimes, so some passes are skipped and some aren't */
+        }
+        return std::function<std::size_t()>([keys]() {
+            std::vector<std::uint32_t> order(keys.size());
+            for (std::uint32_t i = 0; i < order.size(); i++) {
+                order[i] = i;
+            }
+            radix_sort_order(keys, order);
+            keep(order);
+            return keys.size();
+        });
+    }});
+
+    cases.push_back({"name_table_complete", "lookup", {{1024, 400}, {16384, 600}, {131072, 1000}}, [](std::size_t n) {
+        std::mt19937_64 engine(1);
+        std::vector<std::string> names(n);
+        for (std::string &name : names) {
+            name = "tag-" + std::to_string(engine() % 1000000000);
+        }
+        const name_table_t table = name_table_t::build(names);
+        std::vector<std::string> prefixes(64);
+        for (std::string &prefix : prefixes) {
+            prefix = "tag-" + std::to_string(engine() % 10000);
+        }
+        return std::function<std::size_t()>([table, prefixes]() {
+            std::size_t found = 0;
+            for (const std::string &prefix : prefixes) {
+                found += table.complete(prefix, 16).size();
+            }
+            keep(found);
+            return prefixes.size();
+        });
+    }});
+
+    cases.push_back({"bitset", "bit", {{1024, 20}, {65536, 20}, {1048576, 100}}, [](std::size_t n) {
+        std::mt19937_64 engine(1);
+        std::vector<std::uint32_t> ordinals(4096);
+        for (std::uint32_t &ordinal : ordinals) {
+            ordinal = engine() % n;
+        }
+        return std::function<std::size_t()>([n, ordinals]() {
+            bitset_t bits(n);
+            for (const std::uint32_t &ordinal : ordinals) {
+                bits.set(ordinal, !bits.test(ordinal));
+            }
+            keep(bits.count());
+            return ordinals.size();
+        });
+    }});
+
+    return cases;
+}
+
+int main(int argc, char **argv) {
+    bool check = true;
+    std::string filter;
+    std::uint32_t repeats = 5;
+    double min_seconds = 0.02; /* per repeat */
+    for (int i = 1; i < argc; i++) {
+        if (!std::strcmp(argv[i], "--no-thresholds")) {
+            check = false;
+        } else if (!std::strcmp(argv[i], "--filter") && i < argc - 1) {
+            filter = argv[++i];
+        } else if (!std::strcmp(argv[i], "--repeats") && i < argc - 1) {
+            repeats = std::max(1UL, std::strtoul(argv[++i], nullptr, 0));
+        } else {
+            std::cout << "usage: " << argv[0] << R"( [flags]
+
+flags:
+    --filter <text>    : only runs cases whose name includes <text>
+    --repeats <n>      : repeats per case and size, the best is reported (default 5)
+    --no-thresholds    : reports without failing on thresholds
+)";
+            return std::strcmp(argv[i], "-h") && std::strcmp(argv[i], "--help") ? 1 : 0;
+        }
+    }
+
+    bool failed = false;
+    for (const micro_case_t &mcase : make_cases()) {
+        if (mcase.name.find(filter) == std::string::npos) { continue; }
+        for (const auto &[size, threshold] : mcase.sizes) {
+            std::function<std::size_t()> work = mcase.setup(size);
+            double best = 0;
+            for (std::uint32_t r = 0; r < repeats; r++) {
+                std::size_t items = 0;
+                const auto start = std::chrono::steady_clock::now();
+                std::chrono::duration<double> elapsed{};
+                do {
+                    items += work();
+                    elapsed = std::chrono::steady_clock::now() - start;
+                } while (elapsed.count() < min_seconds);
+                double ns = elapsed.count() * 1e9 / static_cast<double>(std::max<std::size_t>(items, 1));
+                best = r == 0 ? ns : std::min(best, ns);
+            }
+            bool ok = !check || best <= threshold;
+            failed = failed || !ok;
+            std::printf("{\"case\": \"%s\", \"size\": %zu, \"ns_per_%s\": %.3f, \"threshold\": %.1f, \"ok\": %s}\n",
+                mcase.name.c_str(), size, mcase.item.c_str(), best, threshold, ok ? "true" : "false");
+        }
+    }
+    return failed ? 1 : 0;
+}
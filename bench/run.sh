@@ -0,0 +1,135 @@
+#!/usr/bin/env bash
+# end-to-end ftag benchmark, build first with bench/compile.sh
+#
+# generates a store for every size, times each command against a fresh copy of it and appends one JSON object per
+# run to the results file:
+#   {"build": "<git rev>", "size": <files>, "command": "<name>", "run": <n>, "seconds": ..., "max_rss_kb": ..., "exit": ...}
+
+set -eu
+
+sizes="1000 10000 100000 1000000 10000000"
+repeats=3
+results="bench/results.jsonl"
+ftag="bin/ftag-release"
+bench="bin/ftag-bench"
+tree_limit=1000000
+gen_flags=""
+work=""
+only=""
+
+usage() {
+    cat <<USAGE
+usage: $0 [flags]
+
+flags:
+    -s <sizes>     : space separated numbers of files to benchmark (default "$sizes")
+    -r <n>         : runs per command (default $repeats)
+    -o <file>      : appends results to <file> (default $results)
+    -b <ftag>      : ftag binary to benchmark (default $ftag)
+    -t <n>         : largest size that gets a real directory tree, larger sizes only run searches (default $tree_limit)
+    -g <flags>     : extra flags for ftag-bench gen, e.g. "--depth 8 --cycles 4 --disabled 0.1"
+    -c <names>     : only runs the space separated commands <names>
+    -w <dir>       : work directory (default a new temporary directory, removed afterwards)
+USAGE
+}
+
+while getopts "s:r:o:b:t:g:c:w:h" opt; do
+    case "$opt" in
+        s) sizes="$OPTARG" ;;
+        r) repeats="$OPTARG" ;;
+        o) results="$OPTARG" ;;
+        b) ftag="$OPTARG" ;;
+        t) tree_limit="$OPTARG" ;;
+        g) gen_flags="$OPTARG" ;;
+        c) only="$OPTARG" ;;
+        w) work="$OPTARG" ;;
+        h) usage; exit 0 ;;
+        *) usage; exit 1 ;;
+    esac
+done
+
+for bin in "$ftag" "$bench"; do
+    if [ ! -x "$bin" ]; then
+        echo "$0: \"$bin\" not found, run bench/compile.sh first" >&2
+        exit 1
+    fi
+done
+ftag="$(cd "$(dirname "$ftag")" && pwd)/$(basename "$ftag")"
+build="$(git rev-parse --short HEAD 2>/dev/null || echo unknown)"
+if [ -n "$(git status --porcelain --untracked-files=no 2>/dev/null)" ]; then
+    build="$build-dirty"
+fi
+
+if [ -z "$work" ]; then
+    work="$(mktemp -d)"
+    trap 'rm -rf "$work"' EXIT
+fi
+mkdir -p "$work"
+
+# name, whether it mutates the store, whether it needs the directory tree, ftag arguments
+commands=(
+    "load|0|0|search --count -t tag-0"
+    "search-all|0|0|search"
+    "search-tag|0|0|search -t tag-0"
+    "search-all-subtree|0|0|search -a tag-0"
+    "search-file-s|0|0|search -fs f1"
+    "search-file-r|0|0|search -fr f1.*2$"
+    "search-files-only|0|0|search --files-only --full-path-only"
+    "add-r|1|1|add -r \$tree"
+    "tag-add-r|1|1|tag add bench-new -r \$tree"
+    "rm-r|1|1|rm -r \$tree/d1"
+    "update-r|1|1|update -r \$tree"
+    "fix-p|1|1|fix -p"
+)
+
+# fresh copy of the generated store in $work/run, for add-r it starts out empty
+prepare() {
+    rm -rf "$work/run"
+    mkdir -p "$work/run"
+    if [ "$1" = "add-r" ]; then
+        : > "$work/run/main.tags"
+        : > "$work/run/.fileindex"
+    else
+        cp "$work/store/main.tags" "$work/store/.fileindex" "$work/store/".fileindex.* "$work/run/"
+    fi
+    if [ "$1" = "tag-add-r" ]; then
+        "$ftag" tag create bench-new > /dev/null
+    fi
+}
+
+export FTAG_TAGS_FILE="$work/run/main.tags"
+export FTAG_INDEX_FILE="$work/run/.fileindex"
+tree="$work/store/tree"
+
+for size in $sizes; do
+    tags=$(( size / 100 > 10 ? size / 100 : 10 ))
+    tree_flag=""
+    if [ "$size" -gt "$tree_limit" ]; then
+        tree_flag="--no-tree"
+    fi
+    rm -rf "$work/store"
+    # shellcheck disable=SC2086
+    "$bench" gen "$work/store" --files "$size" --tags "$tags" --files-per-tag 20 --stale 0.01 $tree_flag $gen_flags
+
+    for entry in "${commands[@]}"; do
+        IFS='|' read -r name mutates needs_tree args <<< "$entry"
+        if [ -n "$only" ] && [[ " $only " != *" $name "* ]]; then
+            continue
+        fi
+        if [ "$needs_tree" = 1 ] && [ -n "$tree_flag" ]; then
+            continue
+        fi
+        args="${args//\$tree/$tree}"
+        prepare "$name"
+        for run in $(seq 1 "$repeats"); do
+            if [ "$mutates" = 1 ] && [ "$run" -gt 1 ]; then
+                prepare "$name"
+            fi
+            # every run searches instead of reading what the one before it left in the query cache
+            rm -rf "$work/run/.fileindex.querycache"
+            # shellcheck disable=SC2086
+            timing="$("$bench" time "$ftag" $args)"
+            printf '{"build": "%s", "size": %s, "command": "%s", "run": %s, %s\n' "$build" "$size" "$name" "$run" "${timing#\{}" | tee -a "$results"
+        done
+    done
+done
@@ -1 +1,3 @@
-clang++ -o bin/ftag src/ftag.cc -g -std=c++20 -DDEBUG_BUILD
+mkdir -p bin
+clang++ -o bin/ftag src/ftag.cc src/libftag.cc src/util.cc -g -std=c++20 -pthread -DDEBUG_BUILD
+# tests/run.sh runs the behavior tests against bin/ftag
@@ -1,18 +1,27 @@
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <iomanip>
 #include <iostream>
 #include <filesystem>
 #include <fstream>
+#include <future>
 #include <map>
+#include <mutex>
+#include <new>
 #include <optional>
 #include <random>
 #include <regex>
 #include <string>
 #include <sstream>
+#include <string_view>
+#include <thread>
 #include <unordered_map>
 #include <variant>
 #include <vector>
 
+#include <csignal>
+#include <cstdarg>
 #include <cstdlib>
 #include <cstring>
 
@@ -20,6 +29,9 @@
 #include <sys/ioctl.h>
 #include <unistd.h>
 
+#include "libftag.hh"
+#include "util.hh"
+
 
 #define STRINGIZE_NX(A) #A
 
@@ -30,7 +42,7 @@
 #define VERSIONC 1
 #define VERSION STRINGIZE(VERSIONA) "." STRINGIZE(VERSIONB) "." STRINGIZE(VERSIONC)
 
-#define INO_FORMAT "%lu"
+#define INO_FORMAT "%s"
 
 /* > 0 */
 enum struct warn_level_t : std::uint32_t {
@@ -77,50 +89,60 @@ warn_level_t warn_level = warn_level_t::all; /* NOLINT */
 #endif
 
 
-std::uint16_t get_columns() {
-    static struct winsize w;
-    ioctl(STDOUT_FILENO, TIOCGWINSZ, &w);
-    return w.ws_col;
-} 
+/* --- profiling ---
+ * enabled by --profile or $FTAG_PROFILE, prints libftag's profile as JSON to stderr at exit */
 
-template <typename T>
-T get_random_int() {
-    static std::random_device device{};
-    static std::default_random_engine engine(device());
-    return std::uniform_int_distribution<T>()(engine);
-}
+std::atomic<std::uint64_t> allocation_count{0}; /* NOLINT */
 
-template <class Key, class Tp, class Compare>
-bool map_contains(const std::map<Key, Tp, Compare> &m, const Key &key) {
-    return m.find(key) != m.end();
+/* counts every allocation for the profile. the deletes are kept out of line, inlined into a delete expression gcc
+ * would see a free of what operator new returned */
+void *operator new(std::size_t n) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(n > 0 ? n : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
 }
 
-template <class Key, class Tp, class Compare>
-bool map_contains(const std::unordered_map<Key, Tp, Compare> &m, const Key &key) {
-    return m.find(key) != m.end();
+[[gnu::noinline]] void operator delete(void *p) noexcept {
+    std::free(p); /* NOLINT */
 }
 
-bool file_exists(const std::string &filename, struct stat *pbuffer = nullptr) {
-    struct stat buffer{};
-    if (pbuffer == nullptr) {
-        pbuffer = &buffer;
-    }
-    return !stat(filename.c_str(), pbuffer);
+[[gnu::noinline]] void operator delete(void *p, std::size_t) noexcept {
+    std::free(p); /* NOLINT */
 }
 
-ino_t path_get_ino(const std::filesystem::path &path) {
-    struct stat buffer{};
-    stat(path.c_str(), &buffer);
-    return buffer.st_ino;
-}
+/* counts what goes through std::cout when profiling */
+struct counting_streambuf_t : std::streambuf {
+    std::streambuf *dest;
 
-std::uint64_t generate_unique_tid();
+    explicit counting_streambuf_t(std::streambuf *dest) : dest(dest) {}
 
-struct color_t {
-    std::uint16_t r = 0, g = 0, b = 0;
+protected:
+    int overflow(int c) override {
+        if (c != traits_type::eof()) {
+            profile.bytes_written++;
+        }
+        return dest->sputc(static_cast<char>(c));
+    }
+
+    std::streamsize xsputn(const char *s, std::streamsize n) override {
+        profile.bytes_written += n;
+        return dest->sputn(s, n);
+    }
+
+    int sync() override {
+        return dest->pubsync();
+    }
 };
 
 
+std::uint16_t get_columns() {
+    static struct winsize w;
+    ioctl(STDOUT_FILENO, TIOCGWINSZ, &w);
+    return w.ws_col;
+} 
+
 const std::string esc = "\033["; /* NOLINT */
 const std::string reset = esc + "0m"; /* NOLINT */
 
@@ -144,152 +166,7 @@ void underline_out(std::ostream &out = std::cout) {
     out << esc << "4m";
 }
 
-/* 0 is an invalid value for both tids and inode number numbers */
-using tid_t = std::uint64_t; /* temporary, changes every run */
-
-struct tag_t {
-    std::uint64_t id = 0;
-    std::string name; /* can't have spaces, parens, square brackets, colons, and cannot start with a dash, encourages plain naming style something-like-this */
-    std::optional<color_t> color;
-    std::vector<tid_t> sub;
-    std::vector<tid_t> super;
-    std::vector<ino_t> files; /* file inode numbers */
-    bool enabled = true;
-};
-
-bool path_ok(const std::string &pathstr) {
-    try {
-        const std::filesystem::path p = std::filesystem::path(pathstr);
-    } catch (const std::exception &e) {
-        return false;
-    }
-    return true;
-}
-
-struct file_info_t {
-    ino_t file_ino;
-    std::string pathstr;
-    std::vector<tid_t> tags;
-
-    bool unresolved() const {
-        return pathstr.empty();
-    }
-    
-    /* caching? why not! clearly checking if pathstr is ok is extremely expensive... */
-    bool pathstr_ok() const {
-        static std::string last_pathstr;
-        static bool last_ok = false;
-        if (last_pathstr != pathstr) {
-            last_pathstr = pathstr;
-            last_ok = path_ok(pathstr);
-        }
-        return last_ok;
-    }
-
-    /* caching? why not! clearly grabbing the filename from pathstr is extremely expensive... */
-    std::string filename() const {
-        static std::string last_pathstr;
-        static std::string last_filename;
-        if (last_pathstr != pathstr) {
-            last_pathstr = pathstr;
-            last_filename = std::filesystem::path(pathstr).filename().string();
-        }
-        return last_filename;
-    }
-
-    std::filesystem::path path() const {
-        static std::string last_pathstr;
-        static std::filesystem::path last_path;
-        if (last_pathstr != pathstr) {
-            last_pathstr = pathstr;
-            last_path = std::filesystem::path(pathstr);
-        }
-        return last_path;
-    }
-};
-
-
-std::vector<tid_t> tags_parsed_order; /* NOLINT */
-
-/* have to use a cmp struct here instead of normal lambda cmp because of storage/lifetime bs */
-struct tagcmp_t {
-    bool operator()(const tid_t &a, const tid_t &b) const {
-        return std::find(tags_parsed_order.begin(), tags_parsed_order.end(), a) < std::find(tags_parsed_order.begin(), tags_parsed_order.end(), b);
-    }
-};
-
-std::map<tid_t, tag_t, tagcmp_t> tags; /* NOLINT */
-
-std::uint64_t generate_unique_tid() {
-    std::uint64_t id = 0;
-    bool in = false;
-    do {
-        in = false;
-        id = get_random_int<std::uint64_t>();
-        for (const auto &[tagid, _] : tags) {
-            in = in || (tagid == id);
-        }
-    } while (in || id == 0);
-    return id;
-}
-
-void split(const std::string &s, const std::string &delim, std::vector<std::string> &outs, std::uint32_t n = 0) {
-    std::size_t last = 0, next = 0;
-    while ((next = s.find(delim, last)) != std::string::npos) {
-        outs.push_back(s.substr(last, next - last));
-        if (n > 0 && outs.size() >= n) { break; }
-        last = next + delim.size();
-    }
-    if (last != s.size()) { outs.push_back(s.substr(last, s.size())); }
-}
-
-/* same output for "a,,b,c" as normal split on "a,b,c" both with delim "," */
-void split_no_rep_delims(const std::string &s, const std::string &delim, std::vector<std::string> &outs, std::uint32_t n = 0) {
-    std::size_t last = 0, next = 0;
-    while ((next = s.find(delim, last)) != std::string::npos) {
-        outs.push_back(s.substr(last, next - last));
-        if (n > 0 && outs.size() >= n) { break; }
-        last = next + delim.size();
-        for (; last < s.size(); last += delim.size()) {
-            if (s.substr(last, delim.size()) != delim) { break; }
-        }
-    }
-    if (last != s.size()) { outs.push_back(s.substr(last, s.size())); }
-}
-
-
-std::string get_file_content(const std::string &filename) {
-    std::ifstream file(filename);
-    std::stringstream ss;
-    ss << file.rdbuf();
-    std::string text = ss.str();
-    file.close();
-    return text;
-}
-
-inline void remove_whitespace(std::string &str) {
-    str.erase(std::remove_if(str.begin(), str.end(), [](const char &c) { return std::isspace(c); }), str.end());
-}
-
-inline void trim_whitespace(std::string &str) {
-    for (std::uint32_t i = 0; i < str.size(); i++) {
-        if (std::isspace(str[i])) {
-            str.erase(str.begin() + i);
-            i--;
-        } else {
-            break;
-        }
-    }
-    for (auto i = static_cast<std::int32_t>(str.size() - 1); i >= 0; i--) {
-        if (std::isspace(str[i])) {
-            str.erase(str.begin() + i);
-        } else {
-            break;
-        }
-    }
-}
-
- /* NOLINTBEGIN */
+/* NOLINTBEGIN */
 std::string config_directory = "/.config/ftag/";
 const std::string c_tags_filename = "main.tags";
 const std::string c_index_filename = ".fileindex";
@@ -299,307 +176,8 @@ bool set_tags_file = false;
 bool set_index_file = false;
 /* NOLINTEND */
 
-std::map<ino_t, file_info_t> file_index; /* NOLINT */
-
-std::int32_t hex_to_rgb(const std::string &s, color_t &color) {
-    return sscanf(s.c_str(), "%2hx%2hx%2hx", &color.r, &color.g, &color.b); /* NOLINT */
-}
-
-std::string rgb_to_hex(const color_t &color) {
-    std::stringstream s;
-    s << std::setfill('0') << std::setw(6) << std::hex;
-    s << (color.r << 16 | color.g << 8 | color.b);
-    return s.str();
-}
-
-bool tag_name_bad(const std::string &tname) {
-    bool name_bad = (tname[0] == '-');
-    for (const char &c : tname) {
-        name_bad = name_bad || (c == ' ' || c == '(' || c == ')' || c == '[' || c == ']' || c == ':');
-    }
-    return name_bad;
-}
-
-
-/* loops in the tag graph are discouraged but are allowed, including a tag having a supertag be itself */
-
-/* *** RUN read_file_index BEFORE THIS ***
- * in order to correctly/efficiently add to file_info_t::tags
- *
- * [] denote the state list, right now only possible members are 'd' for disabled and 'e' for enabled (default, so specifying 'e' is redundant)
- *
- * --- tag file structure ---
- *
- * tag-name: super-tag other-super-tag
- * -[file inode number]
- * -[file inode number]
- * other-tag-name (FF0000): blah-super-tag super-tag
- * blah-tag-name (#FF7F7F)
- * disabled-tag-name [d] (#FF7F7F): enabled-tag-name
- * enabled-tag-name
- * also-enabled-tag-name [e]
- */
-void read_saved_tags() {
-    std::string tags_file_content = get_file_content(tags_file);
-    std::vector<std::string> lines;
-    split_no_rep_delims(tags_file_content, "\n", lines);
-
-    std::optional<tag_t> current_tag;
-    std::unordered_map<tid_t, std::vector<std::string>> unresolved_stags; /* main tag id, supertag names */
-    for (std::uint32_t i = 0; i < lines.size(); i++) {
-        const std::string &line = lines[i];
-        std::string no_whitespace_line = line;
-        remove_whitespace(no_whitespace_line);
-        if (no_whitespace_line.empty()) { continue; }
-        std::string supertags;
-
-#define FINISH_TAG { \
-    if (current_tag.has_value()) { \
-        tags_parsed_order.push_back(current_tag.value().id); /* should do before we add it */ \
-        tags[current_tag.value().id] = current_tag.value(); \
-    } \
-}
-
-#define START_TAG { \
-    current_tag = tag_t(); \
-    current_tag.value().id = generate_unique_tid(); \
-}
-
-        /* is a file inode number line */
-        if (no_whitespace_line[0] == '-') {
-            if (!current_tag.has_value()) {
-                ERR_EXIT(1, "tag file \"%s\" line %i had \"-[file inode number]\" under no active tag", tags_file.c_str(), i + 1);
-            }
-            std::string file_ino_str = no_whitespace_line.substr(1);
-            ino_t file_ino = std::strtoul(file_ino_str.c_str(), nullptr, 0);
-            if (file_ino == 0) {
-                ERR_EXIT(1, "tag file \"%s\" line %i had bad file inode number: \"%s\"", tags_file.c_str(), i + 1, file_ino_str.c_str());
-            }
-            current_tag.value().files.push_back(file_ino);
-            if (map_contains(file_index, file_ino)) {
-                file_index[file_ino].tags.push_back(current_tag.value().id);
-            }
-            continue;
-        /* is a declaring tag line */
-        } else {
-            FINISH_TAG;
-            START_TAG;
-            std::string ttag;
-            std::string tname;
-            std::size_t colon_pos = line.find(':');
-            bool has_colon = colon_pos != std::string::npos;
-
-            /* is still a declaring tag line, just without any supertags */
-            if (!has_colon) {
-                ttag = no_whitespace_line;
-            } else {
-                ttag = line.substr(0, colon_pos);
-                remove_whitespace(ttag);
-                supertags = line.substr(colon_pos + 1);
-            }
-            if (ttag.empty()) {
-                ERR_EXIT(1, "tag file \"%s\" line %i had empty tag name", tags_file.c_str(), i + 1);
-            }
-            std::size_t sqbegin = ttag.find('[');
-            std::size_t sqend = ttag.find(']');
-            std::size_t pbegin = ttag.find('(');
-            std::size_t pend = ttag.find(')');
-            bool has_states = false;
-            bool has_color = false;
-
-            if (sqend != std::string::npos && sqbegin != std::string::npos) {
-                if (sqbegin >= sqend) {
-                    ERR_EXIT(1, "tag file \"%s\" line %i state list had ']' before '['", tags_file.c_str(), i + 1);
-                }
-                has_states = true;
-                std::string statesstr = ttag.substr(sqbegin + 1, sqend - sqbegin - 1);
-                std::vector<std::string> states;
-                split(statesstr, ",", states);
-                for (const std::string &state : states) {
-                    std::string rwstate = state;
-                    if (rwstate == "e") {
-                        current_tag.value().enabled = true;
-                    } else if (rwstate == "d") {
-                        current_tag.value().enabled = false;
-                    }
-                }
-            }
-            if (pend != std::string::npos && pbegin != std::string::npos) {
-                current_tag.value().color = color_t();
-                if (pbegin >= pend) {
-                    ERR_EXIT(1, "tag file \"%s\" line %i color had ')' before '('", tags_file.c_str(), i + 1);
-                }
-                has_color = true;
-                std::string hexstr = ttag.substr(pbegin + 1, pend - pbegin - 1);
-                if (hexstr[0] == '#') { hexstr.erase(hexstr.begin()); }
-                if (hex_to_rgb(hexstr, current_tag.value().color.value()) != 3) {
-                    ERR_EXIT(1, "tag file \"%s\" line %i had bad hex color: \"%s\"", tags_file.c_str(), i + 1, hexstr.c_str());
-                }
-            }
-
-            if (has_color || has_states) {
-                tname = ttag.substr(0, std::min(pbegin, sqbegin));
-            } else {
-                tname = ttag;
-            }
-
-            if (tname.empty()) {
-                ERR_EXIT(1, "tag file \"%s\" line %i had empty tag name", tags_file.c_str(), i + 1);
-            }
-            /* check if tname is good */
-            if (tag_name_bad(tname)) {
-                ERR_EXIT(1, "tag file \"%s\" line %i had bad tag name: \"%s\"", tags_file.c_str(), i + 1, tname.c_str());
-            }
-            current_tag.value().name = tname;
-
-            for (const auto &[_, tag] : tags) {
-                if (tag.name == tname) {
-                    ERR_EXIT(1, "tag file \"%s\" line %i redefined tag \"%s\"", tags_file.c_str(), i + 1, tname.c_str());
-                }
-            }
-
-            /* no supertags */
-            if (!has_colon) { continue; }
-
-            trim_whitespace(supertags);
-            if (supertags.empty()) {
-                WARN("tag file \"%s\" line %i tag name \"%s\" had empty supertags, expected supertags due to ':'", tags_file.c_str(), i + 1, tname.c_str());
-                continue;
-            }
-            std::vector<std::string> tstags;
-            split_no_rep_delims(supertags, " ", tstags);
-            for (const std::string &stag_name : tstags) {
-                tid_t stag_id = 0;
-                for (auto &[tagid, tag] : tags) {
-                    if (tag.name == stag_name) {
-                        stag_id = tagid;
-                        tag.sub.push_back(current_tag.value().id);
-                        break;
-                    }
-                }
-                if (stag_id == 0) {
-                    unresolved_stags[current_tag.value().id].push_back(stag_name);
-                } else {
-                    current_tag.value().super.push_back(stag_id);
-                }
-            }
-            continue;
-        }
-    }
-
-    /* residual finishing tag */
-    FINISH_TAG;
-
-#undef FINISH_TAG
-#undef START_TAG
-
-    /* resolve unresolved supertags */
-    for (const auto &[utag, stags] : unresolved_stags) {
-        std::vector<tid_t> resolved_stag_ids;
-        for (const std::string &stag_name : stags) {
-            bool found = false;
-            for (auto &[tagid, tag] : tags) {
-                if (tag.name == stag_name) {
-                    found = true;
-                    tag.sub.push_back(utag);
-                    resolved_stag_ids.push_back(tagid);
-                }
-            }
-            if (!found) {
-                ERR_EXIT(1, "tag file \"%s\" tag \"%s\" referenced unresolved supertag \"%s\" which was never declared after", tags_file.c_str(), tags[utag].name.c_str(), stag_name.c_str());
-            }
-        }
-        tags[utag].super.insert(tags[utag].super.end(), resolved_stag_ids.begin(), resolved_stag_ids.end());
-    }
-}
-
-/* overwrites the file */
-void dump_saved_tags() {
-    std::ofstream file(tags_file);
-    for (const auto &[id, tag] : tags) {
-        file << tag.name;
-
-        /* states */
-        if (!tag.enabled) {
-            file << " [d]";
-        }
-        /* end states */
-
-        if (tag.color.has_value()) {
-            file << " (#" << rgb_to_hex(tag.color.value()) << ')'; /* NOLINT */
-        }
-        if (!tag.super.empty()) {
-            file << ':';
-            for (const tid_t &id : tag.super) {
-                file << ' ' << tags[id].name;
-            }
-        }
-        file << '\n';
-        for (const ino_t &file_ino : tag.files) {
-            file << "  -" << file_ino << '\n';
-        }
-    }
-}
-
-/* --- index file structure ---
- *
- * [file inode number]:[full path]\0
- * [file inode number]:[full path]\0
- */
-void read_file_index() {
-    std::string index_content = get_file_content(index_file);
-    std::vector<std::string> lines;
-    split(index_content, std::string{'\0'} + "\n", lines);
-    lines.erase(std::remove(lines.begin(), lines.end(), ""), lines.end());
-    for (std::uint32_t i = 0; i < lines.size(); i++) {
-        const std::string &line = lines[i];
-        std::size_t colon_pos = line.find(':');
-        if (colon_pos == std::string::npos) {
-            ERR_EXIT(1, "index file \"%s\" line %i had no ':', could not parse", index_file.c_str(), i);
-        }
-        std::string file_ino_str = line.substr(0, colon_pos);
-        ino_t file_ino = std::strtoul(file_ino_str.c_str(), nullptr, 0);
-        if (file_ino == 0) {
-            ERR_EXIT(1, "index file \"%s\" line %i had bad file inode number \"%s\"", index_file.c_str(), i, file_ino_str.c_str());
-        }
-        std::string pathstr = line.substr(colon_pos + 1);
-        /* struct stat buffer{};
-        bool exists = file_exists(pathstr, &buffer); */
-        if (pathstr.empty()) {
-            WARN("index file \"%s\" had file inode number " INO_FORMAT " with empty file path, you might want to run the update command", index_file.c_str(), file_ino);
-        }
-        /* else if (!pathstr.empty() && !exists) {
-            WARN("index file \"%s\" had file inode number " INO_FORMAT " with file path \"%s\" which does not exist, you might want to run the update command", index_file.c_str(), file_ino, pathstr.c_str());
-        } else if (exists && buffer.st_ino != file_ino) {
-            WARN("index file \"%s\" had file inode number " INO_FORMAT " with file path \"%s\" which exists but has different inode number " INO_FORMAT " on disk, you might want to run the update command", index_file.c_str(), file_ino, pathstr.c_str(), buffer.st_ino);
-        } */
-        /* ***
-         * weakly_canonical does file exists checks... performance killer!
-         * *** */
-        /* std::filesystem::path can = std::filesystem::weakly_canonical(pathstr); */
-        file_index[file_ino] = file_info_t{file_ino, std::filesystem::path(pathstr)};
-    }
-}
-
-void dump_file_index() {
-    std::ofstream file(index_file);
-    for (const auto &[file_ino, file_info] : file_index) {
-        /* file << file_ino << ':' << std::filesystem::weakly_canonical(file_info.pathstr).string() << std::string{'\0'} + "\n"; */
-        file << file_ino << ':' << std::filesystem::path(file_info.pathstr).string() << std::string{'\0'} + "\n";
-    }
-}
-
-
-std::vector<tid_t> enabled_only(const std::vector<tid_t> &tagids) {
-    std::vector<tid_t> ret;
-    for (const tid_t &id : tagids) {
-        if (tags[id].enabled) {
-            ret.push_back(id);
-        }
-    }
-    return ret;
-}
-
+/* never destroyed, exit doesn't have to walk the whole store to free it. its lock goes with the process */
+store_t &store = *new store_t; /* NOLINT */
 
 enum struct display_type_t : std::uint16_t {
     tags_files, tags, files
@@ -613,53 +191,6 @@ enum struct show_tag_info_t : std::uint16_t {
     name_only, full_info, chain
 };
 
-enum struct search_rule_type_t : std::uint16_t {
-    tag, tag_exclude, file, file_exclude, all, all_exclude,
-    all_list, all_list_exclude,
-    inode, inode_exclude
-};
-
-enum struct search_opt_t : std::uint16_t {
-    exact, text_includes, regex
-};
-
-struct search_rule_t {
-    search_rule_type_t type = search_rule_type_t::tag; /* doesn't matter not used */
-    search_opt_t opt = search_opt_t::exact;
-    std::string text;
-    ino_t inum = 0;
-};
-
-const std::unordered_map<std::string, search_rule_type_t> arg_to_rule_type = { /* NOLINT */
-    {"t", search_rule_type_t::tag},
-    {"tag", search_rule_type_t::tag},
-    {"te", search_rule_type_t::tag_exclude},
-    {"tag-exclude", search_rule_type_t::tag_exclude},
-    {"f", search_rule_type_t::file},
-    {"file", search_rule_type_t::file},
-    {"fe", search_rule_type_t::file_exclude},
-    {"file-exclude", search_rule_type_t::file_exclude},
-    {"a", search_rule_type_t::all},
-    {"all", search_rule_type_t::all},
-    {"ae", search_rule_type_t::all_exclude},
-    {"all-exclude", search_rule_type_t::all_exclude},
-
-    {"al", search_rule_type_t::all_list},
-    {"all-list", search_rule_type_t::all_list},
-    {"ale", search_rule_type_t::all_list_exclude},
-    {"all-list-exclude", search_rule_type_t::all_list_exclude},
-
-    {"i", search_rule_type_t::inode},
-    {"inode", search_rule_type_t::inode},
-    {"ie", search_rule_type_t::inode_exclude},
-    {"inode-exclude", search_rule_type_t::inode_exclude}
-};
-
-const std::unordered_map<std::string, search_opt_t> arg_to_opt = { /* NOLINT */
-    {"s", search_opt_t::text_includes},
-    {"r", search_opt_t::regex}
-};
-
 enum struct change_entry_type_t : std::uint16_t {
     /* all entries is slightly misleading since we don't include like symlinks, /dev/null (character files), etc. */
     only_files, only_directories, all_entries
@@ -672,47 +203,49 @@ enum struct change_rule_type_t : std::uint16_t {
 struct change_rule_t {
     std::filesystem::path path;
     change_rule_type_t type;
-    ino_t file_ino = 0;
+    file_id_t file_id;
     bool from_ino = false;
 };
 
 enum struct fix_rule_type_t : std::uint16_t {
-    rip, rii, rpp, rpi, path_all, path_p, path_i
+    rip, rii, rpp, rpi, path_all, path_p, path_i, by_content
 };
 
 struct fix_rule_t {
-    std::variant<ino_t, std::filesystem::path> a, b;
-    std::variant<ino_t, std::filesystem::path> path_d; /* used for when type is path_all, path_p, or path_i */
+    std::variant<file_id_t, std::filesystem::path> a, b;
+    std::variant<file_id_t, std::filesystem::path> path_d; /* used for when type is path_all, path_p, path_i or by_content */
     fix_rule_type_t type;
 };
 
-void add_all(const tid_t &tagid, std::vector<tid_t> &tags_visited, std::map<tid_t, bool, tagcmp_t> &tags_map, std::map<ino_t, bool> &files_map, bool exclude) {
-    if (std::find(tags_visited.begin(), tags_visited.end(), tagid) == tags_visited.end()) {
-        tags_visited.push_back(tagid);
-        tags_map[tagid] = !exclude;
-        for (const ino_t &file_ino : tags[tagid].files) {
-            files_map[file_ino] = !exclude;
+enum struct chain_relation_type_t : std::uint16_t {
+    original, super, sub
+};
+
+/* a virtual tag's search as it would be passed to the search command */
+std::string virtual_tag_str(const virtual_tag_t &virtual_tag) {
+    std::string ret = virtual_tag.rules.empty() ? "-al" : "";
+    for (const search_rule_t &rule : virtual_tag.rules) {
+        ret += (ret.empty() ? "" : " ") + search_flag(rule);
+        if (rule.type == search_rule_type_t::inode || rule.type == search_rule_type_t::inode_exclude) {
+            ret += ' ' + file_id_str(rule.inum);
+        } else if (rule.type != search_rule_type_t::all_list && rule.type != search_rule_type_t::all_list_exclude) {
+            ret += ' ' + rule.text;
         }
-    } else {
-        return;
     }
-    for (const tid_t &id : enabled_only(tags[tagid].sub)) {
-        add_all(id, tags_visited, tags_map, files_map, exclude);
+    if (virtual_tag.search_file_path) {
+        ret += ret.empty() ? "--search-file-path" : " --search-file-path";
     }
+    return ret;
 }
 
-enum struct chain_relation_type_t : std::uint16_t {
-    original, super, sub
-};
-
-void display_tag_info(const tag_t &tag, std::vector<tid_t> &tags_visited, std::map<tid_t, bool, tagcmp_t> &tags_matched, bool color_enabled, const show_tag_info_t &show_tag_info, bool no_formatting, chain_relation_type_t relation, std::optional<std::uint32_t> custom_file_count = {}) { /* notably, does not append newline */
+void display_tag_info(const tag_t &tag, std::vector<tid_t> &tags_visited, const bitset_t &tags_matched, bool color_enabled, const show_tag_info_t &show_tag_info, bool no_formatting, chain_relation_type_t relation, std::optional<std::uint32_t> custom_file_count = {}) { /* notably, does not append newline */
     if (std::find(tags_visited.begin(), tags_visited.end(), tag.id) == tags_visited.end()) {
         tags_visited.push_back(tag.id);
     } else {
         if (relation == chain_relation_type_t::original && !no_formatting) {
             underline_out();
         }
-        if (tags_matched[tag.id] && !no_formatting) {
+        if (tags_matched.test(tag.ordinal) && !no_formatting) {
             bold_out();
         }
         if (color_enabled && tag.color.has_value() && !no_formatting) {
@@ -729,22 +262,26 @@ void display_tag_info(const tag_t &tag, std::vector<tid_t> &tags_visited, std::m
             } else {
                 std::cout << " {" << tag.files.size() << "}";
             }
+            auto vit = store.virtual_tags.find(tag.id);
+            if (vit != store.virtual_tags.end()) {
+                std::cout << " [= " << virtual_tag_str(vit->second) << "]";
+            }
         }
         return;
     }
     if (relation != chain_relation_type_t::sub && show_tag_info != show_tag_info_t::name_only) {
-        std::vector<tid_t> tagsuper = enabled_only(tag.super);
+        std::vector<tid_t> tagsuper = store.enabled_only(tag.super);
         if (!tagsuper.empty()) {
             if (tagsuper.size() > 1) {
                 std::cout << '(';
                 for (std::uint32_t i = 0; i < tagsuper.size() - 1; i++) {
-                    display_tag_info(tags[tagsuper[i]], tags_visited, tags_matched, color_enabled, show_tag_info, no_formatting, chain_relation_type_t::super);
+                    display_tag_info(store.tags[tagsuper[i]], tags_visited, tags_matched, color_enabled, show_tag_info, no_formatting, chain_relation_type_t::super);
                     std::cout << " | ";
                 }
-                display_tag_info(tags[tagsuper[tagsuper.size() - 1]], tags_visited, tags_matched, color_enabled, show_tag_info, no_formatting, chain_relation_type_t::super);
+                display_tag_info(store.tags[tagsuper[tagsuper.size() - 1]], tags_visited, tags_matched, color_enabled, show_tag_info, no_formatting, chain_relation_type_t::super);
                 std::cout << ')';
             } else {
-                display_tag_info(tags[tagsuper[0]], tags_visited, tags_matched, color_enabled, show_tag_info, no_formatting, chain_relation_type_t::super);
+                display_tag_info(store.tags[tagsuper[0]], tags_visited, tags_matched, color_enabled, show_tag_info, no_formatting, chain_relation_type_t::super);
             }
             std::cout << " > ";
         }
@@ -752,7 +289,7 @@ void display_tag_info(const tag_t &tag, std::vector<tid_t> &tags_visited, std::m
     if (relation == chain_relation_type_t::original && !no_formatting) {
         underline_out();
     }
-    if (tags_matched[tag.id] && !no_formatting) {
+    if (tags_matched.test(tag.ordinal) && !no_formatting) {
         bold_out();
     }
     if (color_enabled && tag.color.has_value() && !no_formatting) {
@@ -769,21 +306,25 @@ void display_tag_info(const tag_t &tag, std::vector<tid_t> &tags_visited, std::m
         } else {
             std::cout << " {" << tag.files.size() << "}";
         }
+        auto vit = store.virtual_tags.find(tag.id);
+        if (vit != store.virtual_tags.end()) {
+            std::cout << " [= " << virtual_tag_str(vit->second) << "]";
+        }
     }
     if (relation != chain_relation_type_t::super && show_tag_info == show_tag_info_t::full_info) {
-        std::vector<tid_t> tagsub = enabled_only(tag.sub);
+        std::vector<tid_t> tagsub = store.enabled_only(tag.sub);
         if (!tagsub.empty()) {
             std::cout << " > ";
             if (tagsub.size() > 1) {
                 std::cout << '(';
                 for (std::uint32_t i = 0; i < tagsub.size() - 1; i++) {
-                    display_tag_info(tags[tagsub[i]], tags_visited, tags_matched, color_enabled, show_tag_info, no_formatting, chain_relation_type_t::sub);
+                    display_tag_info(store.tags[tagsub[i]], tags_visited, tags_matched, color_enabled, show_tag_info, no_formatting, chain_relation_type_t::sub);
                     std::cout << " | ";
                 }
-                display_tag_info(tags[tagsub[tagsub.size() - 1]], tags_visited, tags_matched, color_enabled, show_tag_info, no_formatting, chain_relation_type_t::sub);
+                display_tag_info(store.tags[tagsub[tagsub.size() - 1]], tags_visited, tags_matched, color_enabled, show_tag_info, no_formatting, chain_relation_type_t::sub);
                 std::cout << ')';
             } else {
-                display_tag_info(tags[tagsub[0]], tags_visited, tags_matched, color_enabled, show_tag_info, no_formatting, chain_relation_type_t::sub);
+                display_tag_info(store.tags[tagsub[0]], tags_visited, tags_matched, color_enabled, show_tag_info, no_formatting, chain_relation_type_t::sub);
             }
         }
     }
@@ -819,7 +360,7 @@ string_format_t string_format_file_info(const file_info_t &file_info, bool was_m
     std::stringstream ret;
     bool underline = false, bold = false;
     if (show_file_info == show_file_info_t::inum_only) {
-        ret << file_info.file_ino;
+        ret << file_id_str(file_info.file_id);
     } else {
         if (file_info.unresolved()) {
             if (!no_formatting) {
@@ -830,7 +371,7 @@ string_format_t string_format_file_info(const file_info_t &file_info, bool was_m
             }
             ret << "<unresolved>";
             if (show_file_info == show_file_info_t::full_info) {
-                ret << " {" << file_info.tags.size() << "} (" << file_info.file_ino << ')';
+                ret << " {" << file_info.tags.size() << "} (" << file_id_str(file_info.file_id) << ')';
             }
         } else {
             if (was_matched && !no_formatting) {
@@ -839,7 +380,7 @@ string_format_t string_format_file_info(const file_info_t &file_info, bool was_m
             if (show_file_info == show_file_info_t::full_path_only) {
                 ret << std::filesystem::path(file_info.pathstr);
             } else if (show_file_info == show_file_info_t::full_info) {
-                ret << file_info.filename() << " {" << file_info.tags.size() << "} (" << file_info.file_ino << "): " << std::filesystem::path(file_info.pathstr);
+                ret << file_info.filename() << " {" << file_info.tags.size() << "} (" << file_id_str(file_info.file_id) << "): " << std::filesystem::path(file_info.pathstr);
             } else if (show_file_info == show_file_info_t::filename_only) {
                 if (quoted) {
                     ret << std::quoted(file_info.filename());
@@ -858,9 +399,9 @@ string_format_t string_format_file_info(const file_info_t &file_info, bool was_m
                 ret << tpath.lexically_proximate(std::filesystem::current_path());
             } else if (show_file_info == show_file_info_t::inum_only) {
                 if (quoted) {
-                    ret << std::quoted(std::to_string(file_info.file_ino));
+                    ret << std::quoted(file_id_str(file_info.file_id));
                 } else {
-                    ret << std::to_string(file_info.file_ino);
+                    ret << file_id_str(file_info.file_id);
                 }
             }
         }
@@ -868,14 +409,23 @@ string_format_t string_format_file_info(const file_info_t &file_info, bool was_m
     return string_format_t{.str = ret.str(), .underline = underline, .bold = bold};
 }
 
-void display_file_list(const std::vector<ino_t> &file_inos, const std::map<ino_t, bool> &matched, bool compact_output, const show_file_info_t &show_file_info, bool no_formatting, bool quoted) {
+/* rank is each file's position in the search --sort order by ordinal, empty to keep the order of file_ids */
+void display_file_list(const std::vector<file_id_t> &file_ids, const bitset_t &matched, bool compact_output, const show_file_info_t &show_file_info, bool no_formatting, bool quoted, const std::vector<std::uint32_t> &rank) {
     static std::uint16_t cols = 0;
     static constexpr std::uint64_t name_sep = 2;
     const std::string sep(name_sep, ' ');
+    std::vector<const file_info_t *> infos;
+    infos.reserve(file_ids.size());
+    for (const file_id_t &file_id : file_ids) {
+        infos.push_back(&store.file_index.at(file_id));
+    }
+    if (!rank.empty()) {
+        std::sort(infos.begin(), infos.end(), [&rank](const file_info_t *a, const file_info_t *b) { return rank[a->ordinal] < rank[b->ordinal]; });
+    }
     std::vector<string_format_t> formats;
-    formats.reserve(file_inos.size());
-    for (const ino_t &file_ino : file_inos) {
-        formats.push_back(string_format_file_info(file_index[file_ino], matched.at(file_ino), show_file_info, no_formatting, quoted));
+    formats.reserve(file_ids.size());
+    for (const file_info_t *file_info : infos) {
+        formats.push_back(string_format_file_info(*file_info, matched.test(file_info->ordinal), show_file_info, no_formatting, quoted));
     }
     if (compact_output) {
         if (cols == 0) {
@@ -935,28 +485,6 @@ void display_file_list(const std::vector<ino_t> &file_inos, const std::map<ino_t
 }
 
 
-ino_t search_index(const std::filesystem::path &tpath) {
-    for (const auto &[file_ino, file_info] : file_index) {
-        if (file_info.pathstr_ok()) {
-            std::filesystem::path opath = std::filesystem::path(file_info.pathstr).lexically_normal();
-            if (tpath == opath) {
-                return file_ino;
-            }
-        }
-    }
-    return 0;
-}
-
-ino_t search_use_fs(const std::filesystem::path &tpath) {
-    struct stat buf{};
-    if (file_exists(tpath.string(), &buf)) {
-        if (map_contains(file_index, buf.st_ino)) {
-            return buf.st_ino;
-        }
-    }
-    return 0;
-}
-
 std::string read_stdin() {
     static constexpr std::streamsize n = 128;
     std::streamsize readn = 0;
@@ -1009,12 +537,17 @@ void parse_as_args(std::vector<std::string> &ret, const std::string &s, const st
 
 
 /* starts parsing from position 0 in argv, offset it if need be */
-void parse_file_args(int argc, char **argv, const std::string &err_command_name, bool is_update, std::vector<change_rule_t> &to_change, bool &search_index_first, change_entry_type_t &change_entry_type, bool use_canonical) {
+/* fingerprint and full are only taken (and --fingerprint, --full only recognized) when not nullptr */
+void parse_file_args(int argc, char **argv, const std::string &err_command_name, bool is_update, std::vector<change_rule_t> &to_change, bool &search_index_first, change_entry_type_t &change_entry_type, bool use_canonical, bool *fingerprint = nullptr, bool *full = nullptr) {
     std::vector<std::string> sargv;
     bool recognize_dash = true;
     bool parse_per_line = true;
     for (std::uint32_t i = 0; i < argc; i++) {
-        if (!std::strcmp(argv[i], "-rd") || !std::strcmp(argv[i], "--recognize-dash")) {
+        if (fingerprint != nullptr && (!std::strcmp(argv[i], "-fp") || !std::strcmp(argv[i], "--fingerprint"))) {
+            *fingerprint = true;
+        } else if (full != nullptr && !std::strcmp(argv[i], "--full")) {
+            *full = true;
+        } else if (!std::strcmp(argv[i], "-rd") || !std::strcmp(argv[i], "--recognize-dash")) {
             recognize_dash = true;
         } else if (!std::strcmp(argv[i], "-id") || !std::strcmp(argv[i], "--ignore-dash")) {
             recognize_dash = false;
@@ -1141,11 +674,11 @@ void parse_file_args(int argc, char **argv, const std::string &err_command_name,
                     i--;
                     break;
                 }
-                ino_t file_ino = std::strtoul(sargv[i].c_str(), nullptr, 0);
-                if (file_ino == 0) {
+                file_id_t file_id;
+                if (!parse_file_id(sargv[i].c_str(), file_id)) {
                     ERR_EXIT(1, "%s: argument %i inode number \"%s\" was not valid", err_command_name.c_str(), i, sargv[i].c_str());
                 }
-                to_change.push_back(change_rule_t{"", change_rule_type_t::inode_number, file_ino});
+                to_change.push_back(change_rule_t{"", change_rule_type_t::inode_number, file_id});
             }
         } else if (sargv[i] == "--search-index") {
             search_index_first = true;
@@ -1163,21 +696,60 @@ void parse_file_args(int argc, char **argv, const std::string &err_command_name,
     }
 }
 
-/* recursive */
-void get_all(const std::filesystem::path &path, std::vector<change_rule_t> &out, std::uint32_t position, const change_entry_type_t &change_entry_type) {
-    for (const auto &entry : std::filesystem::recursive_directory_iterator(path)) {
-        if ((change_entry_type == change_entry_type_t::all_entries      && (entry.is_regular_file() || entry.is_directory())) ||
-            (change_entry_type == change_entry_type_t::only_files       && entry.is_regular_file()) ||
-            (change_entry_type == change_entry_type_t::only_directories && entry.is_directory())
-        ) {
-            out.insert(out.begin() + position++, change_rule_t{entry.path(), change_rule_type_t::single_file, path_get_ino(entry.path())});
+/* recursive. with dir_cache only the entries of directories changed since the last walk are there besides every
+ * directory and the indexed paths in the unchanged ones, see dir_cache_t::walk */
+void get_all(const std::filesystem::path &path, std::vector<change_rule_t> &out, std::uint32_t position, const change_entry_type_t &change_entry_type, dir_cache_t *dir_cache = nullptr, const std::vector<std::string> &indexed = {}) {
+    profile_phase_t phase("walk");
+    std::vector<change_rule_t> found;
+    if (dir_cache != nullptr) {
+        dir_cache->walk(path, indexed, [&](const std::filesystem::path &entry_path, bool is_directory) {
+            profile.files_scanned++;
+            if (is_directory ? change_entry_type != change_entry_type_t::only_files : change_entry_type != change_entry_type_t::only_directories) {
+                found.push_back(change_rule_t{entry_path, change_rule_type_t::single_file, path_get_id(entry_path)});
+            }
+        });
+    } else {
+        for (const auto &entry : std::filesystem::recursive_directory_iterator(path)) {
+            profile.files_scanned++;
+            if ((change_entry_type == change_entry_type_t::all_entries      && (entry.is_regular_file() || entry.is_directory())) ||
+                (change_entry_type == change_entry_type_t::only_files       && entry.is_regular_file()) ||
+                (change_entry_type == change_entry_type_t::only_directories && entry.is_directory())
+            ) {
+                found.push_back(change_rule_t{entry.path(), change_rule_type_t::single_file, path_get_id(entry.path())});
+            }
         }
     }
+    /* one insert, not one per entry shifting everything after position each time */
+    out.insert(out.begin() + position, std::make_move_iterator(found.begin()), std::make_move_iterator(found.end()));
 }
 
 
 
 int main(int argc, char **argv) { /* NOLINT */
+    const char *envprofile = std::getenv("FTAG_PROFILE");
+    profile.enabled = envprofile && *envprofile && std::strcmp(envprofile, "0") != 0;
+    /* taken out of argv here so no command has to know about it */
+    int kept_argc = 0;
+    for (int i = 0; i < argc; i++) {
+        if (i > 0 && !std::strcmp(argv[i], "--profile")) {
+            profile.enabled = true;
+            continue;
+        }
+        argv[kept_argc++] = argv[i];
+    }
+    argc = kept_argc;
+    argv[argc] = nullptr;
+    static counting_streambuf_t counting_buf(std::cout.rdbuf());
+    if (profile.enabled) {
+        profile.command = argc > 1 ? argv[1] : "";
+        std::cout.rdbuf(&counting_buf);
+        std::atexit([]() {
+            std::cout.flush();
+            profile.allocations = allocation_count.load();
+            profile.print();
+        });
+    }
+
     bool custom_tags_file = false;
     bool custom_index_file = false;
     const char *envindex = std::getenv("FTAG_INDEX_FILE");
@@ -1231,12 +803,16 @@ commands:
     rm <flags>                          : removes files to be tracked/tagged by ftag
     update [flags]                      : updates the index of tracked files, use if some have been moved/renamed
     fix [flags]                         : fixes the inode numbers used in the tags file and index file
+    stats [flags]                       : prints tag usage and co-occurrence counts as JSON
+    export <flags>                      : writes the tags out for other programs, as a tree of symlinks
+    complete [flags] <prefix>           : lists the tag names (or indexed paths) starting with <prefix>, for shells
 
 no command flags:
     -h, --help                    : displays basic help
     -H, --HELP                    : displays extended help
     -v, --version                 : displays ftag's version
     -w, --warn <warnlevel>        : sets warn level
+    --profile                     : prints phase timings and counters as JSON to stderr at exit
 
 )";
             return 0;
@@ -1249,8 +825,8 @@ description:
     without modifying files on disk
 
     tags consist of a name, an optional color, and so-called supertags that they descend from.
-    tag names can't have spaces, parens, square brackets, colons, and cannot start with a dash, encouraging a
-    plain naming style like-this
+    tag names can't have spaces, parens, square brackets, colons, and cannot start with a dash or an equals sign,
+    encouraging a plain naming style like-this
 
     with designating supertags, you can construct a large and complicated tag graph. ftag supports it fine and works with
     it, but placing a tag in a cycle with itself is discouraged for obvious reasons
@@ -1260,6 +836,11 @@ description:
     the tag file format and index file format are designed to be almost entirely human-readable and editable.
     however, they do reference files by their inode numbers, which might be slightly unwieldly
 
+    files are identified by device and inode number together, written <device>:<inum>, so files on different
+    filesystems never collide. the index file is split per device into "<index file>.<device>" files, the index
+    file itself keeping only files indexed before ftag kept devices, which the update and fix commands move to
+    their device's file. anywhere an <inum> is taken, <device>:<inum> is too
+
 commands:
     search [flags]                      : searches for and returns tags and files
     tag <subcommand> <tagname> [flags]  : create/edit/delete tags, and assign and remove files from tags
@@ -1267,12 +848,16 @@ commands:
     rm <flags>                          : removes files to be tracked/tagged by ftag
     update [flags]                      : updates the index of tracked files, use if some have been moved/renamed
     fix [flags]                         : fixes the inode numbers used in the tags file and index file
+    stats [flags]                       : prints tag usage and co-occurrence counts as JSON
+    export <flags>                      : writes the tags out for other programs, as a tree of symlinks
+    complete [flags] <prefix>           : lists the tag names (or indexed paths) starting with <prefix>, for shells
 
 no command flags:
     -h, --help                    : displays basic help
     -H, --HELP                    : displays extended help
     -v, --version                 : displays ftag's version
     -w, --warn <warnlevel>        : sets warn level
+    --profile                     : prints phase timings and counters as JSON to stderr at exit, can be passed anywhere
 
 command flags:
     search:
@@ -1287,8 +872,45 @@ command flags:
                                         (see --search-file-name and --search-file-path)
         -fe,  --file-exclude <text>   : excludes all files with filename/path <text>
                                         (see --search-file-name and --search-file-path)
-        -i,   --inode <inum>          : include the file with inode <inum>
-        -ie,  --inode-exclude <inum>  : exclude the file with inode <inum>
+        -i,   --inode <inum>          : include the file with inode <inum>, on any device unless given as <device>:<inum>
+        -ie,  --inode-exclude <inum>  : exclude the file with inode <inum>, on any device unless given as <device>:<inum>
+
+        --on <path>                   : only loads and searches files on the filesystem <path> is on
+
+        --stream                      : prints the returned files one per line as they are found, each once and in index
+                                        order, instead of grouping them (tag and layout flags have no effect), and stops
+                                        once stdout is closed
+        --limit <n>                   : streams at most <n> files and stops searching after them (implies --stream)
+        --offset <n>                  : skips the first <n> files that would be streamed (implies --stream)
+
+        --sort <key>                  : orders files by name, path, size, mtime, tags (how many) or inode instead of the
+                                        order they were tagged in (or index order), ties keeping that order. size and
+                                        mtime use the metadata saved in the index file (see below), or stat files
+                                        without it once, files that can't be go last. tags keep their order. with
+                                        --stream, every file is found before the first is printed and
+                                        --offset/--limit count in the sorted order
+        --reverse                     : with --sort, largest/latest/last first
+
+        --larger-than <size>          : only returns files larger than <size> bytes, k/m/g/t suffixes for KiB/MiB/...
+        --smaller-than <size>         : only returns files smaller than <size>
+        --modified-after <time>       : only returns files modified after <time>, "<n>[s|m|h|d|w]" ago (e.g. 7d),
+                                        "YYYY-MM-DD[ HH:MM[:SS]]" or "@<unix seconds>"
+        --modified-before <time>      : only returns files modified before <time>
+        --type <f|d|o>                : only returns regular files, directories or anything else
+                                        these filters apply after every rule and use the size, mtime and type add and
+                                        update saved in the index file, without touching the filesystem. files indexed
+                                        without them (before ftag kept them) never pass, update them to save them
+
+        --no-cache                    : evaluates the search even if its result was saved (see below), and doesn't save it.
+                                        results are saved in "<index file>.querycache" and reused by the same search
+                                        until the tags or index file change, through ftag or by hand.
+                                        searches with --modified-after or --modified-before are never saved
+
+        --count                       : only prints how many files are returned
+        --count-by-tag                : only prints, for every tag, how many returned files have it, as "<tag>: <n>"
+                                        (and "(no tags): <n>"), before the total if --count is also passed
+        --facets <k>                  : like --count-by-tag but only the <k> tags the most returned files have (all with 0),
+                                        most first, for narrowing a search down
 
         --search-file-name            : uses filenames when searching for files (default)
                                         only has an effect when used with --file and --file-exclude
@@ -1342,8 +964,17 @@ command flags:
             delete  <name>            : deletes a tag with the name <name>
             enable  <name>            : enables a tag with the name <name>
             disable <name>            : disables a tag with the name <name>
-            add  <name> <flags>       : tags file(s) with tag <name>, interprets <flags> exactly like the add command does
-            rm   <name> <flags>       : untags file(s) with tag <name>, interprets <flags> exactly like the rm command does
+            add  <name> <flags>       : tags file(s) with tag <name>, interprets <flags> exactly like the add command does.
+                                        <name> can be several tags separated by commas ("a,b,c"), all applied in one walk
+            rm   <name> <flags>       : untags file(s) with tag <name>, interprets <flags> exactly like the rm command does.
+                                        <name> can be several tags separated by commas too
+            virtual <name> <search flags>
+                                      : makes <name> (created if it doesn't exist) a virtual tag, whose files are always
+                                        what searching with <search flags> returns (the rule flags and --search-file-path of
+                                        the search command). kept up to date on every change, so searching it is as fast as
+                                        any tag. its search doesn't see virtual tags, and it can't be tagged by hand.
+                                        renaming a tag renames it in the searches too, one named in a search can't be
+                                        deleted
             edit <name> <flags>       : edits a tag
                 flags:
                     -as,  --add-super <supername>        : adds tag <supername> to tag <name>'s supertags
@@ -1357,6 +988,8 @@ command flags:
                     -c,   --color <color>                : changes tag <name>'s hex color to <color>
                     -rc,  --remove-color                 : removes tag <name>'s color
 
+                    -rq,  --remove-query                 : makes virtual tag <name> a normal tag, keeping its current files
+
                     -n,   --rename <newname>             : renames tag <name> to <newname>
 
     add, rm:
@@ -1387,6 +1020,11 @@ command flags:
                                                                   <directory>
                                                                   only has an effect with --recursive
 
+    add, update:
+        -fp, --fingerprint                                      : also saves a fingerprint of the contents of every regular file
+                                                                  (its size and a hash of it, or of 3 64KiB samples of larger
+                                                                  ones) for fix --by-content. files are read in parallel
+
     rm:
        --search-index                                           : searches through the index first to match paths when passed a
                                                                   --file or --recursive (default)
@@ -1397,7 +1035,18 @@ command flags:
     update:
         -f, --file <file OR directory> [file OR directory] ...  : updates files or single directories to be tracked
                                                                   (does not iterate through the contents of the directories)
-        -r, --recursive <directory> [directory] ...             : updates everything in the directories (recursive)
+        -r, --recursive <directory> [directory] ...             : updates everything in the directories (recursive). directories
+                                                                  are remembered in "<index file>.dircache" and the next -r only
+                                                                  lists those whose entries changed since, in an unchanged one
+                                                                  only the files already indexed are updated
+        --full                                                  : walks every directory for -r again, ignoring what was remembered,
+                                                                  to also find indexed files whose stored path isn't where they
+                                                                  are in an unchanged directory (unresolved paths, hard links)
+        -dm, --detect-moves <directory> [directory] ...         : finds every indexed file whose path is gone, unresolved or
+                                                                  now another inode number, walks the directories once (in
+                                                                  parallel) looking for their inode numbers and updates the
+                                                                  paths of those found, then prints how many were moved and
+                                                                  warns about the rest. has to be the first flag
 
     add, rm, update:
         unfortunately, you cannot pass multiple flags (excluding -i, --inode, or when using "-" to indicate from stdin) for
@@ -1425,12 +1074,47 @@ command flags:
 
         -rip, --replace-ip <inum> <path>       : manually replaces inode number <inum> in index file with the one found at <path>
         -rii, --replace-ii <inum> <newinum>    : manually replaces inode number <inum> in index file with <newinum>
+                                                 (a <newinum> without a device keeps <inum>'s device, same for --replace-pi)
         -rpp, --replace-pp <path> <newpath>    : manually replaces inode number associated with <path> in index file with the
                                                  one from <newpath>
         -rpi, --replace-pi <path> <inum>       : manually replaces inode number associated with <path> in index file with <inum>
 
+        -c, --by-content <directory>           : for every index file entry with a fingerprint (see add --fingerprint) whose path is
+                                                 gone or now has another inode number, looks in <directory> (recursive) for a file
+                                                 with the same size and fingerprint and replaces the inode number and path with
+                                                 its. only files with sizes of such entries are read, and entries or files with
+                                                 more than one match are skipped
+
+    stats:
+        --no-co-occurrence            : leaves out co_occurrence, the pairs of tags tagged to the same files
+        --co-min <n>                  : only lists pairs of tags sharing at least <n> files
+
+        prints one JSON object: files, untagged_files, tags, unused_tags (tags with no files, counting subtags),
+        max_depth, then tag_stats (every tag in tags file order, with files tagged with it directly, subtree_files
+        tagged with it or any subtag, and its depth below the tags without supertags) and co_occurrence (every pair
+        of tags sharing files, most shared first). "s" is still short for search, use "st" or longer
+
+    complete:
+        --tags                        : completes tag names (default). a comma list ("a,b,c") completes its last
+                                        tag, keeping the ones before
+        --paths                       : completes indexed file paths instead, relative ones from the current directory
+        --limit <n>                   : lists at most <n>
+
+        reads only the tag names, sorted, from "<tags file>.names" (kept next to the tags file on every change, and
+        rebuilt from the tags file's tag lines if it was edited by hand since), so it answers in a few milliseconds
+        however many files are indexed. a <prefix> starting with a dash goes after "--"
+
+    export:
+        --symlink-tree <dir>          : makes <dir>/<tag>/ for every enabled tag, nested in its supertags' directories
+                                        (under each one, for tags with several), holding a symlink to each of its files
+                                        named after the file ("<name>~<inum>" when the name is taken). what was made is
+                                        recorded in <dir>/.ftag-export, so exporting again only changes the links that
+                                        changed since, and nothing at all if the store didn't change. anything else in
+                                        <dir> is left alone
+
 other:
     config file paths can be changed through $FTAG_TAGS_FILE and $FTAG_INDEX_FILE
+    setting $FTAG_PROFILE to anything but "" or "0" is the same as passing --profile
 
 )";
             return 0;
@@ -1482,9 +1166,13 @@ other:
     bool is_update = false;
     bool is_fix = false;
     bool is_tag = false;
+    bool is_stats = false;
+    bool is_export = false;
+    bool is_complete = false;
 
+    /* when a prefix matches more than one, the first wins, so "s" stays search */
     std::vector<std::string> commands = {
-        "search", "add", "rm", "update", "fix", "tag"
+        "search", "add", "rm", "update", "fix", "tag", "stats", "export", "complete"
     };
     std::vector<std::string> matches;
     for (const std::string &cmdname : commands) {
@@ -1492,7 +1180,7 @@ other:
             matches.push_back(cmdname);
         }
     }
-    if (matches.size() == 1) {
+    if (!matches.empty()) {
         if (matches[0] == "search") {
             is_search = true;
         } else if (matches[0] == "add") {
@@ -1505,6 +1193,12 @@ other:
             is_fix = true;
         } else if (matches[0] == "tag") {
             is_tag = true;
+        } else if (matches[0] == "stats") {
+            is_stats = true;
+        } else if (matches[0] == "export") {
+            is_export = true;
+        } else if (matches[0] == "complete") {
+            is_complete = true;
         }
     }
 
@@ -1533,28 +1227,218 @@ other:
         }
     }
 
-    read_file_index();
-    read_saved_tags();
+    if (is_search) {
+        /* --on decides which index shards get loaded, so it is read before the other search flags */
+        for (std::uint32_t i = 2; i + 1 < argc; i++) {
+            if (!std::strcmp(argv[i], "--on")) {
+                const file_id_t file_id = path_get_id(argv[i + 1]);
+                if (!file_id) {
+                    ERR_EXIT(1, "search: argument %i path \"%s\" was not found", i + 1, argv[i + 1]);
+                }
+                store.device = file_id.dev;
+            }
+        }
+    }
+
+    store.warn = [](const std::string &message) { WARN("%s", message.c_str()); };
+    /* answered from the tag names cache (or straight from the index files), without loading the store */
+    if (is_complete) {
+        bool complete_paths = false;
+        std::size_t limit = 0;
+        std::string prefix;
+        for (std::int32_t i = 2; i < argc; i++) {
+            const std::string targ = argv[i];
+            if (targ == "--tags") {
+                complete_paths = false;
+            } else if (targ == "--paths") {
+                complete_paths = true;
+            } else if (targ == "--limit") {
+                if (i >= argc - 1) {
+                    ERR_EXIT(1, "complete: expected argument <n> after \"%s\"", targ.c_str());
+                }
+                char *end = nullptr;
+                limit = std::strtoull(argv[++i], &end, 10);
+                if (*argv[i] == '\0' || *argv[i] == '-' || *end != '\0') {
+                    ERR_EXIT(1, "complete: argument %i number \"%s\" was not valid", i, argv[i]);
+                }
+            } else if (targ == "--") { /* the prefix, even if it starts with a dash */
+                if (i < argc - 1) {
+                    prefix = argv[i + 1];
+                }
+                break;
+            } else if (targ.starts_with("-")) {
+                ERR_EXIT(1, "complete: flag \"%s\" was not recognized", argv[i]);
+            } else {
+                prefix = targ;
+            }
+        }
+        store.tags_file = tags_file;
+        store.index_file = index_file;
+        name_table_t names;
+        /* what comes before the word being completed, a tag list's earlier tags or the current directory of a
+         * relative path, is kept out of the lookup and put back on every completion */
+        std::string before;
+        if (complete_paths) {
+            if (!store.indexed_paths(names)) {
+                ERR_EXIT(1, "complete: %s", store.error.c_str());
+            }
+            if (!prefix.starts_with("/")) {
+                before = std::filesystem::current_path().string();
+                before += before.ends_with("/") ? "" : "/";
+                prefix = before + prefix;
+            }
+        } else {
+            if (!store.tag_names(names)) {
+                ERR_EXIT(1, "complete: %s", store.error.c_str());
+            }
+            const std::size_t comma_pos = prefix.rfind(',');
+            if (comma_pos != std::string::npos) {
+                before = prefix.substr(0, comma_pos + 1);
+                prefix.erase(0, comma_pos + 1);
+            }
+        }
+        for (const std::string_view &name : names.complete(prefix, limit)) {
+            if (complete_paths) {
+                std::cout << name.substr(before.size()) << '\n';
+            } else {
+                std::cout << before << name << '\n';
+            }
+        }
+        return 0;
+    }
+    /* commands that change the store hold its lock from loading to writing it, so concurrent ones wait for each
+     * other instead of losing each other's changes. searches only lock while loading */
+    if (!store.open(tags_file, index_file, !is_search && !is_stats && !is_export)) {
+        ERR_EXIT(1, "%s", store.error.c_str());
+    }
 
     /* TODO(stole): fully validate parsed tags and index file here, warn/suggest file editing if non-fix-able or non-update-able */
 
     /* commands */
+    std::optional<profile_phase_t> phase;
     if (is_search) {
+        phase.emplace("parse_args");
 
-        std::vector<search_rule_t> search_rules;
+        query_t query;
         display_type_t display_type = display_type_t::tags_files;
         bool color_enabled = true;
         bool organize_by_tag = true;
         bool compact_output = true;
         bool quoted = false;
         bool no_formatting = false;
-        bool search_file_path = false;
         show_tag_info_t show_tag_info = show_tag_info_t::name_only;
         show_file_info_t show_file_info = show_file_info_t::filename_only;
+        bool stream = false;
+        bool use_cache = true;
+        bool count = false;
+        bool count_by_tag = false;
+        std::optional<std::uint64_t> facets;
+        std::optional<std::uint64_t> limit;
+        std::uint64_t offset = 0;
+        sort_key_t sort_key = sort_key_t::none;
+        bool reverse = false;
 
         for (std::uint32_t i = 2; i < argc; i++) {
             std::string targ = argv[i];
-            if (targ == "--tags-files") {
+            if (targ == "--limit" || targ == "--offset") {
+                if (i >= argc - 1) {
+                    ERR_EXIT(1, "search: expected argument <n> after \"%s\"", targ.c_str());
+                }
+                char *end = nullptr;
+                const std::uint64_t n = std::strtoull(argv[++i], &end, 10);
+                if (*argv[i] == '\0' || *argv[i] == '-' || *end != '\0') {
+                    ERR_EXIT(1, "search: argument %i number \"%s\" was not valid", i, argv[i]);
+                }
+                if (targ == "--limit") {
+                    limit = n;
+                } else {
+                    offset = n;
+                }
+                stream = true;
+                continue;
+            } else if (targ == "--sort") {
+                if (i >= argc - 1) {
+                    ERR_EXIT(1, "search: expected argument <key> after \"%s\"", targ.c_str());
+                }
+                const std::string key = argv[++i];
+                if (key == "name") {
+                    sort_key = sort_key_t::name;
+                } else if (key == "path") {
+                    sort_key = sort_key_t::path;
+                } else if (key == "size") {
+                    sort_key = sort_key_t::size;
+                } else if (key == "mtime") {
+                    sort_key = sort_key_t::mtime;
+                } else if (key == "tags") {
+                    sort_key = sort_key_t::tags;
+                } else if (key == "inode") {
+                    sort_key = sort_key_t::inode;
+                } else {
+                    ERR_EXIT(1, "search: argument %i sort key \"%s\" was not name, path, size, mtime, tags or inode", i, argv[i]);
+                }
+                continue;
+            } else if (targ == "--reverse") {
+                reverse = true;
+                continue;
+            } else if (targ == "--larger-than" || targ == "--smaller-than") {
+                if (i >= argc - 1) {
+                    ERR_EXIT(1, "search: expected argument <size> after \"%s\"", targ.c_str());
+                }
+                std::uint64_t size = 0;
+                if (!parse_size(argv[++i], size)) {
+                    ERR_EXIT(1, "search: argument %i size \"%s\" was not valid", i, argv[i]);
+                }
+                (targ == "--larger-than" ? query.meta_filter.larger_than : query.meta_filter.smaller_than) = size;
+                continue;
+            } else if (targ == "--modified-after" || targ == "--modified-before") {
+                if (i >= argc - 1) {
+                    ERR_EXIT(1, "search: expected argument <time> after \"%s\"", targ.c_str());
+                }
+                std::int64_t time = 0;
+                if (!parse_time(argv[++i], time)) {
+                    ERR_EXIT(1, "search: argument %i time \"%s\" was not valid", i, argv[i]);
+                }
+                (targ == "--modified-after" ? query.meta_filter.modified_after : query.meta_filter.modified_before) = time;
+                continue;
+            } else if (targ == "--type") {
+                if (i >= argc - 1) {
+                    ERR_EXIT(1, "search: expected argument <type> after \"%s\"", targ.c_str());
+                }
+                const std::string type = argv[++i];
+                if (type != "f" && type != "d" && type != "o") {
+                    ERR_EXIT(1, "search: argument %i type \"%s\" was not f, d or o", i, argv[i]);
+                }
+                query.meta_filter.type = type[0];
+                continue;
+            } else if (targ == "--stream") {
+                stream = true;
+                continue;
+            } else if (targ == "--no-cache") {
+                use_cache = false;
+                continue;
+            } else if (targ == "--count") {
+                count = true;
+                continue;
+            } else if (targ == "--count-by-tag") {
+                count_by_tag = true;
+                continue;
+            } else if (targ == "--facets") {
+                if (i >= argc - 1) {
+                    ERR_EXIT(1, "search: expected argument <k> after \"%s\"", targ.c_str());
+                }
+                char *end = nullptr;
+                facets = std::strtoull(argv[++i], &end, 10);
+                if (*argv[i] == '\0' || *argv[i] == '-' || *end != '\0') {
+                    ERR_EXIT(1, "search: argument %i number \"%s\" was not valid", i, argv[i]);
+                }
+                continue;
+            } else if (targ == "--on") {
+                if (i >= argc - 1) {
+                    ERR_EXIT(1, "search: expected argument <path> after \"%s\"", targ.c_str());
+                }
+                i++; /* already read before loading */
+                continue;
+            } else if (targ == "--tags-files") {
                 display_type = display_type_t::tags_files;
                 continue;
             } else if (targ == "--tags-only") {
@@ -1564,10 +1448,10 @@ other:
                 display_type = display_type_t::files;
                 continue;
             } else if (targ == "--search-file-path") {
-                search_file_path = true;
+                query.by_path(true);
                 continue;
             } else if (targ == "--search-file-name") {
-                search_file_path = false;
+                query.by_path(false);
                 continue;
             } else if (targ == "--enable-color") {
                 color_enabled = true;
@@ -1628,221 +1512,138 @@ other:
                 continue;
             }
 
-            std::string main_arg;
-            bool has_opt = false;
-            if (targ.starts_with("--")) {
-                main_arg = targ.substr(2, targ.size() - 2);
-                if (!map_contains(arg_to_rule_type, main_arg)) {
-                    has_opt = true;
-                    main_arg = targ.substr(2, targ.size() - 4);
-                    if (targ[targ.size() - 2] != '-') {
-                        ERR_EXIT(1, "search: argument %i not recognized: \"%s\"", i, argv[i]);
-                    }
-                }
-            } else if (targ[0] == '-') {
-                main_arg = targ.substr(1, targ.size() - 1);
-                if (!map_contains(arg_to_rule_type, main_arg)) {
-                    has_opt = true;
-                    main_arg = targ.substr(1, targ.size() - 2);
-                }
-            }
-            if (!map_contains(arg_to_rule_type, main_arg)) {
-                ERR_EXIT(1, "search: argument %i not recognized: \"%s\"", i, argv[i]);
-            }
-            search_rule_type_t rule_type = arg_to_rule_type.find(main_arg)->second;
-            std::string opt;
+            search_rule_type_t rule_type = search_rule_type_t::tag;
             search_opt_t sopt = search_opt_t::exact;
-            if (has_opt) {
-                opt = targ.substr(targ.size() - 1, 1);
-                if (!map_contains(arg_to_opt, opt)) {
-                    ERR_EXIT(1, "search: argument %i search option \"%s\" not found", i, opt.c_str());
-                }
-                sopt = arg_to_opt.find(opt)->second;
+            std::string flag_error;
+            if (!parse_search_flag(targ, rule_type, sopt, flag_error)) {
+                ERR_EXIT(1, "search: argument %i %s", i, flag_error.c_str());
             }
             if (rule_type == search_rule_type_t::inode || rule_type == search_rule_type_t::inode_exclude) {
                 if (i >= argc - 1) {
                     ERR_EXIT(1, "search: expected argument <inum> after \"%s\"", targ.c_str());
                 }
-                ino_t inum = std::strtoul(argv[++i], nullptr, 0);
-                if (inum == 0) {
+                file_id_t inum;
+                if (!parse_file_id(argv[++i], inum)) {
                     ERR_EXIT(1, "search: argument %i inode number \"%s\" was not valid", i, argv[i]);
                 }
-                if (!map_contains(file_index, inum)) {
-                    ERR_EXIT(1, "search: argument %i inode number " INO_FORMAT " was not in index file", i, inum);
+                if (!store.find_id(inum)) {
+                    ERR_EXIT(1, "search: argument %i inode number " INO_FORMAT " was not in index file", i, file_id_str(inum).c_str());
                 }
-                search_rules.push_back(search_rule_t{.type = rule_type, .inum = inum});
+                query.add(search_rule_t{.type = rule_type, .inum = inum});
             } else if (rule_type == search_rule_type_t::all_list || rule_type == search_rule_type_t::all_list_exclude) {
-                search_rules.push_back(search_rule_t{rule_type});
+                query.add(search_rule_t{rule_type});
             } else { /* takes <text> */
                 if (i >= argc - 1) {
                     ERR_EXIT(1, "search: expected argument <text> after \"%s\"", targ.c_str());
                 }
-                search_rules.push_back(search_rule_t{rule_type, sopt, std::string(argv[++i])});
-            }
-        }
-        std::map<tid_t, bool, tagcmp_t> tags_returned;
-        std::map<tid_t, bool, tagcmp_t> tags_matched;
-        for (const auto &[id, _] : tags) {
-            tags_returned[id] = false;
-            tags_matched[id] = false;
-        }
-        std::map<ino_t, bool> files_returned;
-        std::map<ino_t, bool> files_matched;
-        for (const auto &[file_ino, _] : file_index) {
-            files_returned[file_ino] = false;
-            files_matched[file_ino] = false;
-        }
-        if (search_rules.empty()) {
-            search_rules.push_back(search_rule_t{search_rule_type_t::all_list});
-        }
-        for (const search_rule_t &search_rule : search_rules) {
-            bool exclude = search_rule.type == search_rule_type_t::tag_exclude || search_rule.type == search_rule_type_t::file_exclude || search_rule.type == search_rule_type_t::all_exclude || search_rule.type == search_rule_type_t::all_list_exclude || search_rule.type == search_rule_type_t::inode_exclude;
-            bool is_file = search_rule.type == search_rule_type_t::file || search_rule.type == search_rule_type_t::file_exclude;
-            bool is_tag = search_rule.type == search_rule_type_t::tag || search_rule.type == search_rule_type_t::tag_exclude;
-            bool is_all = search_rule.type == search_rule_type_t::all || search_rule.type == search_rule_type_t::all_exclude;
-            bool is_all_list = search_rule.type == search_rule_type_t::all_list || search_rule.type == search_rule_type_t::all_list_exclude;
-            bool is_inode = search_rule.type == search_rule_type_t::inode || search_rule.type == search_rule_type_t::inode_exclude;
-            if (is_all_list) {
-                for (const auto &[id, _] : tags) {
-                    tags_returned[id] = !exclude;
-                    tags_matched[id] = !exclude;
-                }
-                for (const auto &[file_ino, _] : file_index) {
-                    files_returned[file_ino] = !exclude;
-                    files_matched[file_ino] = !exclude;
-                }
-            } else if (is_inode) {
-                files_returned[search_rule.inum] = !exclude;
-            } else if (search_rule.opt == search_opt_t::exact) {
-                if (is_file) {
-                    for (const auto &[file_ino, file_info] : file_index) {
-                        if (search_file_path) {
-                            if (file_info.pathstr == search_rule.text) {
-                                files_returned[file_ino] = !exclude;
-                                files_matched[file_ino] = !exclude;
-                            }
-                        } else {
-                            if (file_info.filename() == search_rule.text) {
-                                files_returned[file_ino] = !exclude;
-                                files_matched[file_ino] = !exclude;
-                            }
-                        }
-                    }
-                } else if (is_tag) {
-                    for (const auto &[id, tag] : tags) {
-                        if (!tag.enabled) { continue; }
-                        if (tag.name == search_rule.text) {
-                            tags_returned[id] = !exclude;
-                            tags_matched[id] = !exclude;
-                            for (const ino_t &file_ino : tag.files) {
-                                files_returned[file_ino] = !exclude;
-                            }
-                        }
-                    }
-                } else if (is_all) {
-                    for (const auto &[id, tag] : tags) {
-                        if (!tag.enabled) { continue; }
-                        if (tag.name == search_rule.text) {
-                            tags_matched[id] = !exclude;
-                            tags_returned[id] = !exclude;
-                            std::vector<tid_t> tags_visited;
-                            add_all(id, tags_visited, tags_returned, files_returned, exclude);
-                        }
-                    }
+                query.add(search_rule_t{rule_type, sopt, std::string(argv[++i])});
+            }
+        }
+        if (count || count_by_tag || facets.has_value()) {
+            phase.emplace("count");
+            const query_count_t counted = query.count(store, count_by_tag || facets.has_value());
+            if (facets.has_value()) {
+                for (const auto &[id, n] : counted.facets(store, facets.value())) {
+                    std::cout << store.tags.at(id).name << ": " << n << '\n';
                 }
-            } else if (search_rule.opt == search_opt_t::text_includes) {
-                if (is_file) {
-                    for (const auto &[file_ino, file_info] : file_index) {
-                        if (search_file_path) {
-                            if (file_info.pathstr.find(search_rule.text) != std::string::npos) {
-                                files_returned[file_ino] = !exclude;
-                                files_matched[file_ino] = !exclude;
-                            }
-                        } else {
-                            if (file_info.filename().find(search_rule.text) != std::string::npos) {
-                                files_returned[file_ino] = !exclude;
-                                files_matched[file_ino] = !exclude;
-                            }
-                        }
-                    }
-                } else if (is_tag) {
-                    for (const auto &[id, tag] : tags) {
-                        if (!tag.enabled) { continue; }
-                        if (tag.name.find(search_rule.text) != std::string::npos) {
-                            tags_returned[id] = !exclude;
-                            tags_matched[id] = !exclude;
-                            for (const ino_t &file_ino : tag.files) {
-                                files_returned[file_ino] = !exclude;
-                            }
-                        }
-                    }
-                } else if (is_all) {
-                    for (const auto &[id, tag] : tags) {
-                        if (!tag.enabled) { continue; }
-                        if (tag.name.find(search_rule.text) != std::string::npos) {
-                            tags_returned[id] = !exclude;
-                            tags_matched[id] = !exclude;
-                            std::vector<tid_t> tags_visited;
-                            add_all(id, tags_visited, tags_returned, files_returned, exclude);
-                        }
+            } else if (count_by_tag) {
+                for (const auto &[id, tag] : store.tags) {
+                    auto it = counted.by_tag.find(id);
+                    if (it != counted.by_tag.end()) {
+                        std::cout << tag.name << ": " << it->second << '\n';
                     }
                 }
-            } else if (search_rule.opt == search_opt_t::regex) {
-                std::regex rg(search_rule.text);
-                if (is_file) {
-                    for (const auto &[file_ino, file_info] : file_index) {
-                        if (search_file_path) {
-                            if (std::regex_search(file_info.pathstr, rg)) {
-                                files_returned[file_ino] = !exclude;
-                                files_matched[file_ino] = !exclude;
-                            }
-                        } else {
-                            if (std::regex_search(file_info.filename(), rg)) {
-                                files_returned[file_ino] = !exclude;
-                                files_matched[file_ino] = !exclude;
-                            }
-                        }
-                    }
-                } else if (is_tag) {
-                    for (const auto &[id, tag] : tags) {
-                        if (!tag.enabled) { continue; }
-                        if (std::regex_search(tag.name, rg)) {
-                            tags_returned[id] = !exclude;
-                            tags_matched[id] = !exclude;
-                            for (const ino_t &file_ino : tag.files) {
-                                files_returned[file_ino] = !exclude;
-                            }
-                        }
-                    }
-                } else if (is_all) {
-                    for (const auto &[id, tag] : tags) {
-                        if (!tag.enabled) { continue; }
-                        if (std::regex_search(tag.name, rg)) {
-                            tags_returned[id] = !exclude;
-                            tags_matched[id] = !exclude;
-                            std::vector<tid_t> tags_visited;
-                            add_all(id, tags_visited, tags_returned, files_returned, exclude);
-                        }
-                    }
+                if (counted.untagged > 0) {
+                    std::cout << "(no tags): " << counted.untagged << '\n';
                 }
             }
+            if (count) {
+                std::cout << counted.files << '\n';
+            }
+            return 0;
         }
 
+        if (stream) {
+            /* nothing is grouped, so every file can go out as soon as it is known to be returned */
+            phase.emplace("stream");
+            if (limit.has_value() && limit.value() == 0) {
+                return 0;
+            }
+            std::signal(SIGPIPE, SIG_IGN); /* a closed stdout shows up as a failed write instead, which stops the search */
+            if (sort_key != sort_key_t::none) {
+                /* every file has to be known before the first goes out, offset and limit then apply to the sorted order */
+                std::vector<file_id_t> file_ids;
+                std::unordered_map<file_id_t, bool> matched_ids;
+                query.stream(store, [&](const file_info_t &file_info, bool matched) {
+                    file_ids.push_back(file_info.file_id);
+                    matched_ids.emplace(file_info.file_id, matched);
+                    return true;
+                });
+                sort_files(store, file_ids, sort_key, reverse);
+                for (std::uint64_t fi = offset; fi < file_ids.size() && (!limit.has_value() || fi - offset < limit.value()) && std::cout.good(); fi++) {
+                    string_format_file_info(store.file_index.at(file_ids[fi]), matched_ids.at(file_ids[fi]), show_file_info, no_formatting, quoted).display(no_formatting);
+                    std::cout << '\n';
+                }
+                return 0;
+            }
+            std::uint64_t skipped = 0, shown = 0;
+            query.stream(store, [&](const file_info_t &file_info, bool matched) {
+                if (skipped < offset) {
+                    skipped++;
+                    return true;
+                }
+                string_format_file_info(file_info, matched, show_file_info, no_formatting, quoted).display(no_formatting);
+                std::cout << '\n';
+                if (shown++ == 0) {
+                    std::cout.flush(); /* the first result shows up right away, even through a pipe */
+                }
+                return std::cout.good() && (!limit.has_value() || shown < limit.value());
+            });
+            return 0;
+        }
+
+        phase.emplace("evaluate");
+        const query_cache_t query_cache(store);
+        query_result_t result;
+        if (!use_cache || !query_cache.load(store, query, result)) {
+            result = query.run(store);
+            if (use_cache) {
+                query_cache.dump(store, query, result);
+            }
+        }
+        const bitset_t &tags_matched = result.tags_matched;
+        const bitset_t &files_matched = result.files_matched;
+        /* tag files not in the index are never returned */
+        const auto file_returned = [&result](const file_id_t &file_id) {
+            auto it = store.file_index.find(file_id);
+            return it != store.file_index.end() && result.returned(it->second);
+        };
+
         /* now display the results */
+        phase.emplace("render");
+        std::vector<file_id_t> returned_order; /* what groups of files go in, ranked for display_file_list */
+        for (const file_info_t &file_info : result.files()) {
+            returned_order.push_back(file_info.file_id);
+        }
+        std::vector<std::uint32_t> file_rank; /* by ordinal */
+        if (sort_key != sort_key_t::none) {
+            sort_files(store, returned_order, sort_key, reverse);
+            file_rank.resize(store.file_ordinals, 0);
+            for (std::uint32_t ri = 0; ri < returned_order.size(); ri++) {
+                file_rank[store.file_index.at(returned_order[ri]).ordinal] = ri;
+            }
+        }
         if (organize_by_tag) {
             /* residual files, we select */
-            for (const auto &[file_ino, file_inc] : files_returned) {
-                if (!file_inc) { continue; }
-                for (const tid_t &id : file_index[file_ino].tags) {
-                    tags_returned[id] = true;
+            for (const file_info_t &file_info : result.files()) {
+                for (const tid_t &id : file_info.tags) {
+                    result.tags_returned.set(store.tags.at(id).ordinal);
                 }
             }
-            for (const auto &[id, inc] : tags_returned) {
-                if (!inc) { continue; }
-                const tag_t &tag = tags[id];
+            for (const tag_t &tag : result.tags()) {
                 bool has_any_returned = false;
-                for (const ino_t &file_ino : tag.files) {
-                    if (!files_returned[file_ino]) { continue; }
+                for (const file_id_t &file_id : tag.files) {
+                    if (!file_returned(file_id)) { continue; }
                     has_any_returned = true;
                 }
                 if (display_type == display_type_t::tags || display_type == display_type_t::tags_files) {
@@ -1863,12 +1664,12 @@ other:
                         if (display_type == display_type_t::tags || display_type == display_type_t::tags_files) {
                             std::cout << '\n';
                         }
-                        std::vector<ino_t> display_file_inos;
-                        for (const ino_t &file_ino : tag.files) {
-                            if (!files_returned[file_ino]) { continue; }
-                            display_file_inos.push_back(file_ino);
+                        std::vector<file_id_t> display_file_ids;
+                        for (const file_id_t &file_id : tag.files) {
+                            if (!file_returned(file_id)) { continue; }
+                            display_file_ids.push_back(file_id);
                         }
-                        display_file_list(display_file_inos, files_matched, compact_output, show_file_info, no_formatting || (display_type == display_type_t::files), quoted);
+                        display_file_list(display_file_ids, files_matched, compact_output, show_file_info, no_formatting || (display_type == display_type_t::files), quoted, file_rank);
                     } else if (display_type == display_type_t::tags_files || (show_file_info == show_file_info_t::filename_only && display_type != display_type_t::files)) {
                         std::cout << "(no files)\n";
                     }
@@ -1879,18 +1680,17 @@ other:
             }
 
             /* files with no tags */
-            std::vector<ino_t> files_no_tags;
-            for (const auto &[file_ino, file_inc] : files_returned) {
-                if (!file_inc) { continue; }
-                if (file_index[file_ino].tags.empty()) {
-                    files_no_tags.push_back(file_ino);
+            std::vector<file_id_t> files_no_tags;
+            for (const file_info_t &file_info : result.files()) {
+                if (file_info.tags.empty()) {
+                    files_no_tags.push_back(file_info.file_id);
                 }
             }
 
             if (!files_no_tags.empty()) {
                 if (display_type == display_type_t::tags || display_type == display_type_t::tags_files) {
                     std::vector<tid_t> tags_visited;
-                    std::map<tid_t, bool, tagcmp_t> fake_tags_matched = {{0, false}};
+                    const bitset_t fake_tags_matched;
                     display_tag_info(tag_t{.id = 0, .name = "(no tags)"}, tags_visited, fake_tags_matched, color_enabled, show_tag_info, no_formatting, chain_relation_type_t::original, files_no_tags.size());
                     if (display_type == display_type_t::tags_files) {
                         std::cout << ':';
@@ -1898,7 +1698,7 @@ other:
                     std::cout << '\n';
                 }
                 if (display_type == display_type_t::files || display_type == display_type_t::tags_files) {
-                    display_file_list(files_no_tags, files_matched, compact_output, show_file_info, no_formatting || (display_type == display_type_t::files), quoted);
+                    display_file_list(files_no_tags, files_matched, compact_output, show_file_info, no_formatting || (display_type == display_type_t::files), quoted, file_rank);
                     /* if (display_type == display_type_t::tags_files && !no_formatting) {
                         std::cout << '\n';
                     } */
@@ -1909,40 +1709,41 @@ other:
             }
 
         } else {
-            std::vector<ino_t> no_tag_group;
-            for (const auto &[file_ino, file_inc] : files_returned) {
-                if (!file_inc) { continue; }
-                std::vector<ino_t> group = {file_ino};
-                std::vector<tid_t> ttags = enabled_only(file_index[file_ino].tags);
+            std::vector<file_id_t> no_tag_group;
+            for (const file_id_t &file_id : returned_order) {
+                if (!file_returned(file_id)) { continue; }
+                std::vector<file_id_t> group = {file_id};
+                std::vector<tid_t> ttags = store.enabled_only(store.file_index.at(file_id).tags);
                 if (ttags.empty()) {
-                    no_tag_group.push_back(file_ino);
+                    no_tag_group.push_back(file_id);
                     continue;
                 }
-                std::sort(ttags.begin(), ttags.end(), [](const tid_t &a, const tid_t &b) -> bool { return tags[a].name.compare(tags[b].name); });
-                for (const auto &[ofile_ino, ofile_inc] : files_returned) {
-                    if (!ofile_inc || ofile_ino == file_ino) { continue; }
-                    std::vector<tid_t> otags = enabled_only(file_index[ofile_ino].tags);
-                    std::sort(otags.begin(), otags.end(), [](const tid_t &a, const tid_t &b) -> bool { return tags[a].name.compare(tags[b].name); });
+                std::sort(ttags.begin(), ttags.end(), [](const tid_t &a, const tid_t &b) -> bool { return store.tags[a].name.compare(store.tags[b].name); });
+                for (const file_info_t &ofile_info : result.files()) {
+                    const file_id_t &ofile_id = ofile_info.file_id;
+                    if (ofile_id == file_id) { continue; }
+                    std::vector<tid_t> otags = store.enabled_only(ofile_info.tags);
+                    std::sort(otags.begin(), otags.end(), [](const tid_t &a, const tid_t &b) -> bool { return store.tags[a].name.compare(store.tags[b].name); });
                     if (otags == ttags) {
-                        group.push_back(ofile_ino);
-                        files_returned[ofile_ino] = false; /* so we won't go over it again in the outer loop */
+                        group.push_back(ofile_id);
+                        result.files_returned.set(ofile_info.ordinal, false); /* so we won't go over it again in the outer loop */
                     }
                 }
                 if (display_type == display_type_t::tags || display_type == display_type_t::tags_files) {
                     for (std::uint32_t i = 0; i < ttags.size() - 1; i++) {
                         std::vector<tid_t> tags_visited;
-                        display_tag_info(tags[ttags[i]], tags_visited, tags_matched, color_enabled, show_tag_info, no_formatting, chain_relation_type_t::original);
+                        display_tag_info(store.tags[ttags[i]], tags_visited, tags_matched, color_enabled, show_tag_info, no_formatting, chain_relation_type_t::original);
                         std::cout << ", ";
                     }
                     std::vector<tid_t> tags_visited;
-                    display_tag_info(tags[ttags[ttags.size() - 1]], tags_visited, tags_matched, color_enabled, show_tag_info, no_formatting, chain_relation_type_t::original);
+                    display_tag_info(store.tags[ttags[ttags.size() - 1]], tags_visited, tags_matched, color_enabled, show_tag_info, no_formatting, chain_relation_type_t::original);
                     if (display_type == display_type_t::tags_files) {
                         std::cout << ':';
                     }
                     std::cout << '\n';
                 }
                 if (display_type == display_type_t::files || display_type == display_type_t::tags_files) {
-                    display_file_list(group, files_matched, compact_output, show_file_info, no_formatting || (display_type == display_type_t::files), quoted);
+                    display_file_list(group, files_matched, compact_output, show_file_info, no_formatting || (display_type == display_type_t::files), quoted, file_rank);
                 }
                 if (display_type == display_type_t::tags_files && !no_formatting) {
                     std::cout << '\n';
@@ -1950,21 +1751,20 @@ other:
             }
             /* tags with no files */
             std::vector<tid_t> tags_no_files;
-            for (const auto &[id, inc] : tags_returned) {
-                if (!inc) { continue; }
-                if (tags[id].files.empty()) {
-                    tags_no_files.push_back(id);
+            for (const tag_t &tag : result.tags()) {
+                if (tag.files.empty()) {
+                    tags_no_files.push_back(tag.id);
                 }
             }
             if (!tags_no_files.empty()) {
                 if (display_type == display_type_t::tags || display_type == display_type_t::tags_files) {
                     for (std::uint32_t i = 0; i < tags_no_files.size() - 1; i++) {
                         std::vector<tid_t> tags_visited;
-                        display_tag_info(tags[tags_no_files[i]], tags_visited, tags_matched, color_enabled, show_tag_info, no_formatting, chain_relation_type_t::original);
+                        display_tag_info(store.tags[tags_no_files[i]], tags_visited, tags_matched, color_enabled, show_tag_info, no_formatting, chain_relation_type_t::original);
                         std::cout << ", ";
                     }
                     std::vector<tid_t> tags_visited;
-                    display_tag_info(tags[tags_no_files[tags_no_files.size() - 1]], tags_visited, tags_matched, color_enabled, show_tag_info, no_formatting, chain_relation_type_t::original);
+                    display_tag_info(store.tags[tags_no_files[tags_no_files.size() - 1]], tags_visited, tags_matched, color_enabled, show_tag_info, no_formatting, chain_relation_type_t::original);
                     if (display_type == display_type_t::tags_files) {
                         std::cout << ": ";
                     }
@@ -1979,7 +1779,7 @@ other:
             if (!no_tag_group.empty()) {
                 if (display_type == display_type_t::tags || display_type == display_type_t::tags_files) {
                     std::vector<tid_t> tags_visited;
-                    std::map<tid_t, bool, tagcmp_t> fake_tags_matched = {{0, false}};
+                    const bitset_t fake_tags_matched;
                     display_tag_info(tag_t{.id = 0, .name = "(no tags)"}, tags_visited, fake_tags_matched, color_enabled, show_tag_info, no_formatting, chain_relation_type_t::original, no_tag_group.size());
                     if (display_type == display_type_t::tags_files) {
                         std::cout << ':';
@@ -1987,7 +1787,7 @@ other:
                     std::cout << '\n';
                 }
                 if (display_type == display_type_t::files || display_type == display_type_t::tags_files) {
-                    display_file_list(no_tag_group, files_matched, compact_output, show_file_info, no_formatting || (display_type == display_type_t::files), quoted);
+                    display_file_list(no_tag_group, files_matched, compact_output, show_file_info, no_formatting || (display_type == display_type_t::files), quoted, file_rank);
                 }
                 if (display_type == display_type_t::tags_files && !no_formatting) {
                     std::cout << '\n';
@@ -1996,6 +1796,43 @@ other:
         }
     /* end of search command */
 
+    } else if (is_update && argc > 2 && (!std::strcmp(argv[2], "-dm") || !std::strcmp(argv[2], "--detect-moves"))) {
+        phase.emplace("parse_args");
+        std::vector<std::filesystem::path> roots;
+        for (std::int32_t i = 3; i < argc; i++) {
+            if (!path_ok(argv[i]) || !std::filesystem::is_directory(argv[i])) {
+                ERR_EXIT(1, "update: argument %i directory \"%s\" was not a directory", i, argv[i]);
+            }
+            roots.push_back(std::filesystem::canonical(argv[i]));
+        }
+        if (roots.empty()) {
+            ERR_EXIT(1, "update: expected at least one directory after \"%s\"", argv[2]);
+        }
+
+        phase.reset();
+        std::vector<file_id_t> missing;
+        const std::vector<relocation_t> relocations = store.detect_moves(roots, missing);
+        phase.emplace("apply");
+        std::uint64_t moved = 0;
+        for (const relocation_t &relocation : relocations) {
+            const bool in_place = std::string_view(store.file_index[relocation.old_id].pathstr) == relocation.pathstr; /* a dev 0 entry getting its device */
+            if (relocation.old_id != relocation.new_id && !store.replace_id(relocation.old_id, relocation.new_id)) {
+                WARN("update: inode number " INO_FORMAT " (associated with path \"%s\") was found at \"%s\" but could not be moved there, %s, skipping", file_id_str(relocation.old_id).c_str(), store.file_index[relocation.old_id].pathstr.c_str(), relocation.pathstr.c_str(), store.error.c_str());
+                missing.push_back(relocation.old_id);
+                continue;
+            }
+            store.set_path(relocation.new_id, relocation.pathstr, relocation.meta);
+            moved += in_place ? 0 : 1;
+        }
+        for (const file_id_t &file_id : missing) {
+            WARN("update: inode number " INO_FORMAT " (associated with path \"%s\") was still not found", file_id_str(file_id).c_str(), store.file_index[file_id].pathstr.c_str());
+        }
+        std::cout << "update: " << moved << " moved, " << missing.size() << " still missing\n";
+        phase.reset(); /* dumps time themselves */
+        if (!store.commit()) {
+            ERR_EXIT(1, "%s: %s", argv[1], store.error.c_str());
+        }
+
     } else if (is_add || is_rm || is_update) {
         std::vector<change_rule_t> to_change;
 
@@ -2003,14 +1840,34 @@ other:
         change_entry_type_t change_entry_type = change_entry_type_t::only_files;
         
 
-        parse_file_args(argc - 2, argv + 2, argv[1], is_update, to_change, search_index_first, change_entry_type, is_add || is_update);
+        phase.emplace("parse_args");
+        bool fingerprint = false;
+        std::vector<file_id_t> fingerprint_ids; /* added or updated regular files, with fingerprint */
+        std::vector<file_id_t> remove_ids; /* removed at once after the walk, see store_t::remove_files */
+        bool full = false;
+        parse_file_args(argc - 2, argv + 2, argv[1], is_update, to_change, search_index_first, change_entry_type, is_add || is_update, is_rm ? nullptr : &fingerprint, is_update ? &full : nullptr);
         if (to_change.empty()) {
             WARN("%s: no action provided, see %s --HELP for more information", argv[1], argv[0]);
             return 0;
         }
+        /* update -r only walks the directories that changed since the last one, --full walks everything (and starts
+         * the cache over) */
+        dir_cache_t dir_cache;
+        const std::string dir_cache_file = store.index_file + ".dircache";
+        if (is_update && !full && !dir_cache.load(dir_cache_file, store.error)) {
+            ERR_EXIT(1, "update: %s", store.error.c_str());
+        }
+        /* the files in unchanged directories are only found through their indexed paths */
+        std::vector<std::string> indexed_paths;
+        if (is_update && !dir_cache.dirs.empty() && std::ranges::any_of(to_change, [](const change_rule_t &rule) { return rule.type == change_rule_type_t::recursive; })) {
+            indexed_paths.reserve(store.file_index.size());
+            for (const auto &[file_id, file_info] : store.file_index) {
+                if (!file_info.unresolved()) { indexed_paths.emplace_back(file_info.pathstr); }
+            }
+            std::ranges::sort(indexed_paths);
+        }
 
-        bool changed_tags = false;
-        bool changed_index = false;
+        phase.emplace("apply");
         for (std::int32_t ci = 0; ci < to_change.size(); ci++) { /* NOLINT */
             const change_rule_t &change_rule = to_change[ci];
 
@@ -2018,12 +1875,12 @@ other:
                 if (is_add) {
                     if (!std::filesystem::exists(change_rule.path)) {
                         const std::string tpathstr = change_rule.path.string();
-                        ino_t maybe_ino = search_index(change_rule.path);
-                        if (maybe_ino != 0) {
+                        file_id_t maybe_ino = store.find_path(change_rule.path);
+                        if (maybe_ino) {
                             if (tpathstr[0] == '"' && tpathstr[tpathstr.size() - 1] == '"') {
-                                ERR_EXIT(1, "add: file/directory \"%s\" could not be added, does not exist, but exists in index file with inode number " INO_FORMAT ", you might want to run the update command, path is also possibly quoted, you might want to use --stdin-parse-as-args or -sa", change_rule.path.c_str(), maybe_ino);
+                                ERR_EXIT(1, "add: file/directory \"%s\" could not be added, does not exist, but exists in index file with inode number " INO_FORMAT ", you might want to run the update command with --detect-moves if it was moved, path is also possibly quoted, you might want to use --stdin-parse-as-args or -sa", change_rule.path.c_str(), file_id_str(maybe_ino).c_str());
                             }
-                            ERR_EXIT(1, "add: file/directory \"%s\" could not be added, does not exist, but exists in index file with inode number " INO_FORMAT ", you might want to run the update command", change_rule.path.c_str(), maybe_ino);
+                            ERR_EXIT(1, "add: file/directory \"%s\" could not be added, does not exist, but exists in index file with inode number " INO_FORMAT ", you might want to run the update command with --detect-moves if it was moved", change_rule.path.c_str(), file_id_str(maybe_ino).c_str());
                         } else {
                             if (tpathstr[0] == '"' && tpathstr[tpathstr.size() - 1] == '"') {
                                 ERR_EXIT(1, "add: file/directory \"%s\" could not be added, does not exist, path is possibly quoted, you might want to use --stdin-parse-as-args or -sa", change_rule.path.c_str());
@@ -2033,31 +1890,38 @@ other:
                     }
 
                     if (!std::filesystem::is_regular_file(change_rule.path) && !std::filesystem::is_directory(change_rule.path)) {
-                        ino_t maybe_ino = search_index(change_rule.path);
-                        if (maybe_ino != 0) {
-                            WARN("add: file/directory \"%s\" could not be added, exists but was not a regular file or directory, but also exists in index file with inode number " INO_FORMAT ", you might want to run the update command", change_rule.path.c_str(), maybe_ino);
+                        file_id_t maybe_ino = store.find_path(change_rule.path);
+                        if (maybe_ino) {
+                            WARN("add: file/directory \"%s\" could not be added, exists but was not a regular file or directory, but also exists in index file with inode number " INO_FORMAT ", you might want to run the update command", change_rule.path.c_str(), file_id_str(maybe_ino).c_str());
                         } else {
                             WARN("add: file/directory \"%s\" could not be added, exists but was not a regular file or directory", change_rule.path.c_str());
                         }
                         continue;
                     }
-                    ino_t file_ino = path_get_ino(change_rule.path); /* inode adder here does not insert into to_change, can ignore change_rule.file_ino */
-                    if (map_contains(file_index, file_ino)) {
-                        WARN("add: file/directory \"%s\" could not be added, inode number " INO_FORMAT " already exists in index file (associated with path \"%s\"), you might want to run update on it, skipping", change_rule.path.c_str(), file_ino, file_index[file_ino].pathstr.c_str());
+                    file_meta_t meta;
+                    file_id_t file_id = path_get_id(change_rule.path, &meta); /* inode adder here does not insert into to_change, can ignore change_rule.file_id */
+                    const file_id_t indexed_id = store.find_id(file_id);
+                    if (indexed_id) {
+                        WARN("add: file/directory \"%s\" could not be added, inode number " INO_FORMAT " already exists in index file (associated with path \"%s\"), you might want to run update on it, skipping", change_rule.path.c_str(), file_id_str(indexed_id).c_str(), store.file_index[indexed_id].pathstr.c_str());
                         continue;
                     }
-                    file_index[file_ino] = file_info_t{file_ino, std::filesystem::canonical(change_rule.path)};
-                    changed_index = true;
+                    store.add_file(file_id, std::filesystem::canonical(change_rule.path), meta);
+                    if (fingerprint) {
+                        fingerprint_ids.push_back(file_id);
+                    }
 
                 } else if (is_rm) {
-                    ino_t file_ino = change_rule.file_ino;
-                    if (file_ino == 0 && search_index_first) {
-                        file_ino = search_index(change_rule.path);
+                    file_id_t file_id = store.find_id(change_rule.file_id);
+                    if (!file_id) {
+                        file_id = change_rule.file_id;
+                    }
+                    if (!file_id && search_index_first) {
+                        file_id = store.find_path(change_rule.path);
                     }
-                    if (file_ino == 0) {
-                        file_ino = search_use_fs(change_rule.path);
+                    if (!file_id) {
+                        file_id = store.find_on_disk(change_rule.path);
                     }
-                    if (file_ino == 0) {
+                    if (!file_id) {
                         std::string twarn_str = "rm: file/directory \"%s\" could not be removed";
                         if (search_index_first) {
                             twarn_str += ", searched both by path in index file and by its inode number (from disk) and was not found";
@@ -2071,23 +1935,21 @@ other:
                         WARN(twarn_str.c_str(), change_rule.path.c_str());
                         continue;
                     }
-                    for (const tid_t &tagid : file_index[file_ino].tags) {
-                        std::erase(tags[tagid].files, file_ino);
-                    }
-                    if (!file_index[file_ino].tags.empty()) {
-                        changed_tags = true;
-                    }
-                    file_index.erase(file_ino);
-                    changed_index = true;
+                    remove_ids.push_back(file_id);
 
                 } else if (is_update) {
                     if (!std::filesystem::exists(change_rule.path)) {
                         ERR_EXIT(1, "update: file/directory \"%s\" could not be updated, does not exist", change_rule.path.c_str());
                     }
-                    ino_t file_ino = path_get_ino(change_rule.path);
-                    if (map_contains(file_index, file_ino)) {
-                        file_index[file_ino].pathstr = change_rule.path;
-                        changed_index = true;
+                    file_meta_t meta;
+                    const file_id_t file_id = path_get_id(change_rule.path, &meta);
+                    const file_id_t indexed_id = store.find_id(file_id);
+                    if (indexed_id && indexed_id != file_id) {
+                        store.replace_id(indexed_id, file_id); /* a dev 0 entry gets its device */
+                    }
+                    store.set_path(file_id, change_rule.path, meta);
+                    if (fingerprint) {
+                        fingerprint_ids.push_back(file_id);
                     }
                 }
 
@@ -2097,41 +1959,51 @@ other:
                 }
                 /* because we want to process them in the same order as they were passed, we insert into to_change here and
                  * also in get_all instead of just push_back */
+                dir_cache_t *walk_cache = is_update ? &dir_cache : nullptr;
                 if (change_entry_type == change_entry_type_t::only_directories || change_entry_type == change_entry_type_t::all_entries) {
                     to_change.insert(to_change.begin() + ci+1, change_rule_t{change_rule.path, change_rule_type_t::single_file});
-                    get_all(change_rule.path, to_change, ci+2, change_entry_type);
+                    get_all(change_rule.path, to_change, ci+2, change_entry_type, walk_cache, indexed_paths);
                 } else {
-                    get_all(change_rule.path, to_change, ci+1, change_entry_type);
+                    get_all(change_rule.path, to_change, ci+1, change_entry_type, walk_cache, indexed_paths);
                 }
 
             } else if (change_rule.type == change_rule_type_t::inode_number) {
                 if (is_rm) {
-                    if (!map_contains(file_index, change_rule.file_ino)) {
-                        ERR_EXIT(1, "%s: inode number " INO_FORMAT " could not be removed, was not found in index file", argv[1], change_rule.file_ino);
+                    const file_id_t file_id = store.find_id(change_rule.file_id);
+                    if (!file_id) {
+                        ERR_EXIT(1, "%s: inode number " INO_FORMAT " could not be removed, was not found in index file", argv[1], file_id_str(change_rule.file_id).c_str());
                     }
-                    to_change.insert(to_change.begin() + ci+1, change_rule_t{.type = change_rule_type_t::single_file, .file_ino = change_rule.file_ino, .from_ino = true});
+                    to_change.insert(to_change.begin() + ci+1, change_rule_t{.type = change_rule_type_t::single_file, .file_id = file_id, .from_ino = true});
                 } else if (is_add) {
-                    if (map_contains(file_index, change_rule.file_ino)) {
-                        WARN("%s: inode number " INO_FORMAT " could not be added, already exists in index file (associated with path \"%s\"), skipping", argv[1], change_rule.file_ino, file_index[change_rule.file_ino].pathstr.c_str());
+                    const file_id_t indexed_id = store.find_id(change_rule.file_id);
+                    if (indexed_id) {
+                        WARN("%s: inode number " INO_FORMAT " could not be added, already exists in index file (associated with path \"%s\"), skipping", argv[1], file_id_str(indexed_id).c_str(), store.file_index[indexed_id].pathstr.c_str());
                         continue;
                     }
-                    file_index[change_rule.file_ino] = file_info_t{change_rule.file_ino};
-                    changed_index = true;
-                    WARN("%s: inode number " INO_FORMAT " adding to index file with unresolved path, you might want to run the update command", argv[1], change_rule.file_ino);
+                    store.add_file(change_rule.file_id, "");
+                    WARN("%s: inode number " INO_FORMAT " adding to index file with unresolved path, you might want to run the update command", argv[1], file_id_str(change_rule.file_id).c_str());
                 }
             }
         }
-        if (changed_tags) {
-            dump_saved_tags();
+        if (!remove_ids.empty()) {
+            store.remove_files(remove_ids);
+        }
+        if (!fingerprint_ids.empty()) {
+            store.fingerprint(fingerprint_ids);
         }
-        if (changed_index) {
-            dump_file_index();
+        phase.reset(); /* dumps time themselves */
+        if (!store.commit()) {
+            ERR_EXIT(1, "%s: %s", argv[1], store.error.c_str());
+        }
+        if (dir_cache.changed) {
+            dir_cache.dump(dir_cache_file);
         }
 
     } else if (is_fix) {
         if (argc < 3) {
             ERR_EXIT(1, "fix: expected a flag, see %s --HELP for more information", argv[0]);
         }
+        phase.emplace("parse_args");
         std::vector<fix_rule_t> fix_rules;
         for (std::uint32_t i = 2; i < argc; i++) {
             if (!std::strcmp(argv[i], "-p") || !std::strcmp(argv[i], "--path-all")) {
@@ -2140,8 +2012,8 @@ other:
                 if (i >= argc - 1) {
                     ERR_EXIT(1, "fix: expected argument <inum> due to path i flag (argument %i)", i);
                 }
-                ino_t inum = std::strtoul(argv[++i], nullptr, 0);
-                if (inum == 0) {
+                file_id_t inum;
+                if (!parse_file_id(argv[++i], inum)) {
                     ERR_EXIT(1, "fix: argument %i inode number \"%s\" was not valid", i, argv[i]);
                 }
                 fix_rules.push_back(fix_rule_t{.path_d = inum, .type = fix_rule_type_t::path_i});
@@ -2158,9 +2030,8 @@ other:
                 if (i >= argc - 2) {
                     ERR_EXIT(1, "fix: expected arguments <inum> <path> due to replace ip flag (argument %i)", i);
                 }
-                ino_t inum = 0;
-                inum = std::strtoul(argv[++i], nullptr, 0);
-                if (inum == 0) {
+                file_id_t inum;
+                if (!parse_file_id(argv[++i], inum)) {
                     ERR_EXIT(1, "fix: argument %i inode number \"%s\" was not valid", i, argv[i]);
                 }
                 std::string pathstr = argv[++i];
@@ -2172,14 +2043,12 @@ other:
                 if (i >= argc - 2) {
                     ERR_EXIT(1, "fix: expected arguments <inum> <newinum> due to replace ii flag (argument %i)", i);
                 }
-                ino_t inum = 0;
-                inum = std::strtoul(argv[++i], nullptr, 0);
-                if (inum == 0) {
+                file_id_t inum;
+                if (!parse_file_id(argv[++i], inum)) {
                     ERR_EXIT(1, "fix: argument %i inode number \"%s\" was not valid", i, argv[i]);
                 }
-                ino_t newinum = 0;
-                newinum = std::strtoul(argv[++i], nullptr, 0);
-                if (newinum == 0) {
+                file_id_t newinum;
+                if (!parse_file_id(argv[++i], newinum)) {
                     ERR_EXIT(1, "fix: argument %i inode number \"%s\" was not valid", i, argv[i]);
                 }
                 fix_rules.push_back(fix_rule_t{.a = inum, .b = newinum, .type = fix_rule_type_t::rii});
@@ -2204,209 +2073,188 @@ other:
                 if (!path_ok(pathstr)) {
                     ERR_EXIT(1, "fix: argument %i could not construct path \"%s\"", i, argv[i]);
                 }
-                ino_t inum = 0;
-                inum = std::strtoul(argv[++i], nullptr, 0);
-                if (inum == 0) {
+                file_id_t inum;
+                if (!parse_file_id(argv[++i], inum)) {
                     ERR_EXIT(1, "fix: argument %i inode number \"%s\" was not valid", i, argv[i]);
                 }
                 fix_rules.push_back(fix_rule_t{.a = std::filesystem::path(pathstr), .b = inum, .type = fix_rule_type_t::rpi});
+            } else if (!std::strcmp(argv[i], "-c") || !std::strcmp(argv[i], "--by-content")) {
+                if (i >= argc - 1) {
+                    ERR_EXIT(1, "fix: expected argument <directory> due to by content flag (argument %i)", i);
+                }
+                std::string pathstr = argv[++i];
+                if (!path_ok(pathstr) || !std::filesystem::is_directory(pathstr)) {
+                    ERR_EXIT(1, "fix: argument %i directory \"%s\" was not a directory", i, argv[i]);
+                }
+                fix_rules.push_back(fix_rule_t{.path_d = std::filesystem::canonical(pathstr), .type = fix_rule_type_t::by_content});
             } else {
                 ERR_EXIT(1, "fix: flag \"%s\" was not recognized", argv[i]);
             }
         }
 
-        bool changed_tags = false;
-        bool changed_index = false;
+        phase.emplace("apply");
         for (const fix_rule_t &fix_rule : fix_rules) {
             bool is_rip = fix_rule.type == fix_rule_type_t::rip;
             bool is_rii = fix_rule.type == fix_rule_type_t::rii;
             bool is_rpi = fix_rule.type == fix_rule_type_t::rpi;
             bool is_rpp = fix_rule.type == fix_rule_type_t::rpp;
+            if (fix_rule.type == fix_rule_type_t::by_content) {
+                for (const relocation_t &match : store.match_by_content(std::get<std::filesystem::path>(fix_rule.path_d))) {
+                    store.replace_id(match.old_id, match.new_id);
+                    store.set_path(match.new_id, match.pathstr, match.meta);
+                }
+                continue;
+            }
             if (fix_rule.type == fix_rule_type_t::path_all) {
-                std::vector<std::pair<ino_t, ino_t>> ino_changes; /* old, new */
-                for (const auto &[file_ino, file_info] : file_index) {
+                std::vector<std::pair<file_id_t, file_id_t>> ino_changes; /* old, new */
+                profile.files_scanned += store.file_index.size();
+                for (const auto &[file_id, file_info] : store.file_index) {
                     struct stat buffer{};
                     if (!file_exists(file_info.pathstr, &buffer)) {
                         continue;
                     }
-                    if (buffer.st_ino == file_ino) {
+                    if (file_id_of(buffer) == file_id) {
                         continue; /* is good */
                     }
-                    if (map_contains(file_index, buffer.st_ino)) {
-                        WARN("fix: old inode number " INO_FORMAT " (associated with path \"%s\") could not be fixed, new inode number " INO_FORMAT " (from old inode number path) was already in index file (associated with path \"%s\"), you might want to run the fix command with a manual replace flag, update command, or rm command, skipping", file_ino, file_info.pathstr.c_str(), buffer.st_ino, file_index[buffer.st_ino].pathstr.c_str());
+                    /* finding itself is a dev 0 entry getting its device */
+                    const file_id_t indexed_id = store.find_id(file_id_of(buffer));
+                    if (indexed_id && indexed_id != file_id) {
+                        WARN("fix: old inode number " INO_FORMAT " (associated with path \"%s\") could not be fixed, new inode number " INO_FORMAT " (from old inode number path) was already in index file (associated with path \"%s\"), you might want to run the fix command with a manual replace flag, update command, or rm command, skipping", file_id_str(file_id).c_str(), file_info.pathstr.c_str(), file_id_str(file_id_of(buffer)).c_str(), store.file_index[indexed_id].pathstr.c_str());
                         continue;
                     }
-                    ino_changes.emplace_back(file_ino, buffer.st_ino);
+                    ino_changes.emplace_back(file_id, file_id_of(buffer));
                 }
                 for (const auto &[oldino, newino] : ino_changes) {
-                    for (const tid_t &tagid : file_index[oldino].tags) {
-                        std::replace(tags[tagid].files.begin(), tags[tagid].files.end(), oldino, newino);
-                    }
-                    if (!file_index[oldino].tags.empty()) {
-                        changed_tags = true;
-                    }
-                    file_index[newino] = file_index[oldino];
-                    file_index.erase(oldino);
-                }
-                if (!ino_changes.empty()) {
-                    changed_index = true;
+                    store.replace_id(oldino, newino);
                 }
             } else if (fix_rule.type == fix_rule_type_t::path_i) {
-                ino_t oldino = std::get<ino_t>(fix_rule.path_d);
-                if (!map_contains(file_index, oldino)) {
-                    ERR_EXIT(1, "fix: old inode number " INO_FORMAT " could not be fixed, was not in index file", oldino);
+                file_id_t oldino = store.find_id(std::get<file_id_t>(fix_rule.path_d));
+                if (!oldino) {
+                    ERR_EXIT(1, "fix: old inode number " INO_FORMAT " could not be fixed, was not in index file", file_id_str(std::get<file_id_t>(fix_rule.path_d)).c_str());
                 }
                 struct stat buffer{};
-                if (!file_exists(file_index[oldino].pathstr, &buffer)) {
-                    ERR_EXIT(1, "fix: old inode number " INO_FORMAT " could not be fixed, associated path \"%s\" was not found", oldino, file_index[oldino].pathstr.c_str());
+                if (!file_exists(store.file_index[oldino].pathstr, &buffer)) {
+                    ERR_EXIT(1, "fix: old inode number " INO_FORMAT " could not be fixed, associated path \"%s\" was not found", file_id_str(oldino).c_str(), store.file_index[oldino].pathstr.c_str());
                 }
-                if (buffer.st_ino == oldino) {
-                    WARN("fix: old inode number " INO_FORMAT " could not be fixed, index file entry was already good (inode number matches that found at the associated path \"%s\"), skipping", oldino, file_index[oldino].pathstr.c_str());
+                if (file_id_of(buffer) == oldino) {
+                    WARN("fix: old inode number " INO_FORMAT " could not be fixed, index file entry was already good (inode number matches that found at the associated path \"%s\"), skipping", file_id_str(oldino).c_str(), store.file_index[oldino].pathstr.c_str());
                     continue;
                 }
-                if (map_contains(file_index, buffer.st_ino)) {
-                    WARN("fix: old inode number " INO_FORMAT " (associated with path \"%s\") could not be fixed, new inode number " INO_FORMAT " (from old inode number path) was already in index file (associated with path \"%s\"), you might want to run the fix command with a manual replace flag, update command, or rm command, skipping", oldino, file_index[oldino].pathstr.c_str(), buffer.st_ino, file_index[buffer.st_ino].pathstr.c_str());
+                const file_id_t indexed_id = store.find_id(file_id_of(buffer));
+                if (indexed_id && indexed_id != oldino) {
+                    WARN("fix: old inode number " INO_FORMAT " (associated with path \"%s\") could not be fixed, new inode number " INO_FORMAT " (from old inode number path) was already in index file (associated with path \"%s\"), you might want to run the fix command with a manual replace flag, update command, or rm command, skipping", file_id_str(oldino).c_str(), store.file_index[oldino].pathstr.c_str(), file_id_str(file_id_of(buffer)).c_str(), store.file_index[indexed_id].pathstr.c_str());
                     continue;
                 }
-                for (const tid_t &tagid : file_index[oldino].tags) {
-                    std::replace(tags[tagid].files.begin(), tags[tagid].files.end(), oldino, buffer.st_ino);
-                }
-                if (!file_index[oldino].tags.empty()) {
-                    changed_tags = true;
-                }
-                file_index[buffer.st_ino] = file_index[oldino];
-                file_index.erase(oldino);
-                changed_index = true;
+                store.replace_id(oldino, file_id_of(buffer));
 
             } else if (fix_rule.type == fix_rule_type_t::path_p) {
                 auto path = std::get<std::filesystem::path>(fix_rule.path_d);
-                ino_t oldino = search_index(path);
-                if (oldino == 0) {
+                file_id_t oldino = store.find_path(path);
+                if (!oldino) {
                     ERR_EXIT(1, "fix: old inode number could not be fixed, passed path \"%s\" was not found in index file", path.c_str());
                 }
                 struct stat buffer{};
-                if (!file_exists(file_index[oldino].pathstr, &buffer)) {
-                    ERR_EXIT(1, "fix: old inode number " INO_FORMAT " (from passed path \"%s\") could not be fixed, passed path was not found", oldino, path.c_str());
+                if (!file_exists(store.file_index[oldino].pathstr, &buffer)) {
+                    ERR_EXIT(1, "fix: old inode number " INO_FORMAT " (from passed path \"%s\") could not be fixed, passed path was not found", file_id_str(oldino).c_str(), path.c_str());
                 }
-                if (buffer.st_ino == oldino) {
-                    WARN("fix: old inode number " INO_FORMAT " (from passed path \"%s\") could not be fixed, index file entry was already good (inode number matches that found at the associated path \"%s\"), skipping", oldino, path.c_str(), file_index[oldino].pathstr.c_str()); /* here associated path and passed path should be identical but whatever */
+                if (file_id_of(buffer) == oldino) {
+                    WARN("fix: old inode number " INO_FORMAT " (from passed path \"%s\") could not be fixed, index file entry was already good (inode number matches that found at the associated path \"%s\"), skipping", file_id_str(oldino).c_str(), path.c_str(), store.file_index[oldino].pathstr.c_str()); /* here associated path and passed path should be identical but whatever */
                     continue;
                 }
-                if (map_contains(file_index, buffer.st_ino)) {
-                    WARN("fix: old inode number " INO_FORMAT " (from passed path \"%s\") could not be fixed, new inode number " INO_FORMAT " (from old inode number path) was already in index file (associated with path \"%s\"), you might want to run the fix command with a manual replace flag, update command, or rm command, skipping", oldino, path.c_str(), buffer.st_ino, file_index[buffer.st_ino].pathstr.c_str());
+                const file_id_t indexed_id = store.find_id(file_id_of(buffer));
+                if (indexed_id && indexed_id != oldino) {
+                    WARN("fix: old inode number " INO_FORMAT " (from passed path \"%s\") could not be fixed, new inode number " INO_FORMAT " (from old inode number path) was already in index file (associated with path \"%s\"), you might want to run the fix command with a manual replace flag, update command, or rm command, skipping", file_id_str(oldino).c_str(), path.c_str(), file_id_str(file_id_of(buffer)).c_str(), store.file_index[indexed_id].pathstr.c_str());
                     continue;
                 }
-                for (const tid_t &tagid : file_index[oldino].tags) {
-                    std::replace(tags[tagid].files.begin(), tags[tagid].files.end(), oldino, buffer.st_ino);
-                }
-                if (!file_index[oldino].tags.empty()) {
-                    changed_tags = true;
-                }
-                file_index[buffer.st_ino] = file_index[oldino];
-                file_index.erase(oldino);
-                changed_index = true;
+                store.replace_id(oldino, file_id_of(buffer));
 
             } else if (is_rip || is_rii || is_rpi || is_rpp) {
-                ino_t oldino = 0;
-                ino_t newino = 0;
+                file_id_t oldino;
+                file_id_t newino;
                 if (is_rip) {
-                    oldino = std::get<ino_t>(fix_rule.a);
+                    oldino = store.find_id(std::get<file_id_t>(fix_rule.a));
                     auto newpath = std::get<std::filesystem::path>(fix_rule.b);
                     struct stat buffer{};
                     if (!file_exists(newpath, &buffer)) {
-                        ERR_EXIT(1, "fix: old inode number " INO_FORMAT " could not be fixed, passed path \"%s\" was not found", oldino, newpath.c_str());
+                        ERR_EXIT(1, "fix: old inode number " INO_FORMAT " could not be fixed, passed path \"%s\" was not found", file_id_str(std::get<file_id_t>(fix_rule.a)).c_str(), newpath.c_str());
                     }
                     /* we won't actually require this, as we only need the inode number
                      * and trust the user knows because this is a very manual flag
                      * same goes for --replace-pp */
                     /* if (!std::filesystem::is_directory(path) && !std::filesystem::is_regular_file(path)) {
-                        ERR_EXIT(1, "fix: old inode number " INO_FORMAT " could not be fixed, passed path \"%s\" exists but was not a regular file or directory", oldino, path.c_str());
+                        ERR_EXIT(1, "fix: old inode number " INO_FORMAT " could not be fixed, passed path \"%s\" exists but was not a regular file or directory", file_id_str(oldino).c_str(), path.c_str());
                     } */
-                    newino = buffer.st_ino;
-                    if (!map_contains(file_index, oldino)) {
-                        ERR_EXIT(1, "fix: old inode number " INO_FORMAT " could not be fixed, was not in index file", oldino);
+                    newino = file_id_of(buffer);
+                    if (!oldino) {
+                        ERR_EXIT(1, "fix: old inode number " INO_FORMAT " could not be fixed, was not in index file", file_id_str(std::get<file_id_t>(fix_rule.a)).c_str());
                     }
-                    if (map_contains(file_index, newino)) {
-                        ERR_EXIT(1, "fix: old inode number " INO_FORMAT " could not be fixed, new inode number " INO_FORMAT " (from passed path \"%s\") was already in index file (associated with path \"%s\"), cannot replace", oldino, newino, newpath.c_str(), file_index[newino].pathstr.c_str());
+                    if (store.contains(newino)) {
+                        ERR_EXIT(1, "fix: old inode number " INO_FORMAT " could not be fixed, new inode number " INO_FORMAT " (from passed path \"%s\") was already in index file (associated with path \"%s\"), cannot replace", file_id_str(oldino).c_str(), file_id_str(newino).c_str(), newpath.c_str(), store.file_index[newino].pathstr.c_str());
                     }
                 } else if (is_rii) {
-                    oldino = std::get<ino_t>(fix_rule.a);
-                    newino = std::get<ino_t>(fix_rule.b);
-                    if (!map_contains(file_index, oldino)) {
-                        ERR_EXIT(1, "fix: old inode number " INO_FORMAT " could not be fixed, was not in index file", oldino);
+                    oldino = store.find_id(std::get<file_id_t>(fix_rule.a));
+                    newino = std::get<file_id_t>(fix_rule.b);
+                    if (!oldino) {
+                        ERR_EXIT(1, "fix: old inode number " INO_FORMAT " could not be fixed, was not in index file", file_id_str(std::get<file_id_t>(fix_rule.a)).c_str());
+                    }
+                    if (newino.dev == 0) {
+                        newino.dev = oldino.dev; /* a bare new inode number stays on the old one's device */
                     }
-                    if (map_contains(file_index, newino)) {
-                        ERR_EXIT(1, "fix: old inode number " INO_FORMAT " could not be fixed, new inode number " INO_FORMAT " was already in index file (associated with path \"%s\"), cannot replace", oldino, newino, file_index[newino].pathstr.c_str());
+                    if (store.contains(newino)) {
+                        ERR_EXIT(1, "fix: old inode number " INO_FORMAT " could not be fixed, new inode number " INO_FORMAT " was already in index file (associated with path \"%s\"), cannot replace", file_id_str(oldino).c_str(), file_id_str(newino).c_str(), store.file_index[newino].pathstr.c_str());
                     }
                 } else if (is_rpi) {
                     auto path = std::get<std::filesystem::path>(fix_rule.a);
-                    newino = std::get<ino_t>(fix_rule.b);
+                    newino = std::get<file_id_t>(fix_rule.b);
                     path = std::filesystem::weakly_canonical(path);
-                    oldino = search_index(path);
-                    if (oldino == 0) {
+                    oldino = store.find_path(path);
+                    if (!oldino) {
                         ERR_EXIT(1, "fix: old inode number (from passed path \"%s\") could not be fixed, passed path was not found in index file", path.c_str());
                     }
-                    if (!map_contains(file_index, oldino)) {
-                        ERR_EXIT(1, "fix: old inode number " INO_FORMAT " (from passed path \"%s\") could not be fixed, was not in index file", oldino, path.c_str());
+                    if (!store.contains(oldino)) {
+                        ERR_EXIT(1, "fix: old inode number " INO_FORMAT " (from passed path \"%s\") could not be fixed, was not in index file", file_id_str(oldino).c_str(), path.c_str());
+                    }
+                    if (newino.dev == 0) {
+                        newino.dev = oldino.dev;
                     }
-                    if (map_contains(file_index, newino)) {
-                        ERR_EXIT(1, "fix: old inode number " INO_FORMAT " (from passed path \"%s\") could not be fixed, new inode number " INO_FORMAT " was already in index file (associated with path \"%s\"), cannot replace", oldino, path.c_str(), newino, file_index[newino].pathstr.c_str());
+                    if (store.contains(newino)) {
+                        ERR_EXIT(1, "fix: old inode number " INO_FORMAT " (from passed path \"%s\") could not be fixed, new inode number " INO_FORMAT " was already in index file (associated with path \"%s\"), cannot replace", file_id_str(oldino).c_str(), path.c_str(), file_id_str(newino).c_str(), store.file_index[newino].pathstr.c_str());
                     }
                 } else if (is_rpp) {
                     auto path = std::get<std::filesystem::path>(fix_rule.a);
                     auto newpath = std::get<std::filesystem::path>(fix_rule.b);
                     path = std::filesystem::weakly_canonical(path);
-                    oldino = search_index(path);
-                    if (oldino == 0) {
+                    oldino = store.find_path(path);
+                    if (!oldino) {
                         ERR_EXIT(1, "fix: old inode number (from passed path \"%s\") could not be fixed, passed path was not found in index file", path.c_str());
                     }
-                    if (!map_contains(file_index, oldino)) {
-                        ERR_EXIT(1, "fix: old inode number " INO_FORMAT " (from passed path \"%s\") could not be fixed, was not in index file", oldino, path.c_str());
+                    if (!store.contains(oldino)) {
+                        ERR_EXIT(1, "fix: old inode number " INO_FORMAT " (from passed path \"%s\") could not be fixed, was not in index file", file_id_str(oldino).c_str(), path.c_str());
                     }
                     struct stat buffer{};
                     if (!file_exists(newpath, &buffer)) {
-                        ERR_EXIT(1, "fix: old inode number " INO_FORMAT " (from passed path \"%s\") could not be fixed, passed path \"%s\" for new inode number was not found", oldino, path.c_str(), newpath.c_str());
+                        ERR_EXIT(1, "fix: old inode number " INO_FORMAT " (from passed path \"%s\") could not be fixed, passed path \"%s\" for new inode number was not found", file_id_str(oldino).c_str(), path.c_str(), newpath.c_str());
                     }
-                    newino = buffer.st_ino;
-                    if (map_contains(file_index, newino)) {
-                        ERR_EXIT(1, "fix: old inode number " INO_FORMAT " (from passed path \"%s\") could not be fixed, new inode number " INO_FORMAT " (from passed path \"%s\") was already in index file (associated with path \"%s\"), cannot replace", oldino, path.c_str(), newino, newpath.c_str(), file_index[newino].pathstr.c_str());
+                    newino = file_id_of(buffer);
+                    if (store.contains(newino)) {
+                        ERR_EXIT(1, "fix: old inode number " INO_FORMAT " (from passed path \"%s\") could not be fixed, new inode number " INO_FORMAT " (from passed path \"%s\") was already in index file (associated with path \"%s\"), cannot replace", file_id_str(oldino).c_str(), path.c_str(), file_id_str(newino).c_str(), newpath.c_str(), store.file_index[newino].pathstr.c_str());
                     }
                 }
 
-                for (const tid_t &tagid : file_index[oldino].tags) {
-                    std::replace(tags[tagid].files.begin(), tags[tagid].files.end(), oldino, newino);
-                }
-                if (!file_index[oldino].tags.empty()) {
-                    changed_tags = true;
-                }
-                file_index[newino] = file_index[oldino];
-                file_index.erase(oldino);
-                changed_index = true;
+                store.replace_id(oldino, newino);
 
             }
         }
-        if (changed_tags) {
-            dump_saved_tags();
-        }
-        if (changed_index) {
-            dump_file_index();
+        phase.reset(); /* dumps time themselves */
+        if (!store.commit()) {
+            ERR_EXIT(1, "%s: %s", argv[1], store.error.c_str());
         }
 
     } else if (is_tag) {
         if (argc < 3) {
             ERR_EXIT(1, "tag: expected a subcommand, see %s --HELP for more information", argv[0]);
         }
-        
-        const auto tag_by_name = [](const std::string &name, bool &found) -> tag_t& {
-            static tag_t temp; /* bs */
-            for (auto &[_, tag] : tags) {
-                if (tag.name == name) {
-                    found = true;
-                    return tag;
-                }
-            }
-            return temp;
-        };
+        phase.emplace("apply");
 
         std::string subcommand = argv[2];
         bool is_tag_add = subcommand == "add";
@@ -2423,208 +2271,188 @@ other:
                     ERR_EXIT(1, "tag: create: hex color \"%s\" was bad", argv[4]);
                 }
             }
-            tid_t tagid = generate_unique_tid();
-            if (tag_name_bad(argv[3])) {
-                ERR_EXIT(1, "tag: create: bad tag name \"%s\"", argv[3]);
-            }
-            for (const auto &[tagid, tag] : tags) {
-                if (tag.name == argv[3]) {
-                    ERR_EXIT(1, "tag: create: tag \"%s\" could not be created, already exists", argv[3]);
-                }
+            if (store.create_tag(argv[3], color) == nullptr) {
+                ERR_EXIT(1, "tag: create: %s", store.error.c_str());
             }
-            tags[tagid] = tag_t{tagid, argv[3], color};
-            dump_saved_tags();
 
         } else if (subcommand == "delete") {
             if (argc < 4) {
                 ERR_EXIT(1, "tag: delete: expected argument <name>");
             }
             std::string name = argv[3];
-            bool found = false;
-            tag_t &tag = tag_by_name(name, found);
-            if (!found) {
+            const tag_t *tag = store.find_tag(name);
+            if (tag == nullptr) {
                 ERR_EXIT(1, "tag: delete: tag \"%s\" could not be deleted, was not found", name.c_str());
             }
-            for (const tid_t &id : tag.sub) {
-                std::erase(tags[id].super, tag.id);
-            }
-            for (const tid_t &id : tag.super) {
-                std::erase(tags[id].sub, tag.id);
+            if (!store.delete_tag(*tag)) {
+                ERR_EXIT(1, "tag: delete: %s, change that search first", store.error.c_str());
             }
-            for (const ino_t &file_ino : tag.files) {
-                std::erase(file_index[file_ino].tags, tag.id);
-            }
-            tags.erase(tag.id);
-            dump_saved_tags();
 
         } else if (subcommand == "enable") {
             if (argc < 4) {
                 ERR_EXIT(1, "tag: enable: expected argument <name>");
             }
             std::string name = argv[3];
-            bool found = false;
-            tag_t &tag = tag_by_name(name, found);
-            if (!found) {
+            tag_t *tag = store.find_tag(name);
+            if (tag == nullptr) {
                 ERR_EXIT(1, "tag: enable: tag \"%s\" could not be enabled, was not found", name.c_str());
             }
-            tag.enabled = true;
-            dump_saved_tags();
+            store.set_enabled(*tag, true);
 
         } else if (subcommand == "disable") {
             if (argc < 4) {
                 ERR_EXIT(1, "tag: disable: expected argument <name>");
             }
             std::string name = argv[3];
-            bool found = false;
-            tag_t &tag = tag_by_name(name, found);
-            if (!found) {
+            tag_t *tag = store.find_tag(name);
+            if (tag == nullptr) {
                 ERR_EXIT(1, "tag: disable: tag \"%s\" could not be disabled, was not found", name.c_str());
             }
-            tag.enabled = false;
-            dump_saved_tags();
+            store.set_enabled(*tag, false);
+
+        } else if (subcommand == "virtual") {
+            if (argc < 4) {
+                ERR_EXIT(1, "tag: virtual: expected arguments <name> <search flags>");
+            }
+            std::string name = argv[3];
+            tag_t *pttag = store.find_tag(name);
+            if (pttag == nullptr && (pttag = store.create_tag(name, {})) == nullptr) {
+                ERR_EXIT(1, "tag: virtual: %s", store.error.c_str());
+            }
+            virtual_tag_t virtual_tag;
+            for (std::uint32_t i = 4; i < argc; i++) {
+                const std::string targ = argv[i];
+                if (targ == "--search-file-path") {
+                    virtual_tag.search_file_path = true;
+                    continue;
+                } else if (targ == "--search-file-name") {
+                    virtual_tag.search_file_path = false;
+                    continue;
+                }
+                search_rule_t rule;
+                std::string flag_error;
+                if (!parse_search_flag(targ, rule.type, rule.opt, flag_error)) {
+                    ERR_EXIT(1, "tag: virtual: argument %i %s", i, flag_error.c_str());
+                }
+                if (rule.type == search_rule_type_t::inode || rule.type == search_rule_type_t::inode_exclude) {
+                    if (i >= argc - 1) {
+                        ERR_EXIT(1, "tag: virtual: expected argument <inum> after \"%s\"", targ.c_str());
+                    }
+                    if (!parse_file_id(argv[++i], rule.inum)) {
+                        ERR_EXIT(1, "tag: virtual: argument %i inode number \"%s\" was not valid", i, argv[i]);
+                    }
+                } else if (rule.type != search_rule_type_t::all_list && rule.type != search_rule_type_t::all_list_exclude) {
+                    if (i >= argc - 1) {
+                        ERR_EXIT(1, "tag: virtual: expected argument <text> after \"%s\"", targ.c_str());
+                    }
+                    rule.text = argv[++i];
+                    if (rule.text.find('\n') != std::string::npos) {
+                        ERR_EXIT(1, "tag: virtual: argument %i text cannot have newlines", i);
+                    }
+                }
+                virtual_tag.rules.push_back(rule);
+            }
+            if (!store.set_virtual(*pttag, virtual_tag)) {
+                ERR_EXIT(1, "tag: virtual: %s", store.error.c_str());
+            }
 
         } else if (subcommand == "edit") {
             if (argc < 5) {
                 ERR_EXIT(1, "tag: edit: expected arguments <name> <flags>");
             }
             std::string name = argv[3];
-            bool found = false;
-            tag_t &ttag = tag_by_name(name, found);
-            if (!found) {
+            tag_t *pttag = store.find_tag(name);
+            if (pttag == nullptr) {
                 ERR_EXIT(1, "tag: edit: tag \"%s\" could not be edited, was not found", name.c_str());
             }
-            bool changed = false;
+            tag_t &ttag = *pttag;
             for (std::uint32_t i = 4; i < argc; i++) {
                 if (!std::strcmp(argv[i], "-ras") || !std::strcmp(argv[i], "--remove-all-super")) {
-                    for (const tid_t &id : ttag.super) {
-                        std::erase(tags[id].sub, ttag.id);
-                    }
-                    ttag.super.clear();
-                    changed = true;
+                    store.remove_all_super(ttag);
 
                 } else if (!std::strcmp(argv[i], "-rab") || !std::strcmp(argv[i], "--remove-all-sub")) {
-                    for (const tid_t &id : ttag.sub) {
-                        std::erase(tags[id].super, ttag.id);
-                    }
-                    ttag.sub.clear();
-                    changed = true;
+                    store.remove_all_sub(ttag);
 
                 } else if (!std::strcmp(argv[i], "-rc") || !std::strcmp(argv[i], "--remove-color")) {
-                    ttag.color.reset();
-                    changed = true;
+                    store.set_color(ttag, {});
+
+                } else if (!std::strcmp(argv[i], "-rq") || !std::strcmp(argv[i], "--remove-query")) {
+                    if (!store.virtual_tags.contains(ttag.id)) {
+                        WARN("tag: edit: tag \"%s\" was not virtual, skipping", ttag.name.c_str());
+                        continue;
+                    }
+                    store.clear_virtual(ttag);
 
                 } else if (!std::strcmp(argv[i], "-as") || !std::strcmp(argv[i], "--add-super")) {
                     if (i >= argc - 1) {
                         ERR_EXIT(1, "tag: edit: add super flag expected argument <supername>");
                     }
                     std::string supername = argv[++i];
-                    bool found = false;
-                    tag_t &tag = tag_by_name(supername, found);
-                    if (!found) {
-                        WARN("tag: edit: tag \"%s\" could not be added as a supertag to tag \"%s\", the first was not found, skipping", tag.name.c_str(), ttag.name.c_str());
+                    tag_t *tag = store.find_tag(supername);
+                    if (tag == nullptr) {
+                        WARN("tag: edit: tag \"%s\" could not be added as a supertag to tag \"%s\", the first was not found, skipping", supername.c_str(), ttag.name.c_str());
                         continue;
                     }
-                    bool already_super = std::find(ttag.super.begin(), ttag.super.end(), tag.id) != ttag.super.end();
-                    bool already_sub = std::find(tag.sub.begin(), tag.sub.end(), ttag.id) != tag.sub.end();
-                    if (already_sub || already_super) {
-                        WARN("tag: edit: tag \"%s\" was already a supertag of tag \"%s\"", tag.name.c_str(), ttag.name.c_str());
-                    }
-                    if (!already_super) {
-                        ttag.super.push_back(tag.id);
-                        changed = true;
-                    }
-                    if (!already_sub) {
-                        tag.sub.push_back(ttag.id);
-                        changed = true;
+                    if (store.has_super(ttag, *tag)) {
+                        WARN("tag: edit: tag \"%s\" was already a supertag of tag \"%s\"", tag->name.c_str(), ttag.name.c_str());
                     }
+                    store.add_super(ttag, *tag);
 
                 } else if (!std::strcmp(argv[i], "-rs") || !std::strcmp(argv[i], "--remove-super")) {
                     if (i >= argc - 1) {
                         ERR_EXIT(1, "tag: edit: remove super flag expected argument <supername>");
                     }
                     std::string supername = argv[++i];
-                    bool found = false;
-                    tag_t &tag = tag_by_name(supername, found);
-                    if (!found) {
-                        WARN("tag: edit: tag \"%s\" could not be removed as a supertag from tag \"%s\", the first was not found, skipping", tag.name.c_str(), ttag.name.c_str());
+                    tag_t *tag = store.find_tag(supername);
+                    if (tag == nullptr) {
+                        WARN("tag: edit: tag \"%s\" could not be removed as a supertag from tag \"%s\", the first was not found, skipping", supername.c_str(), ttag.name.c_str());
                         continue;
                     }
-                    bool already_super = std::find(ttag.super.begin(), ttag.super.end(), tag.id) == ttag.super.end();
-                    bool already_sub = std::find(tag.sub.begin(), tag.sub.end(), ttag.id) == tag.sub.end();
-                    if (already_sub && already_super) {
-                        WARN("tag: edit: tag \"%s\" was not a supertag of tag \"%s\", skipping", tag.name.c_str(), ttag.name.c_str());
+                    if (!store.has_super(ttag, *tag)) {
+                        WARN("tag: edit: tag \"%s\" was not a supertag of tag \"%s\", skipping", tag->name.c_str(), ttag.name.c_str());
                         continue;
                     }
-                    if (!already_super) {
-                        std::erase(ttag.super, tag.id);
-                        changed = true;
-                    }
-                    if (!already_sub) {
-                        std::erase(tag.sub, ttag.id);
-                        changed = true;
-                    }
+                    store.remove_super(ttag, *tag);
 
                 } else if (!std::strcmp(argv[i], "-ab") || !std::strcmp(argv[i], "--add-sub")) {
                     if (i >= argc - 1) {
                         ERR_EXIT(1, "tag: edit: add sub flag expected argument <subname>");
                     }
                     std::string subname = argv[++i];
-                    bool found = false;
-                    tag_t &tag = tag_by_name(subname, found);
-                    if (!found) {
-                        WARN("tag: edit: tag \"%s\" could not be added as a subtag to tag \"%s\", the first was not found, skipping", tag.name.c_str(), ttag.name.c_str());
+                    tag_t *tag = store.find_tag(subname);
+                    if (tag == nullptr) {
+                        WARN("tag: edit: tag \"%s\" could not be added as a subtag to tag \"%s\", the first was not found, skipping", subname.c_str(), ttag.name.c_str());
                         continue;
                     }
-                    bool already_super = std::find(tag.super.begin(), tag.super.end(), ttag.id) != tag.super.end();
-                    bool already_sub = std::find(ttag.sub.begin(), ttag.sub.end(), tag.id) != ttag.sub.end();
-                    if (already_sub || already_super) {
-                        WARN("tag: edit: tag \"%s\" was already a subtag of tag \"%s\"", tag.name.c_str(), ttag.name.c_str());
-                    }
-                    if (!already_super) {
-                        tag.super.push_back(ttag.id);
-                        changed = true;
-                    }
-                    if (!already_sub) {
-                        ttag.sub.push_back(tag.id);
-                        changed = true;
+                    if (store.has_super(*tag, ttag)) {
+                        WARN("tag: edit: tag \"%s\" was already a subtag of tag \"%s\"", tag->name.c_str(), ttag.name.c_str());
                     }
+                    store.add_super(*tag, ttag);
 
                 } else if (!std::strcmp(argv[i], "-rb") || !std::strcmp(argv[i], "--remove-sub")) {
                     if (i >= argc - 1) {
                         ERR_EXIT(1, "tag: edit: remove sub flag expected argument <subname>");
                     }
                     std::string subname = argv[++i];
-                    bool found = false;
-                    tag_t &tag = tag_by_name(subname, found);
-                    if (!found) {
-                        WARN("tag: edit: tag \"%s\" could not be removed as a subtag from tag \"%s\", the first was not found, skipping", tag.name.c_str(), ttag.name.c_str());
+                    tag_t *tag = store.find_tag(subname);
+                    if (tag == nullptr) {
+                        WARN("tag: edit: tag \"%s\" could not be removed as a subtag from tag \"%s\", the first was not found, skipping", subname.c_str(), ttag.name.c_str());
                         continue;
                     }
-                    bool already_super = std::find(tag.super.begin(), tag.super.end(), ttag.id) == tag.super.end();
-                    bool already_sub = std::find(ttag.sub.begin(), ttag.sub.end(), tag.id) == ttag.sub.end();
-                    if (already_sub && already_super) {
-                        WARN("tag: edit: tag \"%s\" was not a subtag of tag \"%s\", skipping", tag.name.c_str(), ttag.name.c_str());
+                    if (!store.has_super(*tag, ttag)) {
+                        WARN("tag: edit: tag \"%s\" was not a subtag of tag \"%s\", skipping", tag->name.c_str(), ttag.name.c_str());
                         continue;
                     }
-                    if (!already_super) {
-                        std::erase(tag.super, ttag.id);
-                        changed = true;
-                    }
-                    if (!already_sub) {
-                        std::erase(ttag.sub, tag.id);
-                        changed = true;
-                    }
+                    store.remove_super(*tag, ttag);
 
                 } else if (!std::strcmp(argv[i], "-n") || !std::strcmp(argv[i], "--rename")) {
                     if (i >= argc - 1) {
                         ERR_EXIT(1, "tag: edit: rename flag expected argument <newname>");
                     }
                     std::string newname = argv[++i];
-                    if (tag_name_bad(newname)) {
-                        ERR_EXIT(1, "tag: edit: rename flag was passed bad tag name \"%s\"", argv[3]);
+                    if (!store.rename_tag(ttag, newname)) {
+                        ERR_EXIT(1, "tag: edit: rename flag was passed bad tag name \"%s\"", newname.c_str());
                     }
-                    ttag.name = newname;
-                    changed = true;
 
                 } else if (!std::strcmp(argv[i], "-c") || !std::strcmp(argv[i], "--color")) {
                     color_t color;
@@ -2632,40 +2460,53 @@ other:
                     if (hex_to_rgb(colorstr, color) != 3) {
                         ERR_EXIT(1, "tag: edit: color flag hex color \"%s\" was bad", colorstr.c_str());
                     }
-                    ttag.color = color;
-                    changed = true;
+                    store.set_color(ttag, color);
 
                 } else {
                     ERR_EXIT(1, "tag: edit: flag \"%s\" was not recognized", argv[i]);
                 }
 
             }
-            if (changed) {
-                dump_saved_tags();
-            }
         } else if (is_tag_add || is_tag_rm) {
             if (argc < 5) {
                 ERR_EXIT(1, "tag: %s: expected arguments <name> <flags>", subcommand.c_str());
             }
+            /* "a,b,c" applies every tag in one walk */
             std::string name = argv[3];
-            bool found = false;
-            tag_t &ttag = tag_by_name(name, found);
-            if (!found) {
-                if (is_tag_add) {
-                    ERR_EXIT(1, "tag: add: tag \"%s\" could not be added to file(s) and/or inode number(s), was not found", name.c_str());
-                } else {
-                    ERR_EXIT(1, "tag: rm: tag \"%s\" could not be removed from file(s) and/or inode number(s), was not found", name.c_str());
+            std::vector<std::string> tnames;
+            split_no_rep_delims(name, ",", tnames);
+            std::vector<tag_t *> ttags;
+            for (const std::string &tname : tnames) {
+                tag_t *pttag = store.find_tag(tname);
+                if (pttag == nullptr) {
+                    if (is_tag_add) {
+                        ERR_EXIT(1, "tag: add: tag \"%s\" could not be added to file(s) and/or inode number(s), was not found", tname.c_str());
+                    } else {
+                        ERR_EXIT(1, "tag: rm: tag \"%s\" could not be removed from file(s) and/or inode number(s), was not found", tname.c_str());
+                    }
+                }
+                if (store.virtual_tags.contains(pttag->id)) {
+                    ERR_EXIT(1, "tag: %s: tag \"%s\" is virtual, its files are whatever its search returns, see tag edit --remove-query", subcommand.c_str(), tname.c_str());
                 }
+                if (std::find(ttags.begin(), ttags.end(), pttag) == ttags.end()) {
+                    ttags.push_back(pttag);
+                }
+            }
+            if (ttags.empty()) {
+                ERR_EXIT(1, "tag: %s: expected at least one tag name", subcommand.c_str());
             }
             std::vector<change_rule_t> to_change;
+            /* resolved while walking, then (un)tagged with every tag at once */
+            std::vector<file_id_t> file_ids;
+            std::vector<change_rule_t> file_rules;
 
             bool search_index_first = true;
             change_entry_type_t change_entry_type = change_entry_type_t::only_files;
 
+            phase.emplace("parse_args");
             parse_file_args(argc - 4, argv + 4, "tag: " + subcommand, false, to_change, search_index_first, change_entry_type, true);
+            phase.emplace("apply");
 
-            bool changed_tags = false;
-            bool changed_index = false;
             for (std::int32_t ci = 0; ci < to_change.size(); ci++) { /* NOLINT */
                 change_rule_t change_rule = to_change[ci];
 
@@ -2674,75 +2515,63 @@ other:
                         if (!change_rule.from_ino) {
                             if (!std::filesystem::exists(change_rule.path)) {
                                 const std::string tpathstr = change_rule.path.string();
-                                ino_t maybe_ino = search_index(change_rule.path);
-                                if (maybe_ino != 0) {
+                                file_id_t maybe_ino = store.find_path(change_rule.path);
+                                if (maybe_ino) {
                                     if (tpathstr[0] == '"' && tpathstr[tpathstr.size() - 1] == '"') {
-                                        ERR_EXIT(1, "tag: add: file/directory \"%s\" could not be tagged with tag \"%s\", path does not exist, but exists in index file with inode number " INO_FORMAT ", you might want to run the update command, path is also possibly quoted, you might want to use --stdin-parse-as-args or -sa", ttag.name.c_str(), change_rule.path.c_str(), maybe_ino);
+                                        ERR_EXIT(1, "tag: add: file/directory \"%s\" could not be tagged with tag \"%s\", path does not exist, but exists in index file with inode number " INO_FORMAT ", you might want to run the update command, path is also possibly quoted, you might want to use --stdin-parse-as-args or -sa", name.c_str(), change_rule.path.c_str(), file_id_str(maybe_ino).c_str());
                                     }
-                                    ERR_EXIT(1, "tag: add: file/directory \"%s\" could not be tagged with tag \"%s\", path does not exist, but exists in index file with inode number " INO_FORMAT ", you might want to run the update command", change_rule.path.c_str(), ttag.name.c_str(), maybe_ino);
+                                    ERR_EXIT(1, "tag: add: file/directory \"%s\" could not be tagged with tag \"%s\", path does not exist, but exists in index file with inode number " INO_FORMAT ", you might want to run the update command", change_rule.path.c_str(), name.c_str(), file_id_str(maybe_ino).c_str());
                                 } else {
                                     if (tpathstr[0] == '"' && tpathstr[tpathstr.size() - 1] == '"') {
-                                        ERR_EXIT(1, "tag: add: file/directory \"%s\" could not be tagged with tag \"%s\", path does not exist, path is possibly quoted, you might want to use --stdin-parse-as-args or -sa", change_rule.path.c_str(), ttag.name.c_str());
+                                        ERR_EXIT(1, "tag: add: file/directory \"%s\" could not be tagged with tag \"%s\", path does not exist, path is possibly quoted, you might want to use --stdin-parse-as-args or -sa", change_rule.path.c_str(), name.c_str());
                                     }
-                                    ERR_EXIT(1, "tag: add: file/directory \"%s\" could not be tagged with tag \"%s\", path does not exist", change_rule.path.c_str(), ttag.name.c_str());
+                                    ERR_EXIT(1, "tag: add: file/directory \"%s\" could not be tagged with tag \"%s\", path does not exist", change_rule.path.c_str(), name.c_str());
                                 }
                             }
 
                             if (!std::filesystem::is_regular_file(change_rule.path) && !std::filesystem::is_directory(change_rule.path)) {
-                                ino_t maybe_ino = search_index(change_rule.path);
-                                if (maybe_ino != 0) {
-                                    WARN("tag: add: file/directory \"%s\" could not be tagged with tag \"%s\", path exists but was not a regular file or directory, but also exists in index file with inode number " INO_FORMAT ", you might want to run the update command", change_rule.path.c_str(), ttag.name.c_str(), maybe_ino);
+                                file_id_t maybe_ino = store.find_path(change_rule.path);
+                                if (maybe_ino) {
+                                    WARN("tag: add: file/directory \"%s\" could not be tagged with tag \"%s\", path exists but was not a regular file or directory, but also exists in index file with inode number " INO_FORMAT ", you might want to run the update command", change_rule.path.c_str(), name.c_str(), file_id_str(maybe_ino).c_str());
                                 } else {
-                                    WARN("tag: add: file/directory \"%s\" could not be tagged with tag \"%s\", path exists but was not a regular file or directory", change_rule.path.c_str(), ttag.name.c_str());
+                                    WARN("tag: add: file/directory \"%s\" could not be tagged with tag \"%s\", path exists but was not a regular file or directory", change_rule.path.c_str(), name.c_str());
                                 }
                                 continue;
                             }
                         }
 
-                        ino_t file_ino = change_rule.file_ino;
-                        if (file_ino == 0) {
-                            file_ino = path_get_ino(change_rule.path);
+                        file_id_t file_id = change_rule.file_id;
+                        if (!file_id) {
+                            file_id = path_get_id(change_rule.path);
                         }
-                        if (!map_contains(file_index, file_ino)) {
+                        if (store.find_id(file_id)) {
+                            file_id = store.find_id(file_id);
+                        } else {
                             if (!change_rule.from_ino) {
-                                WARN("tag: add: file/directory \"%s\" was not in index file, adding and tagging with tag \"%s\"", change_rule.path.c_str(), ttag.name.c_str());
+                                WARN("tag: add: file/directory \"%s\" was not in index file, adding and tagging with tag \"%s\"", change_rule.path.c_str(), name.c_str());
                             } else {
-                                WARN("tag: add: inode number " INO_FORMAT " was not in index file, adding with unresolved path and tagging with tag \"%s\", you might want to run the update command", change_rule.file_ino, ttag.name.c_str());
+                                WARN("tag: add: inode number " INO_FORMAT " was not in index file, adding with unresolved path and tagging with tag \"%s\", you might want to run the update command", file_id_str(change_rule.file_id).c_str(), name.c_str());
                             }
                             if (!file_exists(change_rule.path)) {
                                 ERR_EXIT(1, "tag: add: file/directory \"%s\" could not be added, does not exist", change_rule.path.c_str());
                             }
-                            file_index[file_ino] = file_info_t{file_ino, std::filesystem::canonical(change_rule.path)};
-                            changed_index = true;
-                        }
-                        file_info_t &file_info = file_index[file_ino];
-                        bool already_tagged = std::find(file_info.tags.begin(), file_info.tags.end(), ttag.id) != file_info.tags.end();
-                        bool already_revtagged = std::find(ttag.files.begin(), ttag.files.end(), file_ino) != ttag.files.end();
-                        if (already_tagged || already_revtagged) {
-                            if (!change_rule.from_ino) {
-                                WARN("tag: add: file/directory \"%s\" was already tagged with tag \"%s\"", change_rule.path.c_str(), ttag.name.c_str());
-                            } else {
-                                WARN("tag: add: inode number " INO_FORMAT " (path \"%s\") was already tagged with tag \"%s\"", change_rule.file_ino, change_rule.path.c_str(), ttag.name.c_str());
-                            }
-                        }
-                        if (!already_tagged) {
-                            file_index[file_ino].tags.push_back(ttag.id);
-                            changed_tags = true;
-                        }
-                        if (!already_revtagged) {
-                            ttag.files.push_back(file_ino);
-                            changed_tags = true;
+                            store.add_file(file_id, std::filesystem::canonical(change_rule.path));
                         }
+                        file_ids.push_back(file_id);
+                        file_rules.push_back(change_rule);
 
                     } else if (is_tag_rm) {
-                        ino_t file_ino = change_rule.file_ino;
-                        if (file_ino == 0 && search_index_first) {
-                            file_ino = search_index(change_rule.path);
+                        file_id_t file_id = store.find_id(change_rule.file_id);
+                        if (!file_id) {
+                            file_id = change_rule.file_id;
                         }
-                        if (file_ino == 0) {
-                            file_ino = search_use_fs(change_rule.path);
+                        if (!file_id && search_index_first) {
+                            file_id = store.find_path(change_rule.path);
                         }
-                        if (file_ino == 0) {
+                        if (!file_id) {
+                            file_id = store.find_on_disk(change_rule.path);
+                        }
+                        if (!file_id) {
                             std::string twarn_str = "tag rm: file/directory \"%s\" could not be untagged from tag \"%s\""; /* NOLINT */
                             if (search_index_first) {
                                 twarn_str += ", searched both by path in index file and by its inode number (from disk) and was not found";
@@ -2753,24 +2582,11 @@ other:
                             } else {
                                 twarn_str += ", searched by its inode number (from disk) and was not found";
                             }
-                            WARN(twarn_str.c_str(), change_rule.path.c_str(), ttag.name.c_str());
-                            continue;
-                        }
-                        file_info_t &file_info = file_index[file_ino];
-                        bool already_tagged = std::find(file_info.tags.begin(), file_info.tags.end(), ttag.id) != file_info.tags.end();
-                        bool already_revtagged = std::find(ttag.files.begin(), ttag.files.end(), file_ino) != ttag.files.end();
-                        if (!already_tagged && !already_revtagged) {
-                            WARN("tag: rm: file/directory \"%s\" could not be untagged from tag \"%s\", was not tagged with it", change_rule.path.c_str(), ttag.name.c_str());
+                            WARN(twarn_str.c_str(), change_rule.path.c_str(), name.c_str());
                             continue;
                         }
-                        if (already_tagged) {
-                            std::erase(file_info.tags, ttag.id);
-                            changed_tags = true;
-                        }
-                        if (already_revtagged) {
-                            std::erase(ttag.files, file_ino);
-                            changed_tags = true;
-                        }
+                        file_ids.push_back(file_id);
+                        file_rules.push_back(change_rule);
 
                     }
                 } else if (change_rule.type == change_rule_type_t::recursive) {
@@ -2787,27 +2603,122 @@ other:
                     }
 
                 } else if (change_rule.type == change_rule_type_t::inode_number) {
+                    file_id_t file_id = store.find_id(change_rule.file_id);
+                    if (!file_id) {
+                        file_id = change_rule.file_id;
+                    }
                     if (is_tag_rm) {
-                        if (!map_contains(file_index, change_rule.file_ino) && std::find(ttag.files.begin(), ttag.files.end(), change_rule.file_ino) == ttag.files.end()) {
-                            ERR_EXIT(1, "tag: %s: inode number " INO_FORMAT " could not be untagged from tag \"%s\", was not found in index file", subcommand.c_str(), change_rule.file_ino, ttag.name.c_str());
+                        if (!store.contains(file_id) && std::none_of(ttags.begin(), ttags.end(), [&](const tag_t *ttag) { return store.has_file(*ttag, file_id); })) {
+                            ERR_EXIT(1, "tag: %s: inode number " INO_FORMAT " could not be untagged from tag \"%s\", was not found in index file", subcommand.c_str(), file_id_str(change_rule.file_id).c_str(), name.c_str());
                         }
-                        to_change.insert(to_change.begin() + ci+1, change_rule_t{file_index[change_rule.file_ino].pathstr, change_rule_type_t::single_file, change_rule.file_ino, true});
+                        to_change.insert(to_change.begin() + ci+1, change_rule_t{store.file_index[file_id].pathstr, change_rule_type_t::single_file, file_id, true});
                     } else if (is_tag_add) {
-                        to_change.insert(to_change.begin() + ci+1, change_rule_t{file_index[change_rule.file_ino].pathstr, change_rule_type_t::single_file, change_rule.file_ino, true});
+                        to_change.insert(to_change.begin() + ci+1, change_rule_t{store.file_index[file_id].pathstr, change_rule_type_t::single_file, file_id, true});
                     }
                 }
             }
 
-            if (changed_tags) {
-                dump_saved_tags();
+            std::unordered_map<file_id_t, std::size_t> first_rule;
+            for (std::size_t fi = file_ids.size(); fi-- > 0;) {
+                first_rule[file_ids[fi]] = fi;
             }
-            if (changed_index) {
-                dump_file_index();
+            for (tag_t *ttag : ttags) {
+                std::vector<file_id_t> skipped;
+                if (is_tag_add) {
+                    store.tag_files(*ttag, file_ids, &skipped);
+                } else {
+                    store.untag_files(*ttag, file_ids, &skipped);
+                }
+                for (const file_id_t &file_id : skipped) {
+                    const change_rule_t &change_rule = file_rules[first_rule[file_id]];
+                    if (is_tag_rm) {
+                        WARN("tag: rm: file/directory \"%s\" could not be untagged from tag \"%s\", was not tagged with it", change_rule.path.c_str(), ttag->name.c_str());
+                    } else if (!change_rule.from_ino) {
+                        WARN("tag: add: file/directory \"%s\" was already tagged with tag \"%s\"", change_rule.path.c_str(), ttag->name.c_str());
+                    } else {
+                        WARN("tag: add: inode number " INO_FORMAT " (path \"%s\") was already tagged with tag \"%s\"", file_id_str(change_rule.file_id).c_str(), change_rule.path.c_str(), ttag->name.c_str());
+                    }
+                }
             }
 
         } else {
             ERR_EXIT(1, "tag: subcommand \"%s\" was not recognized", subcommand.c_str());
         }
+        phase.reset(); /* dumps time themselves */
+        if (!store.commit()) {
+            ERR_EXIT(1, "%s: %s", argv[1], store.error.c_str());
+        }
+    } else if (is_stats) {
+        bool co_occurrence = true;
+        std::uint64_t co_min = 1;
+        for (std::int32_t i = 2; i < argc; i++) {
+            const std::string targ = argv[i];
+            if (targ == "--no-co-occurrence") {
+                co_occurrence = false;
+            } else if (targ == "--co-min") {
+                if (i >= argc - 1) {
+                    ERR_EXIT(1, "stats: expected argument <n> after \"%s\"", targ.c_str());
+                }
+                char *end = nullptr;
+                co_min = std::strtoull(argv[++i], &end, 10);
+                if (*argv[i] == '\0' || *argv[i] == '-' || *end != '\0') {
+                    ERR_EXIT(1, "stats: argument %i number \"%s\" was not valid", i, argv[i]);
+                }
+            } else {
+                ERR_EXIT(1, "stats: flag \"%s\" was not recognized", argv[i]);
+            }
+        }
+
+        const store_stats_t stats = store.stats(co_occurrence);
+        phase.emplace("display");
+        /* one JSON object, tags in tags file order and pairs most shared first */
+        std::uint64_t unused_tags = 0;
+        for (const tag_stats_t &tstats : stats.tags) {
+            unused_tags += tstats.subtree_files == 0;
+        }
+        std::cout << "{\"files\": " << stats.files << ", \"untagged_files\": " << stats.untagged_files << ", \"tags\": " << stats.tags.size()
+            << ", \"unused_tags\": " << unused_tags << ", \"max_depth\": " << stats.max_depth << ",\n \"tag_stats\": [";
+        for (std::size_t ti = 0; ti < stats.tags.size(); ti++) {
+            const tag_stats_t &tstats = stats.tags[ti];
+            std::cout << (ti == 0 ? "\n  " : ",\n  ") << "{\"name\": " << json_str(store.tags.at(tstats.id).name) << ", \"files\": " << tstats.files
+                << ", \"subtree_files\": " << tstats.subtree_files << ", \"depth\": " << tstats.depth << '}';
+        }
+        std::cout << "],\n \"co_occurrence\": [";
+        bool first = true;
+        for (const auto &[a, b, n] : stats.co_occurrence) {
+            if (n < co_min) {
+                break;
+            }
+            std::cout << (first ? "\n  " : ",\n  ") << "{\"a\": " << json_str(store.tags.at(stats.tags[a].id).name) << ", \"b\": "
+                << json_str(store.tags.at(stats.tags[b].id).name) << ", \"files\": " << n << '}';
+            first = false;
+        }
+        std::cout << "]}\n";
+    } else if (is_export) {
+        std::optional<std::filesystem::path> symlink_tree;
+        for (std::int32_t i = 2; i < argc; i++) {
+            const std::string targ = argv[i];
+            if (targ == "--symlink-tree") {
+                if (i >= argc - 1) {
+                    ERR_EXIT(1, "export: expected argument <dir> after \"%s\"", targ.c_str());
+                }
+                symlink_tree = std::filesystem::absolute(argv[++i]);
+            } else {
+                ERR_EXIT(1, "export: flag \"%s\" was not recognized", argv[i]);
+            }
+        }
+        if (!symlink_tree) {
+            ERR_EXIT(1, "export: expected --symlink-tree <dir>");
+        }
+        export_stats_t stats;
+        if (!store.export_symlink_tree(symlink_tree.value(), stats)) {
+            ERR_EXIT(1, "export: %s", store.error.c_str());
+        }
+        if (stats.up_to_date) {
+            std::cout << "export: " << stats.links << " links, up to date\n";
+        } else {
+            std::cout << "export: " << stats.links << " links, " << stats.created << " created, " << stats.removed << " removed\n";
+        }
     } else {
         ERR_EXIT(1, "command \"%s\" was not recognized, see %s --HELP", argv[1], argv[0]);
     }
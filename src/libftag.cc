@@ -0,0 +1,3048 @@
+#include "libftag.hh"
+
+#include <algorithm>
+#include <bit>
+#include <fstream>
+#include <future>
+#include <numeric>
+#include <random>
+#include <regex>
+#include <set>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+
+/* --- profiling --- */
+
+profile_t profile; /* NOLINT */
+
+void profile_t::add_phase(const std::string &name, double seconds) {
+    std::lock_guard<std::mutex> lock(phases_mutex);
+    for (auto &[pname, pseconds] : phases) {
+        if (pname == name) {
+            pseconds += seconds;
+            return;
+        }
+    }
+    phases.emplace_back(name, seconds);
+}
+
+void profile_t::print() {
+    const std::chrono::duration<double> total = std::chrono::steady_clock::now() - start;
+    std::fprintf(stderr, "{\"command\": \"%s\", \"total_seconds\": %.6f, \"phases\": {", command.c_str(), total.count());
+    std::lock_guard<std::mutex> lock(phases_mutex);
+    for (std::size_t i = 0; i < phases.size(); i++) {
+        std::fprintf(stderr, "%s\"%s\": %.6f", i > 0 ? ", " : "", phases[i].first.c_str(), phases[i].second);
+    }
+    std::fprintf(stderr, "}, \"counters\": {\"files_scanned\": %lu, \"stat_calls\": %lu, \"regex_evals\": %lu, \"bytes_written\": %lu, \"allocations\": %lu}}\n",
+        static_cast<unsigned long>(files_scanned.load()), static_cast<unsigned long>(stat_calls.load()), static_cast<unsigned long>(regex_evals.load()),
+        static_cast<unsigned long>(bytes_written.load()), static_cast<unsigned long>(allocations.load()));
+}
+
+
+template <typename T>
+T get_random_int() {
+    static std::random_device device{};
+    static std::default_random_engine engine(device());
+    return std::uniform_int_distribution<T>()(engine);
+}
+
+std::uint32_t worker_count() {
+    static const std::uint32_t n = std::max(1U, std::thread::hardware_concurrency());
+    return n;
+}
+
+/* runs fn(i) for every i in [0, n) on its own thread, the calling thread takes i = 0 */
+template <typename F>
+void parallel_for(std::size_t n, const F &fn) {
+    std::vector<std::thread> threads;
+    threads.reserve(n > 0 ? n - 1 : 0);
+    for (std::size_t i = 1; i < n; i++) {
+        threads.emplace_back(fn, i);
+    }
+    if (n > 0) {
+        fn(0);
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+}
+
+/* files per worker below which testing them isn't worth starting a thread */
+constexpr std::size_t parallel_min_files = 16384;
+
+/* how many contiguous ranges of at least min_size parallel_ranges splits n items in, at most one per worker */
+std::size_t range_count(std::size_t n, std::size_t min_size) {
+    return std::max<std::size_t>(1, std::min<std::size_t>(worker_count(), n / min_size));
+}
+
+/* runs fn(part, begin, end) for each of the range_count(n, min_size) ranges of [0, n), in parallel */
+template <typename F>
+void parallel_ranges(std::size_t n, std::size_t min_size, const F &fn) {
+    const std::size_t parts = range_count(n, min_size);
+    const std::size_t size = (n + parts - 1) / parts;
+    parallel_for(parts, [&](std::size_t part) {
+        fn(part, std::min(n, part * size), std::min(n, (part + 1) * size));
+    });
+}
+
+bool file_exists(const char *filename, struct stat *pbuffer) {
+    profile.stat_calls++;
+    struct stat buffer{};
+    if (pbuffer == nullptr) {
+        pbuffer = &buffer;
+    }
+    return !stat(filename, pbuffer);
+}
+
+file_id_t path_get_id(const std::filesystem::path &path, file_meta_t *meta) {
+    profile.stat_calls++;
+    struct stat buffer{};
+    if (stat(path.c_str(), &buffer)) {
+        return {};
+    }
+    if (meta != nullptr) {
+        *meta = file_meta_of(buffer);
+    }
+    return file_id_of(buffer);
+}
+
+
+std::uint64_t file_fingerprint(const std::string &pathstr, std::uint64_t size) {
+    const int fd = open(pathstr.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return 0;
+    }
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> pieces; /* offset, length */
+    if (size <= 3 * fingerprint_sample) {
+        pieces.emplace_back(0, size);
+    } else {
+        pieces.emplace_back(0, fingerprint_sample);
+        pieces.emplace_back(size / 2 - fingerprint_sample / 2, fingerprint_sample);
+        pieces.emplace_back(size - fingerprint_sample, fingerprint_sample);
+    }
+    std::uint64_t hash = hash_bytes(&size, sizeof(size));
+    std::vector<char> buffer(std::min(size, 3 * fingerprint_sample));
+    for (const auto &[offset, length] : pieces) {
+        std::uint64_t got = 0;
+        while (got < length) {
+            const ssize_t n = pread(fd, buffer.data() + got, length - got, static_cast<off_t>(offset + got));
+            if (n <= 0) {
+                close(fd);
+                return 0; /* shrank or failed since the stat, whatever it hashes to would be wrong */
+            }
+            got += n;
+        }
+        hash = hash_bytes(buffer.data(), length, hash);
+    }
+    close(fd);
+    return hash == 0 ? 1 : hash; /* 0 is not taken */
+}
+
+std::vector<std::uint64_t> fingerprint_files(const std::vector<std::pair<std::string, std::uint64_t>> &files) {
+    profile_phase_t phase("fingerprint");
+    std::vector<std::uint64_t> ret(files.size(), 0);
+    std::atomic<std::size_t> next{0};
+    parallel_for(std::min<std::size_t>(worker_count(), files.size()), [&](std::size_t) {
+        for (std::size_t i = next++; i < files.size(); i = next++) {
+            ret[i] = file_fingerprint(files[i].first, files[i].second);
+        }
+    });
+    return ret;
+}
+
+/* minimum size of a piece of a loaded file worth handing to its own thread */
+constexpr std::size_t min_parse_chunk = static_cast<std::size_t>(1) << 20;
+
+/* splits content into at most worker_count() ranges, every range but the first starting at a position
+ * returned by next_start(pos), which gives the first record start at or after pos (or content.size()) */
+template <typename F>
+std::vector<std::pair<std::size_t, std::size_t>> chunk_content(const std::string &content, const F &next_start) {
+    std::size_t n = std::clamp<std::size_t>(content.size() / min_parse_chunk, 1, worker_count());
+    std::vector<std::pair<std::size_t, std::size_t>> chunks;
+    std::size_t begin = 0;
+    for (std::size_t i = 1; i < n && begin < content.size(); i++) {
+        std::size_t end = std::max(begin, next_start(content.size() / n * i));
+        if (end >= content.size()) { break; }
+        if (end == begin) { continue; }
+        chunks.emplace_back(begin, end);
+        begin = end;
+    }
+    chunks.emplace_back(begin, content.size());
+    return chunks;
+}
+
+
+/* a tag as parsed from the tags file, before ids are handed out and supertags are resolved */
+struct parsed_tag_t {
+    tag_t tag;
+    std::vector<std::string> super_names;
+    std::uint32_t line = 0;
+    std::optional<virtual_tag_t> virtual_tag;
+};
+
+/* the result of parsing one chunk of the tags file, line numbers are relative to the chunk start */
+struct tags_chunk_t {
+    std::vector<parsed_tag_t> parsed;
+    std::vector<std::pair<std::uint32_t, std::string>> warnings; /* line, message */
+    std::optional<std::pair<std::uint32_t, std::string>> error; /* line, message */
+    std::uint32_t lines = 0;
+};
+
+/* returns the start of the first tag declaring line at or after pos, i.e. the first line not blank and not a
+ * "-[file inode number]" or "= [search rule]" line */
+std::size_t next_tag_declaration(const std::string &content, std::size_t pos) {
+    if (pos != 0) {
+        pos = content.find('\n', pos - 1);
+        if (pos == std::string::npos) { return content.size(); }
+        pos++;
+    }
+    while (pos < content.size()) {
+        std::size_t first = content.find_first_not_of(" \t\r\v\f", pos);
+        if (first == std::string::npos) { return content.size(); }
+        if (content[first] != '\n' && content[first] != '-' && content[first] != '=') { return pos; }
+        pos = content.find('\n', first);
+        if (pos == std::string::npos) { return content.size(); }
+        pos++;
+    }
+    return content.size();
+}
+
+/* parses the tags file lines in [begin, end), touches no shared state */
+tags_chunk_t parse_tags_chunk(const std::string &content, std::size_t begin, std::size_t end) {
+    tags_chunk_t chunk;
+
+#define CHUNK_ERR(...) { \
+    chunk.error = {chunk.lines, format_str(__VA_ARGS__)}; \
+    return chunk; \
+}
+
+    std::string line;
+    std::string no_whitespace_line;
+    while (begin < end) {
+        std::size_t line_end = std::min(content.find('\n', begin), end);
+        line.assign(content, begin, line_end - begin);
+        begin = line_end + 1;
+        chunk.lines++;
+        no_whitespace_line = line;
+        remove_whitespace(no_whitespace_line);
+        if (no_whitespace_line.empty()) { continue; }
+
+        /* is a file inode number line */
+        if (no_whitespace_line[0] == '-') {
+            if (chunk.parsed.empty()) {
+                CHUNK_ERR("had \"-[file inode number]\" under no active tag");
+            }
+            file_id_t file_id;
+            if (!parse_file_id(no_whitespace_line.substr(1), file_id)) {
+                CHUNK_ERR("had bad file inode number: \"%s\"", no_whitespace_line.substr(1).c_str());
+            }
+            chunk.parsed.back().tag.files.push_back(file_id);
+            continue;
+        }
+
+        /* is a virtual tag's search rule line, "= [flag] [text]" with text taken as is */
+        if (no_whitespace_line[0] == '=') {
+            if (chunk.parsed.empty()) {
+                CHUNK_ERR("had \"= [search rule]\" under no active tag");
+            }
+            std::string rest = line.substr(line.find('=') + 1);
+            rest.erase(0, rest.find_first_not_of(" \t"));
+            const std::size_t space_pos = rest.find(' ');
+            const std::string flag = rest.substr(0, space_pos);
+            const std::string text = space_pos == std::string::npos ? std::string() : rest.substr(space_pos + 1);
+            virtual_tag_t &virtual_tag = chunk.parsed.back().virtual_tag ? chunk.parsed.back().virtual_tag.value() : chunk.parsed.back().virtual_tag.emplace();
+            if (flag == "--search-file-path") {
+                virtual_tag.search_file_path = true;
+                continue;
+            }
+            search_rule_t rule;
+            std::string error;
+            if (!parse_search_flag(flag, rule.type, rule.opt, error)) {
+                CHUNK_ERR("had search rule flag %s", error.c_str());
+            }
+            if (rule.type == search_rule_type_t::inode || rule.type == search_rule_type_t::inode_exclude) {
+                if (!parse_file_id(text, rule.inum)) {
+                    CHUNK_ERR("had bad search rule inode number: \"%s\"", text.c_str());
+                }
+            } else if (rule.type != search_rule_type_t::all_list && rule.type != search_rule_type_t::all_list_exclude) {
+                rule.text = text;
+            }
+            virtual_tag.rules.push_back(rule);
+            continue;
+        }
+
+        /* is a declaring tag line */
+        parsed_tag_t &current = chunk.parsed.emplace_back();
+        current.line = chunk.lines;
+        std::string ttag;
+        std::string tname;
+        std::string supertags;
+        std::size_t colon_pos = line.find(':');
+        bool has_colon = colon_pos != std::string::npos;
+
+        /* is still a declaring tag line, just without any supertags */
+        if (!has_colon) {
+            ttag = no_whitespace_line;
+        } else {
+            ttag = line.substr(0, colon_pos);
+            remove_whitespace(ttag);
+            supertags = line.substr(colon_pos + 1);
+        }
+        if (ttag.empty()) {
+            CHUNK_ERR("had empty tag name");
+        }
+        std::size_t sqbegin = ttag.find('[');
+        std::size_t sqend = ttag.find(']');
+        std::size_t pbegin = ttag.find('(');
+        std::size_t pend = ttag.find(')');
+        bool has_states = false;
+        bool has_color = false;
+
+        if (sqend != std::string::npos && sqbegin != std::string::npos) {
+            if (sqbegin >= sqend) {
+                CHUNK_ERR("state list had ']' before '['");
+            }
+            has_states = true;
+            std::string statesstr = ttag.substr(sqbegin + 1, sqend - sqbegin - 1);
+            std::vector<std::string> states;
+            split(statesstr, ",", states);
+            for (const std::string &state : states) {
+                if (state == "e") {
+                    current.tag.enabled = true;
+                } else if (state == "d") {
+                    current.tag.enabled = false;
+                }
+            }
+        }
+        if (pend != std::string::npos && pbegin != std::string::npos) {
+            current.tag.color = color_t();
+            if (pbegin >= pend) {
+                CHUNK_ERR("color had ')' before '('");
+            }
+            has_color = true;
+            std::string hexstr = ttag.substr(pbegin + 1, pend - pbegin - 1);
+            if (hexstr[0] == '#') { hexstr.erase(hexstr.begin()); }
+            if (hex_to_rgb(hexstr, current.tag.color.value()) != 3) {
+                CHUNK_ERR("had bad hex color: \"%s\"", hexstr.c_str());
+            }
+        }
+
+        if (has_color || has_states) {
+            tname = ttag.substr(0, std::min(pbegin, sqbegin));
+        } else {
+            tname = ttag;
+        }
+
+        if (tname.empty()) {
+            CHUNK_ERR("had empty tag name");
+        }
+        /* check if tname is good */
+        if (tag_name_bad(tname)) {
+            CHUNK_ERR("had bad tag name: \"%s\"", tname.c_str());
+        }
+        current.tag.name = tname;
+
+        /* no supertags */
+        if (!has_colon) { continue; }
+
+        trim_whitespace(supertags);
+        if (supertags.empty()) {
+            chunk.warnings.emplace_back(chunk.lines, format_str("tag name \"%s\" had empty supertags, expected supertags due to ':'", tname.c_str()));
+            continue;
+        }
+        split_no_rep_delims(supertags, " ", current.super_names);
+    }
+
+#undef CHUNK_ERR
+
+    return chunk;
+}
+
+/* reads and splits the tags file at tag declarations, parsing every chunk on its own thread.
+ * does not touch the store, so it may run alongside read_index_shard */
+std::vector<tags_chunk_t> parse_saved_tags(const std::string &tags_file) {
+    profile_phase_t phase("parse_tags");
+    const std::string content = get_file_content(tags_file);
+    const auto ranges = chunk_content(content, [&content](std::size_t pos) { return next_tag_declaration(content, pos); });
+    std::vector<tags_chunk_t> chunks(ranges.size());
+    parallel_for(ranges.size(), [&](std::size_t i) {
+        chunks[i] = parse_tags_chunk(content, ranges[i].first, ranges[i].second);
+    });
+    return chunks;
+}
+
+/* *** RUN read_index_shard BEFORE THIS ***
+ * in order to correctly/efficiently add to file_info_t::tags
+ *
+ * takes the chunks from parse_saved_tags, gives out ids, resolves supertags and links files to their tags
+ *
+ * [] denote the state list, right now only possible members are 'd' for disabled and 'e' for enabled (default, so specifying 'e' is redundant)
+ *
+ * --- tag file structure ---
+ *
+ * tag-name: super-tag other-super-tag
+ * -[device]:[file inode number]
+ * -[file inode number]
+ * other-tag-name (FF0000): blah-super-tag super-tag
+ * blah-tag-name (#FF7F7F)
+ * disabled-tag-name [d] (#FF7F7F): enabled-tag-name
+ * enabled-tag-name
+ * also-enabled-tag-name [e]
+ *
+ * a file without "[device]:" has dev 0, see file_id_t
+ */
+bool read_saved_tags(store_t &store, std::vector<tags_chunk_t> chunks) {
+    profile_phase_t phase("link_tags");
+    const char *tags_file = store.tags_file.c_str();
+    std::vector<parsed_tag_t> parsed;
+    std::uint32_t line_offset = 0;
+    for (tags_chunk_t &chunk : chunks) {
+        for (const auto &[line, message] : chunk.warnings) {
+            store.warn(format_str("tag file \"%s\" line %u %s", tags_file, line_offset + line, message.c_str()));
+        }
+        if (chunk.error.has_value()) {
+            store.error = format_str("tag file \"%s\" line %u %s", tags_file, line_offset + chunk.error.value().first, chunk.error.value().second.c_str());
+            return false;
+        }
+        for (parsed_tag_t &ptag : chunk.parsed) {
+            ptag.line += line_offset;
+            parsed.push_back(std::move(ptag));
+        }
+        line_offset += chunk.lines;
+    }
+
+    std::unordered_map<std::string, std::size_t> name_to_pos; /* name, position in parsed */
+    std::unordered_map<tid_t, bool> used_ids;
+    name_to_pos.reserve(parsed.size());
+    used_ids.reserve(parsed.size());
+    for (std::size_t i = 0; i < parsed.size(); i++) {
+        tag_t &tag = parsed[i].tag;
+        if (!name_to_pos.emplace(tag.name, i).second) {
+            store.error = format_str("tag file \"%s\" line %u redefined tag \"%s\"", tags_file, parsed[i].line, tag.name.c_str());
+            return false;
+        }
+        do {
+            tag.id = get_random_int<tid_t>();
+        } while (tag.id == 0 || map_contains(used_ids, tag.id));
+        used_ids[tag.id] = true;
+    }
+
+    /* resolve supertags, those declared before come first, then those declared after (including itself) */
+    std::vector<std::optional<std::size_t>> unresolved(parsed.size()); /* position in super_names */
+    std::vector<std::vector<std::size_t>> super_pos(parsed.size());
+    parallel_for(worker_count(), [&](std::size_t t) {
+        for (std::size_t i = t; i < parsed.size(); i += worker_count()) {
+            std::vector<std::size_t> after;
+            for (std::size_t si = 0; si < parsed[i].super_names.size(); si++) {
+                auto it = name_to_pos.find(parsed[i].super_names[si]);
+                if (it == name_to_pos.end()) {
+                    unresolved[i] = si;
+                    break;
+                }
+                (it->second < i ? super_pos[i] : after).push_back(it->second);
+            }
+            super_pos[i].insert(super_pos[i].end(), after.begin(), after.end());
+        }
+    });
+    for (std::size_t i = 0; i < parsed.size(); i++) {
+        if (unresolved[i].has_value()) {
+            store.error = format_str("tag file \"%s\" tag \"%s\" referenced unresolved supertag \"%s\" which was never declared after", tags_file, parsed[i].tag.name.c_str(), parsed[i].super_names[unresolved[i].value()].c_str());
+            return false;
+        }
+        for (const std::size_t &si : super_pos[i]) {
+            parsed[i].tag.super.push_back(parsed[si].tag.id);
+        }
+    }
+    /* subtags declared after their supertag come first, like the supertags above */
+    for (bool after : {false, true}) {
+        for (std::size_t i = 0; i < parsed.size(); i++) {
+            for (const std::size_t &si : super_pos[i]) {
+                if ((si >= i) == after) {
+                    parsed[si].tag.sub.push_back(parsed[i].tag.id);
+                }
+            }
+        }
+    }
+
+    store.parsed_order.reserve(store.parsed_order.size() + parsed.size());
+    for (parsed_tag_t &ptag : parsed) {
+        ptag.tag.ordinal = store.parsed_order.size();
+        store.tag_ordinals.emplace(ptag.tag.id, ptag.tag.ordinal);
+        store.parsed_order.push_back(ptag.tag.id);
+    }
+    std::vector<const tag_t *> loaded;
+    loaded.reserve(parsed.size());
+    for (parsed_tag_t &ptag : parsed) {
+        const tid_t id = ptag.tag.id;
+        loaded.push_back(&(store.tags[id] = std::move(ptag.tag)));
+        if (ptag.virtual_tag) {
+            store.virtual_tags.emplace(id, std::move(ptag.virtual_tag.value()));
+        }
+    }
+
+    /* link files to their tags, every thread owns the files whose inode numbers fall in its residue class so each
+     * file_info_t::tags keeps the order of the tags file. the references are sorted into those classes once, in that
+     * order, so no thread walks the ones of the others. a class's tag lists are allocated from its link resource */
+    const auto link = [&store](const file_id_t &file_id, tid_t id) {
+        auto it = store.file_index.find(file_id);
+        if (it != store.file_index.end()) {
+            it->second.tags.push_back(id);
+        }
+    };
+    const std::size_t workers = store.link_resources.size();
+    if (workers <= 1) {
+        for (const tag_t *tag : loaded) {
+            for (const file_id_t &file_id : tag->files) { link(file_id, tag->id); }
+        }
+        return true;
+    }
+    std::vector<std::vector<std::pair<const file_id_t *, tid_t>>> buckets(workers);
+    for (const tag_t *tag : loaded) {
+        for (const file_id_t &file_id : tag->files) {
+            buckets[file_id.ino % workers].emplace_back(&file_id, tag->id);
+        }
+    }
+    parallel_for(workers, [&](std::size_t t) {
+        for (const auto &[file_id, id] : buckets[t]) { link(*file_id, id); }
+    });
+    return true;
+}
+
+std::size_t file_index_t::key_lower_bound(const file_id_t &file_id) const {
+    std::size_t k = 1;
+    while (k < layout.size()) {
+        k = 2 * k + static_cast<std::size_t>(layout[k] < file_id);
+    }
+    /* the search went left at the answer and only right after, so drop those rights and that left */
+    k >>= std::countr_one(k) + 1;
+    return k == 0 ? keys.size() : layout_pos[k];
+}
+
+std::size_t file_index_t::key_find(const file_id_t &file_id) const {
+    const std::size_t pos = key_lower_bound(file_id);
+    return pos < keys.size() && keys[pos] == file_id && dead[pos] == 0 ? pos : keys.size();
+}
+
+file_index_t::iterator file_index_t::find(const file_id_t &file_id) {
+    const std::size_t pos = key_find(file_id);
+    if (pos != keys.size()) {
+        return {this, pos, pending.upper_bound(file_id)};
+    }
+    auto pit = pending.find(file_id);
+    return pit == pending.end() ? end() : iterator{this, next_live(key_lower_bound(file_id)), pit};
+}
+
+file_index_t::const_iterator file_index_t::find(const file_id_t &file_id) const {
+    return const_cast<file_index_t *>(this)->find(file_id); /* NOLINT */
+}
+
+file_index_t::iterator file_index_t::lower_bound(const file_id_t &file_id) {
+    return {this, next_live(key_lower_bound(file_id)), pending.lower_bound(file_id)};
+}
+
+file_index_t::const_iterator file_index_t::lower_bound(const file_id_t &file_id) const {
+    return const_cast<file_index_t *>(this)->lower_bound(file_id); /* NOLINT */
+}
+
+file_index_t::iterator file_index_t::upper_bound(const file_id_t &file_id) {
+    std::size_t pos = key_lower_bound(file_id);
+    if (pos < keys.size() && keys[pos] == file_id) {
+        pos++;
+    }
+    return {this, next_live(pos), pending.upper_bound(file_id)};
+}
+
+file_index_t::const_iterator file_index_t::upper_bound(const file_id_t &file_id) const {
+    return const_cast<file_index_t *>(this)->upper_bound(file_id); /* NOLINT */
+}
+
+file_info_t &file_index_t::at(const file_id_t &file_id) {
+    auto it = find(file_id);
+    if (it == end()) {
+        throw std::out_of_range("file_index_t::at");
+    }
+    return it->second;
+}
+
+const file_info_t &file_index_t::at(const file_id_t &file_id) const {
+    return const_cast<file_index_t *>(this)->at(file_id); /* NOLINT */
+}
+
+file_info_t &file_index_t::operator[](const file_id_t &file_id) {
+    const std::size_t pos = key_find(file_id);
+    return pos != keys.size() ? infos[pos] : pending[file_id];
+}
+
+void file_index_t::erase(const_iterator it) {
+    if (it.in_arrays()) {
+        dead[it.pos] = 1;
+        erased++;
+    } else {
+        pending.erase(it.pending);
+    }
+}
+
+void file_index_t::erase(const_iterator first, const_iterator last) {
+    while (first != last) {
+        const_iterator next = first;
+        ++next;
+        erase(first);
+        first = next;
+    }
+}
+
+void file_index_t::clear() {
+    rebuild({}, {});
+    pending.clear();
+}
+
+void file_index_t::insert(std::vector<file_info_t> files) {
+    const auto by_id = [](const file_info_t &a, const file_info_t &b) { return a.file_id < b.file_id; };
+    if (!std::is_sorted(files.begin(), files.end(), by_id)) {
+        std::stable_sort(files.begin(), files.end(), by_id);
+    }
+    merge();
+    if (keys.empty()) { /* the first shard loaded, files becomes the arrays as they are */
+        std::size_t kept = 0;
+        for (std::size_t i = 0; i < files.size(); i++) {
+            if (i + 1 < files.size() && files[i + 1].file_id == files[i].file_id) { continue; }
+            if (kept != i) {
+                files[kept] = std::move(files[i]);
+            }
+            kept++;
+        }
+        files.resize(kept);
+        std::vector<file_id_t> new_keys(kept);
+        for (std::size_t i = 0; i < kept; i++) {
+            new_keys[i] = files[i].file_id;
+        }
+        rebuild(std::move(new_keys), std::move(files));
+        return;
+    }
+    std::vector<file_id_t> new_keys;
+    std::vector<file_info_t> new_infos;
+    new_keys.reserve(keys.size() + files.size());
+    new_infos.reserve(keys.size() + files.size());
+    std::size_t pos = 0;
+    for (std::size_t i = 0; i < files.size(); i++) {
+        if (i + 1 < files.size() && files[i + 1].file_id == files[i].file_id) { continue; } /* a later record replaces it */
+        for (; pos < keys.size() && keys[pos] < files[i].file_id; pos++) {
+            new_keys.push_back(keys[pos]);
+            new_infos.push_back(std::move(infos[pos]));
+        }
+        if (pos < keys.size() && keys[pos] == files[i].file_id) {
+            pos++;
+        }
+        new_keys.push_back(files[i].file_id);
+        new_infos.push_back(std::move(files[i]));
+    }
+    for (; pos < keys.size(); pos++) {
+        new_keys.push_back(keys[pos]);
+        new_infos.push_back(std::move(infos[pos]));
+    }
+    rebuild(std::move(new_keys), std::move(new_infos));
+}
+
+void file_index_t::merge() {
+    if (pending.empty() && erased == 0) { return; }
+    std::vector<file_id_t> new_keys;
+    std::vector<file_info_t> new_infos;
+    new_keys.reserve(size());
+    new_infos.reserve(size());
+    auto pit = pending.begin();
+    for (std::size_t pos = next_live(0); pos < keys.size(); pos = next_live(pos + 1)) {
+        for (; pit != pending.end() && pit->first < keys[pos]; ++pit) {
+            new_keys.push_back(pit->first);
+            new_infos.push_back(std::move(pit->second));
+        }
+        new_keys.push_back(keys[pos]);
+        new_infos.push_back(std::move(infos[pos]));
+    }
+    for (; pit != pending.end(); ++pit) {
+        new_keys.push_back(pit->first);
+        new_infos.push_back(std::move(pit->second));
+    }
+    pending.clear();
+    rebuild(std::move(new_keys), std::move(new_infos));
+}
+
+/* an in order walk of the implicit tree visits its slots in key order */
+static void fill_layout(const std::vector<file_id_t> &keys, std::vector<file_id_t> &layout, std::vector<std::uint32_t> &layout_pos, std::size_t &pos, std::size_t k) {
+    if (k >= layout.size()) { return; }
+    fill_layout(keys, layout, layout_pos, pos, 2 * k);
+    layout[k] = keys[pos];
+    layout_pos[k] = pos++;
+    fill_layout(keys, layout, layout_pos, pos, 2 * k + 1);
+}
+
+void file_index_t::rebuild(std::vector<file_id_t> new_keys, std::vector<file_info_t> new_infos) {
+    keys = std::move(new_keys);
+    infos = std::move(new_infos);
+    dead.assign(keys.size(), 0);
+    erased = 0;
+    layout.assign(keys.size() + 1, file_id_t{});
+    layout_pos.assign(keys.size() + 1, 0);
+    std::size_t pos = 0;
+    fill_layout(keys, layout, layout_pos, pos, 1);
+}
+
+/* the result of parsing one chunk of the index file, record numbers are relative to the chunk start */
+struct index_chunk_t {
+    std::vector<file_info_t> files;
+    std::vector<file_id_t> empty_paths;
+    std::optional<std::pair<std::uint32_t, std::string>> error; /* record, message */
+    std::uint32_t records = 0;
+};
+
+const std::string_view index_delim{"\0\n", 2};
+
+/* "[size];[mtime];[type];[mode][;fingerprint]" of an index record, mode in octal and fingerprint in hex */
+std::optional<file_meta_t> parse_index_meta(std::string_view fields) {
+    const std::string owned(fields); /* the strto* need a terminator */
+    const char *pos = owned.c_str();
+    char *end = nullptr;
+    file_meta_t meta;
+    meta.size = std::strtoull(pos, &end, 10);
+    if (end == pos || *end != ';') { return std::nullopt; }
+    pos = end + 1;
+    meta.mtime = std::strtoll(pos, &end, 10);
+    if (end == pos || *end != ';') { return std::nullopt; }
+    pos = end + 1;
+    if ((*pos != 'f' && *pos != 'd' && *pos != 'o') || pos[1] != ';') { return std::nullopt; }
+    meta.type = *pos;
+    pos += 2;
+    meta.mode = std::strtoul(pos, &end, 8);
+    if (end == pos || (*end != '\0' && *end != ';')) { return std::nullopt; }
+    if (*end == ';') {
+        pos = end + 1;
+        meta.fingerprint = std::strtoull(pos, &end, 16);
+        if (end == pos || *end != '\0') { return std::nullopt; }
+    }
+    return meta;
+}
+
+/* parses the index file records in [begin, end), of a shard of device dev. paths are allocated from paths and tag
+ * lists will be from links[ino % links.size()] */
+index_chunk_t parse_index_chunk(const std::string &content, std::size_t begin, std::size_t end, dev_t dev, std::pmr::memory_resource *paths, std::span<std::pmr::memory_resource *const> links) {
+    index_chunk_t chunk;
+    while (begin < end) {
+        std::size_t record_end = std::min(content.find(index_delim, begin), end);
+        const std::string_view record(content.data() + begin, record_end - begin);
+        begin = record_end + index_delim.size();
+        if (record.empty()) { continue; }
+        std::size_t colon_pos = record.find(':');
+        if (colon_pos == std::string::npos) {
+            chunk.error = {chunk.records, "had no ':', could not parse"};
+            return chunk;
+        }
+        /* strtoul stops at the colon, or at the semicolon before the metadata */
+        char *pos = nullptr;
+        const file_id_t file_id{dev, static_cast<ino_t>(std::strtoul(record.data(), &pos, 0))};
+        if (!file_id) {
+            chunk.error = {chunk.records, format_str("had bad file inode number \"%s\"", std::string(record.substr(0, colon_pos)).c_str())};
+            return chunk;
+        }
+        std::optional<file_meta_t> meta;
+        if (*pos == ';') {
+            meta = parse_index_meta(record.substr(pos + 1 - record.data(), colon_pos - (pos + 1 - record.data())));
+            if (!meta) {
+                chunk.error = {chunk.records, format_str("had bad file metadata \"%s\"", std::string(record.substr(0, colon_pos)).c_str())};
+                return chunk;
+            }
+        }
+        chunk.records++;
+        /* ***
+         * weakly_canonical does file exists checks... performance killer!
+         * *** */
+        file_info_t &file_info = chunk.files.emplace_back(file_info_t{file_id, std::pmr::string(record.substr(colon_pos + 1), paths), std::pmr::vector<tid_t>(links[file_id.ino % links.size()]), meta});
+        if (file_info.pathstr.empty()) {
+            chunk.empty_paths.push_back(file_id);
+        }
+    }
+    return chunk;
+}
+
+/* --- index file structure ---
+ *
+ * [file inode number]:[full path]\0
+ * [file inode number];[size];[mtime in ns];[f|d|o];[octal mode]:[full path]\0
+ * [file inode number];[size];[mtime in ns];[f|d|o];[octal mode];[hex fingerprint]:[full path]\0
+ *
+ * the metadata is there for files added or updated since it was kept, the fingerprint only for files added or
+ * updated with --fingerprint. the same for every shard, the device is in the
+ * shard's file name
+ */
+bool read_index_shard(store_t &store, dev_t dev) {
+    profile_phase_t phase("load_index");
+    const std::string shard_file = store.shard_file(dev);
+    const std::string content = get_file_content(shard_file);
+    const auto ranges = chunk_content(content, [&content](std::size_t pos) {
+        pos = content.find(index_delim, pos);
+        return pos == std::string::npos ? content.size() : pos + index_delim.size();
+    });
+    if (store.link_resources.empty()) {
+        for (std::uint32_t i = 0; i < worker_count(); i++) {
+            store.link_resources.push_back(&store.load_resources.emplace_back());
+        }
+    }
+    std::vector<std::pmr::memory_resource *> paths;
+    for (std::size_t i = 0; i < ranges.size(); i++) {
+        paths.push_back(&store.load_resources.emplace_back());
+    }
+    std::vector<index_chunk_t> chunks(ranges.size());
+    parallel_for(ranges.size(), [&](std::size_t i) {
+        chunks[i] = parse_index_chunk(content, ranges[i].first, ranges[i].second, dev, paths[i], store.link_resources);
+    });
+
+    std::uint32_t record_offset = 0;
+    std::vector<file_info_t> files;
+    for (index_chunk_t &chunk : chunks) {
+        if (chunk.error.has_value()) {
+            store.error = format_str("index file \"%s\" line %u %s", shard_file.c_str(), record_offset + chunk.error.value().first, chunk.error.value().second.c_str());
+            return false;
+        }
+        for (const file_id_t &file_id : chunk.empty_paths) {
+            store.warn(format_str("index file \"%s\" had file inode number %s with empty file path, you might want to run the update command", shard_file.c_str(), file_id_str(file_id).c_str()));
+        }
+        for (file_info_t &file_info : chunk.files) {
+            file_info.ordinal = store.file_ordinals++;
+        }
+        if (files.empty()) {
+            files = std::move(chunk.files);
+        } else {
+            std::move(chunk.files.begin(), chunk.files.end(), std::back_inserter(files));
+        }
+        record_offset += chunk.records;
+    }
+    store.file_index.insert(std::move(files));
+    return true;
+}
+
+
+store_t::~store_t() {
+    unlock();
+    if (lock_fd != -1) {
+        close(lock_fd);
+    }
+}
+
+bool store_t::open(const std::string &tags_file, const std::string &index_file, bool exclusive) {
+    this->tags_file = tags_file;
+    this->index_file = index_file;
+    if (exclusive && !lock(lock_type_t::exclusive)) { return false; }
+    return load();
+}
+
+static std::uint64_t read_generation(int lock_fd) {
+    char buffer[32] = {};
+    if (lock_fd == -1 || pread(lock_fd, buffer, sizeof(buffer) - 1, 0) <= 0) { return 0; }
+    return std::strtoull(buffer, nullptr, 10);
+}
+
+/* takes a lock for as long as it lives unless one at least as strong is held, then puts back the one held */
+struct scoped_lock_t {
+    store_t &store;
+    lock_type_t held;
+    bool ok = true;
+
+    scoped_lock_t(store_t &store, lock_type_t type) : store(store), held(store.held_lock) {
+        if (held < type) {
+            ok = store.lock(type);
+        }
+    }
+    scoped_lock_t(const scoped_lock_t &) = delete;
+    scoped_lock_t &operator=(const scoped_lock_t &) = delete;
+
+    ~scoped_lock_t() {
+        if (store.held_lock != held) {
+            held == lock_type_t::none ? store.unlock() : static_cast<void>(store.lock(held));
+        }
+    }
+};
+
+static bool load_store(store_t &store) {
+    store.tags.clear();
+    store.file_index.clear();
+    store.link_resources.clear();
+    store.load_resources.clear();
+    store.parsed_order.clear();
+    store.tag_ordinals.clear();
+    store.file_ordinals = 0;
+    store.virtual_tags.clear();
+    store.virtual_dirty.clear();
+    store.tags_changed = false;
+    store.shards_changed.clear();
+    store.generation = read_generation(store.lock_fd);
+    /* the tags file only needs the index once files are linked to their tags, so parse it meanwhile */
+    std::future<std::vector<tags_chunk_t>> tags_parse = std::async(std::launch::async, parse_saved_tags, store.tags_file);
+    std::vector<dev_t> devs = store.device.has_value() ? std::vector<dev_t>{store.device.value()} : store.shard_devices();
+    devs.insert(devs.begin(), 0);
+    for (const dev_t &dev : std::set<dev_t>(devs.begin(), devs.end())) {
+        if (!read_index_shard(store, dev)) { return false; }
+    }
+    return read_saved_tags(store, tags_parse.get());
+}
+
+bool store_t::load() {
+    scoped_lock_t lock(*this, lock_type_t::shared);
+    return lock.ok && load_store(*this);
+}
+
+bool store_t::load_shard(dev_t dev) {
+    scoped_lock_t lock(*this, lock_type_t::shared);
+    if (!lock.ok) { return false; }
+    auto [begin, end] = shard(dev);
+    file_index.erase(begin, end);
+    if (!read_index_shard(*this, dev)) { return false; }
+    shards_changed.erase(dev);
+    for (const tid_t &id : parsed_order) {
+        for (const file_id_t &file_id : tags.at(id).files) {
+            if (file_id.dev != dev) { continue; }
+            auto it = file_index.find(file_id);
+            if (it != file_index.end()) {
+                it->second.tags.push_back(id);
+            }
+        }
+    }
+    return true;
+}
+
+bool store_t::commit() {
+    refresh_virtual();
+    if (!tags_changed && shards_changed.empty()) {
+        return true;
+    }
+    scoped_lock_t lock(*this, lock_type_t::exclusive);
+    if (!lock.ok) { return false; }
+    const std::uint64_t on_disk = read_generation(lock_fd);
+    if (on_disk != generation) {
+        error = format_str("could not write, \"%s\" was changed by another process since it was loaded (generation %lu, now %lu)", index_file.c_str(), static_cast<unsigned long>(generation), static_cast<unsigned long>(on_disk));
+        return false;
+    }
+    if (tags_changed && !dump_tags()) { return false; }
+    for (const dev_t &dev : std::set<dev_t>(shards_changed)) {
+        if (!dump_shard(dev)) { return false; }
+    }
+    file_index.merge();
+    const std::string generation_str = std::to_string(++generation) + '\n';
+    if (lock_fd == -1 || pwrite(lock_fd, generation_str.data(), generation_str.size(), 0) != static_cast<ssize_t>(generation_str.size()) || ftruncate(lock_fd, static_cast<off_t>(generation_str.size())) != 0) {
+        warn(format_str("could not write the generation to \"%s.lock\", other processes won't see this commit", index_file.c_str()));
+    }
+    return true;
+}
+
+bool store_t::lock(lock_type_t type) {
+    if (type == lock_type_t::none) {
+        unlock();
+        return true;
+    }
+    const std::string lock_file = index_file + ".lock";
+    if (lock_fd == -1) {
+        lock_fd = ::open(lock_file.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644); /* NOLINT */
+    }
+    if (lock_fd == -1) {
+        lock_fd = ::open(lock_file.c_str(), O_RDONLY | O_CLOEXEC); /* NOLINT */
+    }
+    if (lock_fd == -1) {
+        if (type == lock_type_t::exclusive) {
+            error = format_str("could not open lock file \"%s\", %s", lock_file.c_str(), std::strerror(errno));
+            return false;
+        }
+        held_lock = type; /* nothing to coordinate with, no other process can write either */
+        return true;
+    }
+    profile_phase_t phase("lock_wait");
+    int ret = 0;
+    while ((ret = flock(lock_fd, type == lock_type_t::exclusive ? LOCK_EX : LOCK_SH)) == -1 && errno == EINTR) {}
+    if (ret == -1) {
+        error = format_str("could not lock \"%s\", %s", lock_file.c_str(), std::strerror(errno));
+        return false;
+    }
+    held_lock = type;
+    return true;
+}
+
+void store_t::unlock() {
+    if (held_lock != lock_type_t::none && lock_fd != -1) {
+        flock(lock_fd, LOCK_UN);
+    }
+    held_lock = lock_type_t::none;
+}
+
+std::string store_t::shard_file(dev_t dev) const {
+    if (dev == 0) {
+        return index_file;
+    }
+    return index_file + '.' + std::to_string(dev);
+}
+
+std::vector<dev_t> store_t::shard_devices() const {
+    std::vector<dev_t> ret;
+    const std::filesystem::path index_path(index_file);
+    const std::string prefix = index_path.filename().string() + '.';
+    const std::filesystem::path dir = index_path.has_parent_path() ? index_path.parent_path() : std::filesystem::path(".");
+    std::error_code ec;
+    for (const auto &entry : std::filesystem::directory_iterator(dir, ec)) {
+        const std::string name = entry.path().filename().string();
+        if (name.size() <= prefix.size() || name.compare(0, prefix.size(), prefix) != 0) { continue; }
+        if (name.find_first_not_of("0123456789", prefix.size()) != std::string::npos) { continue; }
+        const dev_t dev = std::strtoull(name.c_str() + prefix.size(), nullptr, 10);
+        if (dev != 0) {
+            ret.push_back(dev);
+        }
+    }
+    std::sort(ret.begin(), ret.end());
+    return ret;
+}
+
+/* --- tag names cache structure ---
+ *
+ * [tags file size];[tags file mtime in ns]\n
+ * then every tag name, sorted, each followed by a \n
+ */
+static std::string tag_names_stamp(const std::string &tags_file) {
+    struct stat buffer{};
+    if (!file_exists(tags_file, &buffer)) { return {}; }
+    return format_str("%lu;%ld\n", static_cast<unsigned long>(buffer.st_size), static_cast<long>(file_meta_of(buffer).mtime));
+}
+
+/* writes filename aside in its directory with write and renames that over it, so a reader without the lock (an
+ * older ftag, an editor, completion) sees the old file or the new one and a crash leaves the old one. a symlink is
+ * followed and the file keeps its permissions. false if it couldn't be written, filename is then untouched */
+static bool write_aside(const std::string &filename, const std::function<void(std::ofstream &file)> &write) {
+    std::error_code ec;
+    const std::string target = std::filesystem::is_symlink(filename, ec) ? std::filesystem::canonical(filename, ec).string() : filename;
+    const std::string temp_filename = target + ".tmp" + std::to_string(getpid());
+    {
+        std::ofstream file(temp_filename, std::ios::binary);
+        write(file);
+        file.flush();
+        if (!file) {
+            std::filesystem::remove(temp_filename, ec);
+            return false;
+        }
+        profile.bytes_written += file.tellp();
+    }
+    const std::filesystem::file_status status = std::filesystem::status(target, ec);
+    if (std::filesystem::exists(status)) {
+        std::filesystem::permissions(temp_filename, status.permissions(), ec);
+    }
+    std::filesystem::rename(temp_filename, target, ec);
+    if (ec) {
+        std::filesystem::remove(temp_filename, ec);
+        return false;
+    }
+    return true;
+}
+
+/* completions may read it while it's written */
+static void dump_tag_names(const std::string &tags_file, const name_table_t &names) {
+    write_aside(tags_file + ".names", [&](std::ofstream &file) { file << tag_names_stamp(tags_file) << names.text; });
+}
+
+/* replaces the file, see write_aside */
+bool store_t::dump_tags() {
+    profile_phase_t phase("dump_tags");
+    const bool written = write_aside(tags_file, [this](std::ofstream &file) {
+        for (const auto &[id, tag] : tags) {
+            file << tag.name;
+
+            /* states */
+            if (!tag.enabled) {
+                file << " [d]";
+            }
+            /* end states */
+
+            if (tag.color.has_value()) {
+                file << " (#" << rgb_to_hex(tag.color.value()) << ')'; /* NOLINT */
+            }
+            if (!tag.super.empty()) {
+                file << ':';
+                for (const tid_t &id : tag.super) {
+                    file << ' ' << tags.at(id).name;
+                }
+            }
+            file << '\n';
+            auto vit = virtual_tags.find(id);
+            if (vit != virtual_tags.end()) {
+                for (const search_rule_t &rule : vit->second.rules) {
+                    file << "  = " << search_flag(rule);
+                    if (rule.type == search_rule_type_t::inode || rule.type == search_rule_type_t::inode_exclude) {
+                        file << ' ' << file_id_str(rule.inum);
+                    } else if (rule.type != search_rule_type_t::all_list && rule.type != search_rule_type_t::all_list_exclude) {
+                        file << ' ' << rule.text;
+                    }
+                    file << '\n';
+                }
+                if (vit->second.search_file_path) {
+                    file << "  = --search-file-path\n";
+                }
+            }
+            for (const file_id_t &file_id : tag.files) {
+                file << "  -" << file_id_str(file_id) << '\n';
+            }
+        }
+    });
+    if (!written) {
+        error = format_str("tag file \"%s\" could not be written", tags_file.c_str());
+        return false;
+    }
+    std::vector<std::string> names;
+    names.reserve(tags.size());
+    for (const auto &[id, tag] : tags) {
+        names.push_back(tag.name);
+    }
+    dump_tag_names(tags_file, name_table_t::build(std::move(names)));
+    tags_changed = false;
+    return true;
+}
+
+bool store_t::tag_names(name_table_t &names) {
+    scoped_lock_t lock(*this, lock_type_t::shared);
+    if (!lock.ok) { return false; }
+    const std::string stamp = tag_names_stamp(tags_file);
+    {
+        profile_phase_t phase("load_tag_names");
+        std::string content = get_file_content(tags_file + ".names");
+        if (!stamp.empty() && content.starts_with(stamp) && names.assign(std::move(content.erase(0, stamp.size())))) {
+            return true;
+        }
+    }
+    profile_phase_t phase("scan_tags");
+    const std::string content = get_file_content(tags_file);
+    std::vector<std::string> scanned;
+    for (std::size_t pos = next_tag_declaration(content, 0); pos < content.size(); pos = next_tag_declaration(content, pos)) {
+        const std::size_t end = std::min(content.find('\n', pos), content.size());
+        std::string name = content.substr(pos, std::min(content.find_first_of("[(:", pos), end) - pos);
+        remove_whitespace(name);
+        if (!name.empty()) {
+            scanned.push_back(std::move(name));
+        }
+        pos = end + 1;
+    }
+    names = name_table_t::build(std::move(scanned));
+    if (!stamp.empty()) {
+        dump_tag_names(tags_file, names);
+    }
+    return true;
+}
+
+bool store_t::indexed_paths(name_table_t &names) {
+    scoped_lock_t lock(*this, lock_type_t::shared);
+    if (!lock.ok) { return false; }
+    profile_phase_t phase("scan_index");
+    std::vector<dev_t> devs = device.has_value() ? std::vector<dev_t>{device.value()} : shard_devices();
+    devs.insert(devs.begin(), 0);
+    std::vector<std::string> paths;
+    for (const dev_t &dev : std::set<dev_t>(devs.begin(), devs.end())) {
+        const std::string content = get_file_content(shard_file(dev));
+        for (std::size_t begin = 0; begin < content.size();) {
+            const std::size_t end = std::min(content.find(index_delim, begin), content.size());
+            const std::size_t colon_pos = content.find(':', begin);
+            if (colon_pos < end && colon_pos + 1 < end && content.find('\n', colon_pos) >= end) {
+                paths.emplace_back(content, colon_pos + 1, end - colon_pos - 1);
+            }
+            begin = end + index_delim.size();
+        }
+    }
+    names = name_table_t::build(std::move(paths));
+    return true;
+}
+
+bool store_t::dump_index() {
+    std::set<dev_t> devs(shards_changed);
+    if (!device.has_value() || device.value() == 0) {
+        devs.insert(0);
+    }
+    for (auto it = file_index.cbegin(); it != file_index.cend(); it = shard(it->first.dev).end()) {
+        devs.insert(it->first.dev);
+    }
+    for (const dev_t &dev : devs) {
+        if (!dump_shard(dev)) { return false; }
+    }
+    return true;
+}
+
+bool store_t::dump_shard(dev_t dev) {
+    profile_phase_t phase("dump_index");
+    const auto range = shard(dev);
+    if (range.empty() && dev != 0) {
+        std::error_code ec;
+        std::filesystem::remove(shard_file(dev), ec);
+        shards_changed.erase(dev);
+        return true;
+    }
+    const bool written = write_aside(shard_file(dev), [&range](std::ofstream &file) {
+        for (const auto &[file_id, file_info] : range) {
+            /* file << file_id.ino << ':' << std::filesystem::weakly_canonical(file_info.pathstr).string() << std::string{'\0'} + "\n"; */
+            file << file_id.ino;
+            if (file_info.meta) {
+                const file_meta_t &meta = file_info.meta.value();
+                file << ';' << meta.size << ';' << meta.mtime << ';' << meta.type << ';' << std::oct << meta.mode << std::dec;
+                if (meta.fingerprint != 0) {
+                    file << ';' << std::hex << meta.fingerprint << std::dec;
+                }
+            }
+            file << ':' << std::filesystem::path(file_info.pathstr).string() << std::string{'\0'} + "\n";
+        }
+    });
+    if (!written) {
+        error = format_str("index file \"%s\" could not be written", shard_file(dev).c_str());
+        return false;
+    }
+    shards_changed.erase(dev);
+    return true;
+}
+
+
+tag_t *store_t::find_tag(const std::string &name) {
+    for (auto &[_, tag] : tags) {
+        if (tag.name == name) {
+            return &tag;
+        }
+    }
+    return nullptr;
+}
+
+file_id_t store_t::find_path(const std::filesystem::path &path) const {
+    for (const auto &[file_id, file_info] : file_index) {
+        profile.files_scanned++;
+        if (file_info.pathstr_ok()) {
+            std::filesystem::path opath = std::filesystem::path(file_info.pathstr).lexically_normal();
+            if (path == opath) {
+                return file_id;
+            }
+        }
+    }
+    return {};
+}
+
+file_id_t store_t::find_id(const file_id_t &file_id) const {
+    if (contains(file_id)) {
+        return file_id;
+    }
+    if (contains(file_id_t{0, file_id.ino})) {
+        return file_id_t{0, file_id.ino};
+    }
+    if (file_id.dev == 0) {
+        for (auto it = file_index.cbegin(); it != file_index.cend(); it = shard(it->first.dev).end()) {
+            if (contains(file_id_t{it->first.dev, file_id.ino})) {
+                return file_id_t{it->first.dev, file_id.ino};
+            }
+        }
+    }
+    return {};
+}
+
+file_id_t store_t::find_on_disk(const std::filesystem::path &path) const {
+    const file_id_t disk_id = path_get_id(path);
+    if (!disk_id) {
+        return {};
+    }
+    return find_id(disk_id);
+}
+
+bool store_t::contains(file_id_t file_id) const {
+    return file_index.contains(file_id);
+}
+
+store_stats_t store_t::stats(bool co_occurrence) const {
+    profile_phase_t phase("stats");
+    store_stats_t ret;
+    ret.files = file_index.size();
+    std::unordered_map<tid_t, std::uint32_t> pos; /* in ret.tags */
+    pos.reserve(tags.size());
+    for (const auto &[id, _] : tags) {
+        pos.emplace(id, static_cast<std::uint32_t>(ret.tags.size()));
+        ret.tags.push_back(tag_stats_t{.id = id});
+    }
+
+    /* depths, breadth first from the tags with no supertags, then from whatever is left (only reachable through
+     * loops) in tags order */
+    std::vector<bool> reached(ret.tags.size());
+    std::vector<std::uint32_t> queue;
+    const auto walk = [&](std::size_t qi) {
+        for (; qi < queue.size(); qi++) {
+            tag_stats_t &tstats = ret.tags[queue[qi]];
+            ret.max_depth = std::max(ret.max_depth, tstats.depth);
+            for (const tid_t &sub : tags.at(tstats.id).sub) {
+                const std::uint32_t si = pos.at(sub);
+                if (reached[si]) { continue; }
+                reached[si] = true;
+                ret.tags[si].depth = tstats.depth + 1;
+                queue.push_back(si);
+            }
+        }
+    };
+    for (std::uint32_t i = 0; i < ret.tags.size(); i++) {
+        if (tags.at(ret.tags[i].id).super.empty()) {
+            reached[i] = true;
+            queue.push_back(i);
+        }
+    }
+    walk(0);
+    for (std::uint32_t i = 0; i < ret.tags.size(); i++) {
+        if (reached[i]) { continue; }
+        reached[i] = true;
+        queue.push_back(i);
+        walk(queue.size() - 1);
+    }
+
+    /* every tag and its supertags, transitively, filled in the first time a file has the tag */
+    std::vector<std::vector<std::uint32_t>> ancestors(ret.tags.size());
+    const auto get_ancestors = [&](std::uint32_t ti) -> const std::vector<std::uint32_t> & {
+        std::vector<std::uint32_t> &anc = ancestors[ti];
+        if (!anc.empty()) { return anc; }
+        std::vector<std::uint32_t> pending = {ti};
+        std::unordered_map<std::uint32_t, bool> seen{{ti, true}};
+        while (!pending.empty()) {
+            const std::uint32_t ai = pending.back();
+            pending.pop_back();
+            anc.push_back(ai);
+            for (const tid_t &super : tags.at(ret.tags[ai].id).super) {
+                if (seen.emplace(pos.at(super), true).second) {
+                    pending.push_back(pos.at(super));
+                }
+            }
+        }
+        return anc;
+    };
+
+    std::vector<std::uint64_t> stamp(ret.tags.size(), 0); /* last file (plus one) counted towards a subtree */
+    std::unordered_map<std::uint64_t, std::uint64_t> pairs; /* first << 32 | second, files */
+    std::vector<std::uint32_t> file_tags;
+    std::uint64_t fi = 0;
+    for (const auto &[_, file_info] : file_index) {
+        fi++;
+        profile.files_scanned++;
+        if (file_info.tags.empty()) {
+            ret.untagged_files++;
+            continue;
+        }
+        file_tags.clear();
+        for (const tid_t &id : file_info.tags) {
+            const std::uint32_t ti = pos.at(id);
+            file_tags.push_back(ti);
+            ret.tags[ti].files++;
+            for (const std::uint32_t &ai : get_ancestors(ti)) {
+                if (stamp[ai] != fi) {
+                    stamp[ai] = fi;
+                    ret.tags[ai].subtree_files++;
+                }
+            }
+        }
+        if (!co_occurrence) { continue; }
+        std::sort(file_tags.begin(), file_tags.end());
+        for (std::size_t a = 0; a < file_tags.size(); a++) {
+            for (std::size_t b = a + 1; b < file_tags.size(); b++) {
+                pairs[static_cast<std::uint64_t>(file_tags[a]) << 32U | file_tags[b]]++;
+            }
+        }
+    }
+
+    ret.co_occurrence.reserve(pairs.size());
+    for (const auto &[key, n] : pairs) {
+        ret.co_occurrence.emplace_back(static_cast<std::uint32_t>(key >> 32U), static_cast<std::uint32_t>(key), n);
+    }
+    std::sort(ret.co_occurrence.begin(), ret.co_occurrence.end(), [](const auto &a, const auto &b) {
+        if (std::get<2>(a) != std::get<2>(b)) { return std::get<2>(a) > std::get<2>(b); }
+        return std::tie(std::get<0>(a), std::get<1>(a)) < std::tie(std::get<0>(b), std::get<1>(b));
+    });
+    return ret;
+}
+
+std::vector<tid_t> store_t::enabled_only(std::span<const tid_t> tagids) const {
+    std::vector<tid_t> ret;
+    for (const tid_t &id : tagids) {
+        if (tags.at(id).enabled) {
+            ret.push_back(id);
+        }
+    }
+    return ret;
+}
+
+bool store_t::has_super(const tag_t &tag, const tag_t &super) const {
+    return std::find(tag.super.begin(), tag.super.end(), super.id) != tag.super.end() ||
+           std::find(super.sub.begin(), super.sub.end(), tag.id) != super.sub.end();
+}
+
+bool store_t::has_file(const tag_t &tag, file_id_t file_id) const {
+    /* a file's own tags are few, tag.files can be most of the index */
+    auto it = file_index.find(file_id);
+    if (it != file_index.end() && std::find(it->second.tags.begin(), it->second.tags.end(), tag.id) != it->second.tags.end()) {
+        return true;
+    }
+    return std::find(tag.files.begin(), tag.files.end(), file_id) != tag.files.end();
+}
+
+
+tid_t store_t::generate_unique_tid() const {
+    tid_t id = 0;
+    bool in = false;
+    do {
+        in = false;
+        id = get_random_int<tid_t>();
+        for (const auto &[tagid, _] : tags) {
+            in = in || (tagid == id);
+        }
+    } while (in || id == 0);
+    return id;
+}
+
+tag_t *store_t::create_tag(const std::string &name, const std::optional<color_t> &color) {
+    if (tag_name_bad(name)) {
+        error = format_str("bad tag name \"%s\"", name.c_str());
+        return nullptr;
+    }
+    if (find_tag(name) != nullptr) {
+        error = format_str("tag \"%s\" could not be created, already exists", name.c_str());
+        return nullptr;
+    }
+    const tid_t id = generate_unique_tid();
+    const std::uint32_t ordinal = parsed_order.size();
+    tag_ordinals.emplace(id, ordinal);
+    parsed_order.push_back(id);
+    tags_changed = true;
+    return &(tags[id] = tag_t{.id = id, .name = name, .color = color, .ordinal = ordinal});
+}
+
+/* the rules that name a tag, which don't follow it when renamed */
+static bool names_tag(const search_rule_t &rule, const std::string &name) {
+    switch (rule.type) {
+        case search_rule_type_t::tag: case search_rule_type_t::tag_exclude:
+        case search_rule_type_t::all: case search_rule_type_t::all_exclude:
+            return rule.opt == search_opt_t::exact && rule.text == name;
+        default:
+            return false;
+    }
+}
+
+bool store_t::delete_tag(const tag_t &tag) {
+    const tid_t id = tag.id;
+    for (const auto &[vid, virtual_tag] : virtual_tags) {
+        if (vid == id) { continue; }
+        if (std::ranges::any_of(virtual_tag.rules, [&tag](const search_rule_t &rule) { return names_tag(rule, tag.name); })) {
+            error = format_str("tag \"%s\" is in the search of virtual tag \"%s\"", tag.name.c_str(), tags.at(vid).name.c_str());
+            return false;
+        }
+    }
+    touch_tag(tag);
+    virtual_tags.erase(id);
+    for (const tid_t &subid : tag.sub) {
+        std::erase(tags.at(subid).super, id);
+    }
+    for (const tid_t &superid : tag.super) {
+        std::erase(tags.at(superid).sub, id);
+    }
+    for (const file_id_t &file_id : tag.files) {
+        auto it = file_index.find(file_id);
+        if (it != file_index.end()) {
+            std::erase(it->second.tags, id);
+        }
+    }
+    tags.erase(id);
+    tags_changed = true;
+    return true;
+}
+
+void store_t::set_enabled(tag_t &tag, bool enabled) {
+    if (tag.enabled != enabled) {
+        touch_tag(tag);
+    }
+    tag.enabled = enabled;
+    tags_changed = true;
+}
+
+void store_t::set_color(tag_t &tag, const std::optional<color_t> &color) {
+    tag.color = color;
+    tags_changed = true;
+}
+
+bool store_t::rename_tag(tag_t &tag, const std::string &name) {
+    if (tag_name_bad(name)) {
+        error = format_str("bad tag name \"%s\"", name.c_str());
+        return false;
+    }
+    touch_tag(tag);
+    for (auto &[_, virtual_tag] : virtual_tags) {
+        for (search_rule_t &rule : virtual_tag.rules) {
+            if (names_tag(rule, tag.name)) { rule.text = name; }
+        }
+    }
+    tag.name = name;
+    tags_changed = true;
+    return true;
+}
+
+bool store_t::add_super(tag_t &tag, tag_t &super) {
+    bool changed = false;
+    if (std::find(tag.super.begin(), tag.super.end(), super.id) == tag.super.end()) {
+        tag.super.push_back(super.id);
+        changed = true;
+    }
+    if (std::find(super.sub.begin(), super.sub.end(), tag.id) == super.sub.end()) {
+        super.sub.push_back(tag.id);
+        changed = true;
+    }
+    if (changed) {
+        touch_tag(tag);
+    }
+    tags_changed = tags_changed || changed;
+    return changed;
+}
+
+bool store_t::remove_super(tag_t &tag, tag_t &super) {
+    bool changed = std::erase(tag.super, super.id) > 0;
+    changed = std::erase(super.sub, tag.id) > 0 || changed;
+    if (changed) {
+        touch_tag(tag);
+    }
+    tags_changed = tags_changed || changed;
+    return changed;
+}
+
+void store_t::remove_all_super(tag_t &tag) {
+    touch_tag(tag);
+    for (const tid_t &id : tag.super) {
+        std::erase(tags.at(id).sub, tag.id);
+    }
+    tag.super.clear();
+    tags_changed = true;
+}
+
+void store_t::remove_all_sub(tag_t &tag) {
+    for (const tid_t &id : tag.sub) {
+        touch_tag(tags.at(id));
+        std::erase(tags.at(id).super, tag.id);
+    }
+    tag.sub.clear();
+    tags_changed = true;
+}
+
+bool store_t::add_file(file_id_t file_id, const std::string &pathstr, const std::optional<file_meta_t> &meta) {
+    if (contains(file_id)) {
+        error = format_str("inode number %s already exists in index file (associated with path \"%s\")", file_id_str(file_id).c_str(), file_index.at(file_id).pathstr.c_str());
+        return false;
+    }
+    file_index[file_id] = file_info_t{.file_id = file_id, .pathstr = std::pmr::string(pathstr), .meta = meta, .ordinal = file_ordinals++};
+    shards_changed.insert(file_id.dev);
+    touch_file(file_id);
+    return true;
+}
+
+bool store_t::remove_file(file_id_t file_id) {
+    auto it = file_index.find(file_id);
+    if (it == file_index.end()) {
+        error = format_str("inode number %s was not in index file", file_id_str(file_id).c_str());
+        return false;
+    }
+    for (const tid_t &tagid : it->second.tags) {
+        std::erase(tags.at(tagid).files, file_id);
+    }
+    if (!it->second.tags.empty()) {
+        tags_changed = true;
+    }
+    file_index.erase(it);
+    shards_changed.insert(file_id.dev);
+    return true;
+}
+
+std::size_t store_t::remove_files(const std::vector<file_id_t> &file_ids) {
+    std::map<tid_t, std::unordered_set<file_id_t>> untagged;
+    std::size_t removed = 0;
+    for (const file_id_t &file_id : file_ids) {
+        auto it = file_index.find(file_id);
+        if (it == file_index.end()) { continue; }
+        for (const tid_t &tagid : it->second.tags) {
+            untagged[tagid].insert(file_id);
+        }
+        file_index.erase(it);
+        shards_changed.insert(file_id.dev);
+        removed++;
+    }
+    for (const auto &[tagid, gone] : untagged) {
+        std::erase_if(tags.at(tagid).files, [&gone](const file_id_t &file_id) { return gone.contains(file_id); });
+        tags_changed = true;
+    }
+    return removed;
+}
+
+bool store_t::set_path(file_id_t file_id, const std::string &pathstr, const std::optional<file_meta_t> &meta) {
+    auto it = file_index.find(file_id);
+    if (it == file_index.end()) {
+        error = format_str("inode number %s was not in index file", file_id_str(file_id).c_str());
+        return false;
+    }
+    if (std::string_view(it->second.pathstr) == pathstr && (!meta || it->second.meta == meta)) {
+        return true;
+    }
+    if (std::string_view(it->second.pathstr) != pathstr) {
+        touch_file(file_id);
+    }
+    it->second.pathstr = pathstr;
+    if (meta) {
+        it->second.meta = meta;
+    }
+    shards_changed.insert(file_id.dev);
+    return true;
+}
+
+bool store_t::replace_id(file_id_t oldino, file_id_t newino) {
+    auto it = file_index.find(oldino);
+    if (it == file_index.end()) {
+        error = format_str("old inode number %s was not in index file", file_id_str(oldino).c_str());
+        return false;
+    }
+    if (contains(newino)) {
+        error = format_str("new inode number %s was already in index file", file_id_str(newino).c_str());
+        return false;
+    }
+    for (const tid_t &tagid : it->second.tags) {
+        std::vector<file_id_t> &files = tags.at(tagid).files;
+        std::replace(files.begin(), files.end(), oldino, newino);
+    }
+    if (!it->second.tags.empty()) {
+        tags_changed = true;
+    }
+    file_info_t file_info = std::move(it->second);
+    file_info.file_id = newino;
+    file_index.erase(it);
+    file_index[newino] = std::move(file_info);
+    shards_changed.insert(oldino.dev);
+    shards_changed.insert(newino.dev);
+    touch_file(newino);
+    return true;
+}
+
+std::size_t store_t::fingerprint(const std::vector<file_id_t> &file_ids) {
+    std::vector<file_info_t *> infos;
+    std::vector<std::pair<std::string, std::uint64_t>> files;
+    for (const file_id_t &file_id : file_ids) {
+        auto it = file_index.find(file_id);
+        if (it == file_index.end() || !it->second.meta || it->second.meta->type != 'f') { continue; }
+        infos.push_back(&it->second);
+        files.emplace_back(it->second.pathstr, it->second.meta->size);
+    }
+    const std::vector<std::uint64_t> fingerprints = fingerprint_files(files);
+    std::size_t taken = 0;
+    for (std::size_t i = 0; i < infos.size(); i++) {
+        if (fingerprints[i] == 0) {
+            warn(format_str("file \"%s\" could not be read for its fingerprint", infos[i]->pathstr.c_str()));
+            continue;
+        }
+        if (infos[i]->meta->fingerprint != fingerprints[i]) {
+            infos[i]->meta->fingerprint = fingerprints[i];
+            shards_changed.insert(infos[i]->file_id.dev);
+        }
+        taken++;
+    }
+    return taken;
+}
+
+/* whether an index entry is the file stat found, a dev 0 entry by its inode number alone */
+static bool same_file(const file_id_t &file_id, const struct stat &buffer) {
+    return file_id.dev == 0 ? file_id.ino == buffer.st_ino : file_id == file_id_of(buffer);
+}
+
+std::vector<relocation_t> store_t::match_by_content(const std::filesystem::path &dir) {
+    std::unordered_map<std::uint64_t, std::vector<file_id_t>> orphans; /* by size */
+    std::vector<relocation_t> ret;
+    {
+        profile_phase_t phase("orphans");
+        for (const auto &[file_id, file_info] : file_index) {
+            profile.files_scanned++;
+            if (!file_info.meta || file_info.meta->fingerprint == 0) { continue; }
+            struct stat buffer{};
+            if (file_exists(file_info.pathstr, &buffer) && same_file(file_id, buffer)) {
+                if (file_id.dev == 0) { /* in place, it only gets its device */
+                    ret.push_back(relocation_t{file_id, file_id_of(buffer), std::string(file_info.pathstr), *file_info.meta});
+                }
+                continue;
+            }
+            orphans[file_info.meta->size].push_back(file_id);
+        }
+    }
+    if (orphans.empty()) {
+        return ret;
+    }
+
+    /* only files with an orphan's size are worth reading */
+    std::vector<std::pair<std::string, std::uint64_t>> candidates;
+    std::vector<std::pair<file_id_t, file_meta_t>> candidate_stats;
+    {
+        profile_phase_t phase("walk");
+        std::error_code ec;
+        for (auto it = std::filesystem::recursive_directory_iterator(dir, std::filesystem::directory_options::skip_permission_denied, ec);
+                it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+            if (ec) { break; }
+            profile.files_scanned++;
+            if (!it->is_regular_file(ec)) { continue; }
+            struct stat buffer{};
+            if (!file_exists(it->path(), &buffer) || !orphans.contains(static_cast<std::uint64_t>(buffer.st_size))) { continue; }
+            if (find_id(file_id_of(buffer))) { continue; } /* already someone's */
+            candidates.emplace_back(it->path().string(), buffer.st_size);
+            candidate_stats.emplace_back(file_id_of(buffer), file_meta_of(buffer));
+        }
+        if (ec) {
+            warn(format_str("directory \"%s\" could not be walked fully: %s", dir.c_str(), ec.message().c_str()));
+        }
+    }
+    const std::vector<std::uint64_t> fingerprints = fingerprint_files(candidates);
+
+    std::map<file_id_t, std::vector<std::size_t>> found; /* orphan, candidates with its fingerprint */
+    std::vector<std::size_t> matched_orphans(candidates.size(), 0);
+    for (std::size_t ci = 0; ci < candidates.size(); ci++) {
+        if (fingerprints[ci] == 0) { continue; }
+        for (const file_id_t &orphan : orphans.at(candidates[ci].second)) {
+            if (file_index.at(orphan).meta->fingerprint == fingerprints[ci]) {
+                found[orphan].push_back(ci);
+                matched_orphans[ci]++;
+            }
+        }
+    }
+    for (const auto &[orphan, cis] : found) {
+        const std::pmr::string &pathstr = file_index.at(orphan).pathstr;
+        if (cis.size() > 1) {
+            warn(format_str("inode number %s (\"%s\") has the same contents as %zu files, e.g. \"%s\" and \"%s\", skipping", file_id_str(orphan).c_str(), pathstr.c_str(), cis.size(), candidates[cis[0]].first.c_str(), candidates[cis[1]].first.c_str()));
+            continue;
+        }
+        const std::size_t ci = cis[0];
+        if (matched_orphans[ci] > 1) {
+            warn(format_str("file \"%s\" has the same contents as %zu index file entries, e.g. inode number %s (\"%s\"), skipping", candidates[ci].first.c_str(), matched_orphans[ci], file_id_str(orphan).c_str(), pathstr.c_str()));
+            continue;
+        }
+        relocation_t &match = ret.emplace_back(relocation_t{orphan, candidate_stats[ci].first, candidates[ci].first, candidate_stats[ci].second});
+        match.meta.fingerprint = fingerprints[ci];
+    }
+    return ret;
+}
+
+/* --- directory cache structure ---
+ *
+ * [device]:[inode number];[mtime in ns];[ctime in ns]:[full path]\0
+ */
+bool dir_cache_t::load(const std::string &filename, std::string &error) {
+    dirs.clear();
+    if (!file_exists(filename)) {
+        return true;
+    }
+    profile_phase_t phase("load_dir_cache");
+    const std::string content = get_file_content(filename);
+    std::uint32_t record_n = 0;
+    for (std::size_t begin = 0; begin < content.size();) {
+        const std::size_t end = std::min(content.find(index_delim, begin), content.size());
+        const std::string record = content.substr(begin, end - begin);
+        begin = end + index_delim.size();
+        if (record.empty()) { continue; }
+        record_n++;
+        const std::size_t semi_pos = record.find(';');
+        const std::size_t colon_pos = record.find(':', semi_pos == std::string::npos ? 0 : semi_pos);
+        dir_stamp_t stamp;
+        char *pos = nullptr;
+        if (semi_pos == std::string::npos || colon_pos == std::string::npos || !parse_file_id(record.substr(0, semi_pos), stamp.id)) {
+            error = format_str("directory cache file \"%s\" line %u could not be parsed", filename.c_str(), record_n);
+            return false;
+        }
+        stamp.mtime = std::strtoll(record.c_str() + semi_pos + 1, &pos, 10);
+        if (*pos == ';') {
+            stamp.ctime = std::strtoll(pos + 1, &pos, 10);
+        }
+        if (pos != record.c_str() + colon_pos) {
+            error = format_str("directory cache file \"%s\" line %u had bad stamps", filename.c_str(), record_n);
+            return false;
+        }
+        dirs.insert_or_assign(dirs.end(), record.substr(colon_pos + 1), stamp);
+    }
+    return true;
+}
+
+void dir_cache_t::dump(const std::string &filename) {
+    profile_phase_t phase("dump_dir_cache");
+    std::ofstream file(filename);
+    for (const auto &[pathstr, stamp] : dirs) {
+        file << file_id_str(stamp.id) << ';' << stamp.mtime << ';' << stamp.ctime << ':' << pathstr << std::string{'\0'} + "\n";
+    }
+    profile.bytes_written += file.tellp();
+    changed = false;
+}
+
+void dir_cache_t::walk(const std::filesystem::path &root, const std::vector<std::string> &indexed, const std::function<void(const std::filesystem::path &path, bool is_directory)> &emit) {
+    const std::int64_t racy_after = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count() - 1000000000;
+    std::map<std::string, dir_stamp_t> walked;
+    /* whether dir and everything under it got cached, a directory is only cached if so as its cached subdirectories
+     * stand in for its entries next time */
+    const std::function<bool(const std::filesystem::path &)> visit = [&](const std::filesystem::path &dir) {
+        struct stat buffer{};
+        if (!file_exists(dir, &buffer) || !S_ISDIR(buffer.st_mode)) { return false; }
+        const dir_stamp_t stamp{file_id_of(buffer), file_meta_of(buffer).mtime, static_cast<std::int64_t>(buffer.st_ctim.tv_sec) * 1000000000 + buffer.st_ctim.tv_nsec};
+        const std::string dirstr = dir.string();
+        bool complete = stamp.mtime < racy_after && stamp.ctime < racy_after;
+        auto it = dirs.find(dirstr);
+        if (it != dirs.end() && it->second == stamp) {
+            /* the same entries, so the same subdirectories, which are the direct children among the cached paths.
+             * everything under one child is contiguous, [child + '/', child + '0'), and is skipped past at once */
+            const std::string prefix = dirstr.ends_with('/') ? dirstr : dirstr + '/';
+            for (auto sit = dirs.lower_bound(prefix); sit != dirs.end() && sit->first.starts_with(prefix);) {
+                const std::size_t slash = sit->first.find('/', prefix.size());
+                if (slash == std::string::npos) {
+                    emit(sit->first, true);
+                    complete = visit(sit->first) && complete;
+                    ++sit;
+                } else {
+                    sit = dirs.lower_bound(sit->first.substr(0, slash) + '0');
+                }
+            }
+            /* its files could still have been edited in place, the indexed ones among them get looked at again
+             * without listing it, the same way */
+            for (auto iit = std::lower_bound(indexed.begin(), indexed.end(), prefix); iit != indexed.end() && iit->starts_with(prefix);) {
+                const std::size_t slash = iit->find('/', prefix.size());
+                if (slash == std::string::npos) {
+                    if (!dirs.contains(*iit)) { emit(*iit, false); }
+                    ++iit;
+                } else {
+                    iit = std::lower_bound(iit, indexed.end(), iit->substr(0, slash) + '0');
+                }
+            }
+        } else {
+            std::error_code ec;
+            for (const auto &entry : std::filesystem::directory_iterator(dir, std::filesystem::directory_options::skip_permission_denied, ec)) {
+                const bool is_directory = entry.is_directory(ec) && !entry.is_symlink(ec); /* symlinks aren't followed */
+                emit(entry.path(), is_directory);
+                if (is_directory) {
+                    complete = visit(entry.path()) && complete;
+                }
+            }
+            complete = complete && !ec;
+        }
+        if (complete) {
+            walked.emplace(dirstr, stamp);
+        }
+        return complete;
+    };
+    visit(root);
+
+    const std::string rootstr = root.string();
+    const std::string prefix = rootstr.ends_with('/') ? rootstr : rootstr + '/';
+    dirs.erase(rootstr);
+    dirs.erase(dirs.lower_bound(prefix), dirs.lower_bound(prefix.substr(0, prefix.size() - 1) + '0'));
+    dirs.merge(walked);
+    changed = true;
+}
+
+std::vector<relocation_t> store_t::detect_moves(const std::vector<std::filesystem::path> &roots, std::vector<file_id_t> &missing) {
+    std::unordered_set<file_id_t> stale;
+    std::vector<relocation_t> in_place; /* dev 0 entries still at their path, which only get their device */
+    {
+        profile_phase_t phase("stale");
+        for (const auto &[file_id, file_info] : file_index) {
+            profile.files_scanned++;
+            struct stat buffer{};
+            if (!file_info.unresolved() && file_exists(file_info.pathstr, &buffer) && same_file(file_id, buffer)) {
+                if (file_id.dev == 0) {
+                    relocation_t &relocation = in_place.emplace_back(relocation_t{file_id, file_id_of(buffer), std::string(file_info.pathstr), file_meta_of(buffer)});
+                    if (file_info.meta && file_info.meta->size == relocation.meta.size && file_info.meta->mtime == relocation.meta.mtime) {
+                        relocation.meta.fingerprint = file_info.meta->fingerprint; /* unchanged since it was taken */
+                    }
+                }
+                continue;
+            }
+            stale.insert(file_id);
+        }
+    }
+    if (stale.empty()) {
+        return in_place;
+    }
+
+    const auto check = [this, &stale](const std::filesystem::path &path, std::vector<relocation_t> &out) {
+        profile.files_scanned++;
+        struct stat buffer{};
+        if (!file_exists(path, &buffer)) { return; }
+        const file_id_t file_id = file_id_of(buffer);
+        file_id_t old_id = file_id;
+        if (!stale.contains(old_id)) {
+            old_id = file_id_t{0, file_id.ino};
+            if (!stale.contains(old_id)) { return; }
+        }
+        const file_meta_t meta = file_meta_of(buffer);
+        const std::optional<file_meta_t> &old_meta = file_index.at(old_id).meta;
+        if (old_meta && old_meta->type != meta.type) { return; } /* the inode number was freed and reused */
+        out.push_back(relocation_t{old_id, file_id, path.string(), meta});
+    };
+
+    /* every root's direct entries are the work items, so the threads share out the top of the tree rather than
+     * each taking a root */
+    std::vector<std::vector<relocation_t>> found(1);
+    std::vector<std::filesystem::path> items;
+    for (const std::filesystem::path &root : roots) {
+        check(root, found[0]);
+        std::error_code ec;
+        for (const auto &entry : std::filesystem::directory_iterator(root, std::filesystem::directory_options::skip_permission_denied, ec)) {
+            items.push_back(entry.path());
+        }
+        if (ec) {
+            warn(format_str("directory \"%s\" could not be walked: %s", root.c_str(), ec.message().c_str()));
+        }
+    }
+    {
+        profile_phase_t phase("walk");
+        found.resize(1 + std::min<std::size_t>(worker_count(), items.size()));
+        std::atomic<std::size_t> next{0};
+        parallel_for(found.size() - 1, [&](std::size_t t) {
+            std::vector<relocation_t> &out = found[t + 1];
+            for (std::size_t i = next++; i < items.size(); i = next++) {
+                check(items[i], out);
+                std::error_code ec;
+                if (!std::filesystem::is_directory(std::filesystem::symlink_status(items[i], ec))) { continue; }
+                for (auto it = std::filesystem::recursive_directory_iterator(items[i], std::filesystem::directory_options::skip_permission_denied, ec);
+                        !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+                    check(it->path(), out);
+                }
+            }
+        });
+    }
+
+    /* a file with more than one path (hard links, overlapping roots) keeps the first path in order, whichever thread
+     * found it */
+    std::vector<relocation_t> ret;
+    for (std::vector<relocation_t> &relocations : found) {
+        std::move(relocations.begin(), relocations.end(), std::back_inserter(ret));
+    }
+    std::sort(ret.begin(), ret.end(), [](const relocation_t &a, const relocation_t &b) { return std::tie(a.old_id, a.pathstr) < std::tie(b.old_id, b.pathstr); });
+    ret.erase(std::unique(ret.begin(), ret.end(), [](const relocation_t &a, const relocation_t &b) { return a.old_id == b.old_id; }), ret.end());
+    std::move(in_place.begin(), in_place.end(), std::back_inserter(ret));
+    std::unordered_set<file_id_t> moved;
+    for (const relocation_t &relocation : ret) {
+        moved.insert(relocation.old_id);
+    }
+    for (const auto &[file_id, _] : file_index) {
+        if (stale.contains(file_id) && !moved.contains(file_id)) {
+            missing.push_back(file_id);
+        }
+    }
+    return ret;
+}
+
+bool store_t::tag_file(tag_t &tag, file_id_t file_id) {
+    auto it = file_index.find(file_id);
+    if (it == file_index.end()) {
+        error = format_str("inode number %s was not in index file", file_id_str(file_id).c_str());
+        return false;
+    }
+    bool changed = false;
+    if (std::find(it->second.tags.begin(), it->second.tags.end(), tag.id) == it->second.tags.end()) {
+        it->second.tags.push_back(tag.id);
+        changed = true;
+    }
+    if (std::find(tag.files.begin(), tag.files.end(), file_id) == tag.files.end()) {
+        tag.files.push_back(file_id);
+        changed = true;
+    }
+    if (changed && !virtual_tags.contains(tag.id)) {
+        touch_file(file_id);
+    }
+    tags_changed = tags_changed || changed;
+    return changed;
+}
+
+bool store_t::untag_file(tag_t &tag, file_id_t file_id) {
+    bool changed = std::erase(tag.files, file_id) > 0;
+    auto it = file_index.find(file_id);
+    if (it != file_index.end()) {
+        changed = std::erase(it->second.tags, tag.id) > 0 || changed;
+    }
+    if (changed && !virtual_tags.contains(tag.id)) {
+        touch_file(file_id);
+    }
+    tags_changed = tags_changed || changed;
+    return changed;
+}
+
+std::size_t store_t::tag_files(tag_t &tag, const std::vector<file_id_t> &file_ids, std::vector<file_id_t> *skipped) {
+    std::unordered_set<file_id_t> tagged(tag.files.begin(), tag.files.end());
+    std::size_t changed = 0;
+    for (const file_id_t &file_id : file_ids) {
+        auto it = file_index.find(file_id);
+        if (it == file_index.end() || !tagged.insert(file_id).second) {
+            if (skipped != nullptr) {
+                skipped->push_back(file_id);
+            }
+            continue;
+        }
+        tag.files.push_back(file_id);
+        if (std::find(it->second.tags.begin(), it->second.tags.end(), tag.id) == it->second.tags.end()) {
+            it->second.tags.push_back(tag.id);
+        }
+        if (!virtual_tags.contains(tag.id)) {
+            touch_file(file_id);
+        }
+        changed++;
+    }
+    tags_changed = tags_changed || changed > 0;
+    return changed;
+}
+
+std::size_t store_t::untag_files(tag_t &tag, const std::vector<file_id_t> &file_ids, std::vector<file_id_t> *skipped) {
+    const std::unordered_set<file_id_t> untag(file_ids.begin(), file_ids.end());
+    std::unordered_set<file_id_t> found;
+    std::erase_if(tag.files, [&](const file_id_t &file_id) {
+        if (!untag.contains(file_id)) { return false; }
+        found.insert(file_id);
+        return true;
+    });
+    std::unordered_set<file_id_t> seen;
+    for (const file_id_t &file_id : file_ids) {
+        if (!seen.insert(file_id).second || !found.contains(file_id)) {
+            if (skipped != nullptr) {
+                skipped->push_back(file_id);
+            }
+            continue;
+        }
+        auto it = file_index.find(file_id);
+        if (it != file_index.end()) {
+            std::erase(it->second.tags, tag.id);
+        }
+        if (!virtual_tags.contains(tag.id)) {
+            touch_file(file_id);
+        }
+    }
+    tags_changed = tags_changed || !found.empty();
+    return found.size();
+}
+
+
+static const std::unordered_map<std::string, search_rule_type_t> arg_to_rule_type = { /* NOLINT */
+    {"t", search_rule_type_t::tag},
+    {"tag", search_rule_type_t::tag},
+    {"te", search_rule_type_t::tag_exclude},
+    {"tag-exclude", search_rule_type_t::tag_exclude},
+    {"f", search_rule_type_t::file},
+    {"file", search_rule_type_t::file},
+    {"fe", search_rule_type_t::file_exclude},
+    {"file-exclude", search_rule_type_t::file_exclude},
+    {"a", search_rule_type_t::all},
+    {"all", search_rule_type_t::all},
+    {"ae", search_rule_type_t::all_exclude},
+    {"all-exclude", search_rule_type_t::all_exclude},
+
+    {"al", search_rule_type_t::all_list},
+    {"all-list", search_rule_type_t::all_list},
+    {"ale", search_rule_type_t::all_list_exclude},
+    {"all-list-exclude", search_rule_type_t::all_list_exclude},
+
+    {"i", search_rule_type_t::inode},
+    {"inode", search_rule_type_t::inode},
+    {"ie", search_rule_type_t::inode_exclude},
+    {"inode-exclude", search_rule_type_t::inode_exclude}
+};
+
+static const std::unordered_map<std::string, search_opt_t> arg_to_opt = { /* NOLINT */
+    {"s", search_opt_t::text_includes},
+    {"r", search_opt_t::regex}
+};
+
+bool parse_search_flag(const std::string &arg, search_rule_type_t &type, search_opt_t &opt, std::string &error) {
+    /* the flag itself, or the flag and a one letter opt ("-tr", "--tag-r") */
+    std::string main_arg;
+    bool has_opt = false;
+    if (arg.starts_with("--")) {
+        main_arg = arg.substr(2);
+        if (!map_contains(arg_to_rule_type, main_arg)) {
+            has_opt = true;
+            main_arg = arg.size() < 4 || arg[arg.size() - 2] != '-' ? std::string() : arg.substr(2, arg.size() - 4);
+        }
+    } else if (arg.starts_with("-")) {
+        main_arg = arg.substr(1);
+        if (!map_contains(arg_to_rule_type, main_arg)) {
+            has_opt = true;
+            main_arg = arg.substr(1, arg.size() - 2);
+        }
+    }
+    if (!map_contains(arg_to_rule_type, main_arg)) {
+        error = format_str("not recognized: \"%s\"", arg.c_str());
+        return false;
+    }
+    type = arg_to_rule_type.at(main_arg);
+    opt = search_opt_t::exact;
+    if (has_opt) {
+        const std::string opt_str = arg.substr(arg.size() - 1);
+        if (!map_contains(arg_to_opt, opt_str)) {
+            error = format_str("search option \"%s\" not found", opt_str.c_str());
+            return false;
+        }
+        opt = arg_to_opt.at(opt_str);
+    }
+    return true;
+}
+
+std::string search_flag(const search_rule_t &rule) {
+    static const std::map<search_rule_type_t, std::string> type_flags = {
+        {search_rule_type_t::tag, "-t"}, {search_rule_type_t::tag_exclude, "-te"}, {search_rule_type_t::file, "-f"},
+        {search_rule_type_t::file_exclude, "-fe"}, {search_rule_type_t::all, "-a"}, {search_rule_type_t::all_exclude, "-ae"},
+        {search_rule_type_t::all_list, "-al"}, {search_rule_type_t::all_list_exclude, "-ale"},
+        {search_rule_type_t::inode, "-i"}, {search_rule_type_t::inode_exclude, "-ie"}
+    };
+    std::string ret = type_flags.at(rule.type);
+    const bool takes_text = rule.type != search_rule_type_t::all_list && rule.type != search_rule_type_t::all_list_exclude && rule.type != search_rule_type_t::inode && rule.type != search_rule_type_t::inode_exclude;
+    if (takes_text && rule.opt == search_opt_t::text_includes) {
+        ret += 's';
+    } else if (takes_text && rule.opt == search_opt_t::regex) {
+        ret += 'r';
+    }
+    return ret;
+}
+
+query_t &query_t::add(const search_rule_t &rule) {
+    rules.push_back(rule);
+    return *this;
+}
+
+query_t &query_t::tag(const std::string &text, search_opt_t opt) {
+    return add(search_rule_t{search_rule_type_t::tag, opt, text});
+}
+
+query_t &query_t::tag_exclude(const std::string &text, search_opt_t opt) {
+    return add(search_rule_t{search_rule_type_t::tag_exclude, opt, text});
+}
+
+query_t &query_t::all(const std::string &text, search_opt_t opt) {
+    return add(search_rule_t{search_rule_type_t::all, opt, text});
+}
+
+query_t &query_t::all_exclude(const std::string &text, search_opt_t opt) {
+    return add(search_rule_t{search_rule_type_t::all_exclude, opt, text});
+}
+
+query_t &query_t::file(const std::string &text, search_opt_t opt) {
+    return add(search_rule_t{search_rule_type_t::file, opt, text});
+}
+
+query_t &query_t::file_exclude(const std::string &text, search_opt_t opt) {
+    return add(search_rule_t{search_rule_type_t::file_exclude, opt, text});
+}
+
+query_t &query_t::inode(file_id_t inum) {
+    return add(search_rule_t{.type = search_rule_type_t::inode, .inum = inum});
+}
+
+query_t &query_t::inode_exclude(file_id_t inum) {
+    return add(search_rule_t{.type = search_rule_type_t::inode_exclude, .inum = inum});
+}
+
+query_t &query_t::all_list() {
+    return add(search_rule_t{search_rule_type_t::all_list});
+}
+
+query_t &query_t::all_list_exclude() {
+    return add(search_rule_t{search_rule_type_t::all_list_exclude});
+}
+
+query_t &query_t::by_path(bool search_file_path) {
+    this->search_file_path = search_file_path;
+    return *this;
+}
+
+query_t &query_t::filter(const meta_filter_t &meta_filter) {
+    this->meta_filter = meta_filter;
+    return *this;
+}
+
+/* sets the bit of every indexed file of tag, the ones not in the index (of other devices, or dangling) can't be returned */
+static void set_tag_files(const store_t &store, const tag_t &tag, bitset_t &files, bool value) {
+    for (const file_id_t &file_id : tag.files) {
+        auto it = store.file_index.find(file_id);
+        if (it != store.file_index.end()) {
+            files.set(it->second.ordinal, value);
+        }
+    }
+}
+
+void add_all(const store_t &store, const tid_t &tagid, std::vector<tid_t> &tags_visited, bitset_t &tags_returned, bitset_t &files_returned, bool exclude) {
+    if (std::find(tags_visited.begin(), tags_visited.end(), tagid) == tags_visited.end()) {
+        tags_visited.push_back(tagid);
+        const tag_t &tag = store.tags.at(tagid);
+        tags_returned.set(tag.ordinal, !exclude);
+        set_tag_files(store, tag, files_returned, !exclude);
+    } else {
+        return;
+    }
+    for (const tid_t &id : store.enabled_only(store.tags.at(tagid).sub)) {
+        add_all(store, id, tags_visited, tags_returned, files_returned, exclude);
+    }
+}
+
+bool meta_filter_t::passes(const file_info_t &file_info) const {
+    if (empty()) { return true; }
+    if (!file_info.meta) { return false; }
+    const file_meta_t &meta = file_info.meta.value();
+    return (!larger_than || meta.size > larger_than.value()) && (!smaller_than || meta.size < smaller_than.value())
+        && (!modified_after || meta.mtime > modified_after.value()) && (!modified_before || meta.mtime < modified_before.value())
+        && (!type || meta.type == type.value());
+}
+
+/* whether text (a tag name, filename or path) is selected by a rule's <text> */
+bool rule_text_matches(const search_rule_t &search_rule, const std::regex *rg, std::string_view text, std::uint64_t &regex_evals) {
+    if (search_rule.opt == search_opt_t::exact) {
+        return text == search_rule.text;
+    }
+    if (search_rule.opt == search_opt_t::text_includes) {
+        return text.find(search_rule.text) != std::string_view::npos;
+    }
+    regex_evals++;
+    return std::regex_search(text.begin(), text.end(), *rg);
+}
+
+/* a bit for every tag and file ordinal of store, nothing selected */
+static query_result_t empty_result(const store_t &store) {
+    return query_result_t{
+        .store = &store,
+        .tags_returned = bitset_t(store.parsed_order.size()),
+        .tags_matched = bitset_t(store.parsed_order.size()),
+        .files_returned = bitset_t(store.file_ordinals),
+        .files_matched = bitset_t(store.file_ordinals)
+    };
+}
+
+query_result_t query_t::run(const store_t &store) const {
+    const std::map<tid_t, tag_t, tagcmp_t> &tags = store.tags;
+    const file_index_t &file_index = store.file_index;
+    query_result_t result = empty_result(store);
+    bitset_t &tags_returned = result.tags_returned;
+    bitset_t &tags_matched = result.tags_matched;
+    bitset_t &files_returned = result.files_returned;
+    bitset_t &files_matched = result.files_matched;
+    std::vector<search_rule_t> search_rules = rules;
+    if (search_rules.empty()) {
+        search_rules.push_back(search_rule_t{search_rule_type_t::all_list});
+    }
+    /* every file in index order, made for the first file rule */
+    std::vector<const file_info_t *> file_slots;
+    for (const search_rule_t &search_rule : search_rules) {
+        bool exclude = search_rule.type == search_rule_type_t::tag_exclude || search_rule.type == search_rule_type_t::file_exclude || search_rule.type == search_rule_type_t::all_exclude || search_rule.type == search_rule_type_t::all_list_exclude || search_rule.type == search_rule_type_t::inode_exclude;
+        bool is_file = search_rule.type == search_rule_type_t::file || search_rule.type == search_rule_type_t::file_exclude;
+        bool is_tag = search_rule.type == search_rule_type_t::tag || search_rule.type == search_rule_type_t::tag_exclude;
+        bool is_all = search_rule.type == search_rule_type_t::all || search_rule.type == search_rule_type_t::all_exclude;
+        bool is_all_list = search_rule.type == search_rule_type_t::all_list || search_rule.type == search_rule_type_t::all_list_exclude;
+        bool is_inode = search_rule.type == search_rule_type_t::inode || search_rule.type == search_rule_type_t::inode_exclude;
+        if (is_all_list) {
+            tags_returned.fill(store.parsed_order.size(), !exclude);
+            tags_matched.fill(store.parsed_order.size(), !exclude);
+            files_returned.fill(store.file_ordinals, !exclude);
+            files_matched.fill(store.file_ordinals, !exclude);
+        } else if (is_inode) {
+            if (search_rule.inum.dev != 0) {
+                auto it = file_index.find(search_rule.inum);
+                if (it != file_index.end()) {
+                    files_returned.set(it->second.ordinal, !exclude);
+                }
+            } else {
+                /* the inode number on every device, one lookup per shard */
+                for (auto it = file_index.begin(); it != file_index.end(); it = store.shard(it->first.dev).end()) {
+                    auto fit = file_index.find(file_id_t{it->first.dev, search_rule.inum.ino});
+                    if (fit != file_index.end()) {
+                        files_returned.set(fit->second.ordinal, !exclude);
+                    }
+                }
+            }
+        } else if (is_file) {
+            /* the rules that test every file, each worker over its own range of the index. hits are kept per file in
+             * index order and applied afterwards on this thread, so the result doesn't depend on the split */
+            if (file_slots.empty()) {
+                file_slots.reserve(file_index.size());
+                for (const auto &[file_id, file_info] : file_index) {
+                    file_slots.push_back(&file_info);
+                }
+            }
+            std::optional<std::regex> rg;
+            if (search_rule.opt == search_opt_t::regex) {
+                rg.emplace(search_rule.text);
+            }
+            std::vector<std::uint8_t> hits(file_slots.size(), 0);
+            std::vector<std::uint64_t> regex_evals(range_count(file_slots.size(), parallel_min_files), 0);
+            parallel_ranges(file_slots.size(), parallel_min_files, [&](std::size_t part, std::size_t begin, std::size_t end) {
+                for (std::size_t i = begin; i < end; i++) {
+                    const file_info_t &file_info = *file_slots[i];
+                    hits[i] = rule_text_matches(search_rule, rg ? &rg.value() : nullptr, search_file_path ? std::string_view(file_info.pathstr) : file_info.filename(), regex_evals[part]);
+                }
+            });
+            for (std::size_t i = 0; i < hits.size(); i++) {
+                if (hits[i]) {
+                    files_returned.set(file_slots[i]->ordinal, !exclude);
+                    files_matched.set(file_slots[i]->ordinal, !exclude);
+                }
+            }
+            profile.files_scanned += file_slots.size();
+            profile.regex_evals += std::accumulate(regex_evals.begin(), regex_evals.end(), std::uint64_t{0});
+        } else if (search_rule.opt == search_opt_t::exact) {
+            if (is_tag) {
+                for (const auto &[id, tag] : tags) {
+                    if (!tag.enabled) { continue; }
+                    if (tag.name == search_rule.text) {
+                        tags_returned.set(tag.ordinal, !exclude);
+                        tags_matched.set(tag.ordinal, !exclude);
+                        set_tag_files(store, tag, files_returned, !exclude);
+                    }
+                }
+            } else if (is_all) {
+                for (const auto &[id, tag] : tags) {
+                    if (!tag.enabled) { continue; }
+                    if (tag.name == search_rule.text) {
+                        tags_matched.set(tag.ordinal, !exclude);
+                        tags_returned.set(tag.ordinal, !exclude);
+                        std::vector<tid_t> tags_visited;
+                        add_all(store, id, tags_visited, tags_returned, files_returned, exclude);
+                    }
+                }
+            }
+        } else if (search_rule.opt == search_opt_t::text_includes) {
+            if (is_tag) {
+                for (const auto &[id, tag] : tags) {
+                    if (!tag.enabled) { continue; }
+                    if (tag.name.find(search_rule.text) != std::string::npos) {
+                        tags_returned.set(tag.ordinal, !exclude);
+                        tags_matched.set(tag.ordinal, !exclude);
+                        set_tag_files(store, tag, files_returned, !exclude);
+                    }
+                }
+            } else if (is_all) {
+                for (const auto &[id, tag] : tags) {
+                    if (!tag.enabled) { continue; }
+                    if (tag.name.find(search_rule.text) != std::string::npos) {
+                        tags_returned.set(tag.ordinal, !exclude);
+                        tags_matched.set(tag.ordinal, !exclude);
+                        std::vector<tid_t> tags_visited;
+                        add_all(store, id, tags_visited, tags_returned, files_returned, exclude);
+                    }
+                }
+            }
+        } else if (search_rule.opt == search_opt_t::regex) {
+            std::regex rg(search_rule.text);
+            if (is_tag) {
+                for (const auto &[id, tag] : tags) {
+                    if (!tag.enabled) { continue; }
+                    profile.regex_evals++;
+                    if (std::regex_search(tag.name, rg)) {
+                        tags_returned.set(tag.ordinal, !exclude);
+                        tags_matched.set(tag.ordinal, !exclude);
+                        set_tag_files(store, tag, files_returned, !exclude);
+                    }
+                }
+            } else if (is_all) {
+                for (const auto &[id, tag] : tags) {
+                    if (!tag.enabled) { continue; }
+                    profile.regex_evals++;
+                    if (std::regex_search(tag.name, rg)) {
+                        tags_returned.set(tag.ordinal, !exclude);
+                        tags_matched.set(tag.ordinal, !exclude);
+                        std::vector<tid_t> tags_visited;
+                        add_all(store, id, tags_visited, tags_returned, files_returned, exclude);
+                    }
+                }
+            }
+        }
+    }
+    if (!meta_filter.empty()) {
+        for (const auto &[file_id, file_info] : file_index) {
+            if (files_returned.test(file_info.ordinal) && !meta_filter.passes(file_info)) {
+                files_returned.set(file_info.ordinal, false);
+                files_matched.set(file_info.ordinal, false);
+            }
+        }
+    }
+    return result;
+}
+
+
+/* a query's rules as per-file tests, tag rules having selected their tags up front. the per-file evaluation of
+ * stream, and of virtual tags (whose searches skip the virtual tags) */
+struct query_plan_t {
+    struct rule_t {
+        search_rule_t rule;
+        bool exclude = false;
+        bool sets_matched = false; /* file and all_list rules, as in run */
+        std::optional<std::regex> rg;
+        std::unordered_set<tid_t> tags; /* for tag and all rules, a file is selected if it has any of these */
+    };
+
+    std::vector<rule_t> rules;
+    bool search_file_path = false;
+
+    query_plan_t(const store_t &store, const std::vector<search_rule_t> &search_rules, bool search_file_path, bool skip_virtual = false) : search_file_path(search_file_path) {
+        rules.reserve(std::max<std::size_t>(search_rules.size(), 1));
+        if (search_rules.empty()) {
+            rules.push_back(rule_t{search_rule_t{search_rule_type_t::all_list}, false, true});
+        }
+        for (const search_rule_t &search_rule : search_rules) {
+            rule_t &prule = rules.emplace_back(rule_t{search_rule});
+            const search_rule_type_t type = search_rule.type;
+            prule.exclude = type == search_rule_type_t::tag_exclude || type == search_rule_type_t::file_exclude || type == search_rule_type_t::all_exclude || type == search_rule_type_t::all_list_exclude || type == search_rule_type_t::inode_exclude;
+            prule.sets_matched = type == search_rule_type_t::file || type == search_rule_type_t::file_exclude || type == search_rule_type_t::all_list || type == search_rule_type_t::all_list_exclude;
+            const bool is_tag = type == search_rule_type_t::tag || type == search_rule_type_t::tag_exclude;
+            const bool is_all = type == search_rule_type_t::all || type == search_rule_type_t::all_exclude;
+            if (search_rule.opt == search_opt_t::regex && (is_tag || is_all || prule.sets_matched)) {
+                prule.rg.emplace(search_rule.text);
+            }
+            if (!is_tag && !is_all) { continue; }
+            const auto selectable = [&](tid_t id) {
+                return store.tags.at(id).enabled && !(skip_virtual && store.virtual_tags.contains(id));
+            };
+            std::vector<tid_t> pending;
+            std::uint64_t regex_evals = 0;
+            for (const auto &[id, tag] : store.tags) {
+                if (selectable(id) && rule_text_matches(search_rule, prule.rg ? &prule.rg.value() : nullptr, tag.name, regex_evals)) {
+                    pending.push_back(id);
+                }
+            }
+            profile.regex_evals += regex_evals;
+            /* all rules also take the enabled subtags, transitively */
+            while (!pending.empty()) {
+                const tid_t id = pending.back();
+                pending.pop_back();
+                if (!prule.tags.insert(id).second || !is_all) { continue; }
+                for (const tid_t &sub : store.tags.at(id).sub) {
+                    if (selectable(sub)) {
+                        pending.push_back(sub);
+                    }
+                }
+            }
+        }
+    }
+
+    /* whether the rules return the file, matched set to what files_matched would say. regex_evals counts up for the
+     * caller to add to the profile once, the counter is shared by every thread */
+    bool returns(const file_info_t &file_info, bool &matched, std::uint64_t &regex_evals) const {
+        const file_id_t &file_id = file_info.file_id;
+        bool returned = false;
+        matched = false;
+        for (const rule_t &prule : rules) {
+            bool selected = false;
+            switch (prule.rule.type) {
+            case search_rule_type_t::all_list:
+            case search_rule_type_t::all_list_exclude:
+                selected = true;
+                break;
+            case search_rule_type_t::inode:
+            case search_rule_type_t::inode_exclude:
+                selected = file_id.ino == prule.rule.inum.ino && (prule.rule.inum.dev == 0 || file_id.dev == prule.rule.inum.dev);
+                break;
+            case search_rule_type_t::file:
+            case search_rule_type_t::file_exclude:
+                selected = rule_text_matches(prule.rule, prule.rg ? &prule.rg.value() : nullptr, search_file_path ? std::string_view(file_info.pathstr) : file_info.filename(), regex_evals);
+                break;
+            default:
+                selected = std::any_of(file_info.tags.begin(), file_info.tags.end(), [&prule](const tid_t &id) { return prule.tags.contains(id); });
+                break;
+            }
+            if (!selected) { continue; }
+            returned = !prule.exclude;
+            if (prule.sets_matched) {
+                matched = !prule.exclude;
+            }
+        }
+        return returned;
+    }
+};
+
+std::size_t query_t::stream(const store_t &store, const std::function<bool(const file_info_t &file_info, bool matched)> &emit) const {
+    const query_plan_t plan(store, rules, search_file_path);
+    std::size_t emitted = 0;
+    std::uint64_t regex_evals = 0;
+    for (const auto &[file_id, file_info] : store.file_index) {
+        profile.files_scanned++;
+        bool matched = false;
+        if (!plan.returns(file_info, matched, regex_evals) || !meta_filter.passes(file_info)) { continue; }
+        emitted++;
+        if (!emit(file_info, matched)) { break; }
+    }
+    profile.regex_evals += regex_evals;
+    return emitted;
+}
+
+void store_t::touch_file(file_id_t file_id) {
+    if (!virtual_tags.empty()) {
+        virtual_dirty.insert(file_id);
+    }
+}
+
+void store_t::touch_tag(const tag_t &tag) {
+    if (virtual_tags.empty()) { return; }
+    /* the files an all rule reaches through the tag, so the subtags' too */
+    std::unordered_set<tid_t> visited;
+    std::vector<tid_t> pending = {tag.id};
+    while (!pending.empty()) {
+        const tid_t id = pending.back();
+        pending.pop_back();
+        if (!visited.insert(id).second) { continue; }
+        const tag_t &t = tags.at(id);
+        virtual_dirty.insert(t.files.begin(), t.files.end());
+        pending.insert(pending.end(), t.sub.begin(), t.sub.end());
+    }
+}
+
+void store_t::refresh_virtual_tag(tag_t &tag, const virtual_tag_t &virtual_tag, const std::vector<file_id_t> &file_ids) {
+    const query_plan_t plan(*this, virtual_tag.rules, virtual_tag.search_file_path, true);
+    /* set_virtual hands over the whole index, tested in parallel like query_t::count */
+    std::vector<std::uint8_t> hits(file_ids.size(), 0);
+    std::vector<std::uint64_t> regex_evals(range_count(file_ids.size(), parallel_min_files), 0);
+    parallel_ranges(file_ids.size(), parallel_min_files, [&](std::size_t part, std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; i++) {
+            auto it = file_index.find(file_ids[i]);
+            bool matched = false;
+            hits[i] = it != file_index.end() && plan.returns(it->second, matched, regex_evals[part]);
+        }
+    });
+    profile.files_scanned += file_ids.size();
+    profile.regex_evals += std::accumulate(regex_evals.begin(), regex_evals.end(), std::uint64_t{0});
+    std::vector<file_id_t> in, out;
+    for (std::size_t i = 0; i < file_ids.size(); i++) {
+        (hits[i] ? in : out).push_back(file_ids[i]);
+    }
+    tag_files(tag, in, nullptr);
+    untag_files(tag, out, nullptr);
+}
+
+void store_t::refresh_virtual() {
+    if (virtual_tags.empty() || virtual_dirty.empty()) { return; }
+    profile_phase_t phase("refresh_virtual");
+    std::vector<file_id_t> file_ids(virtual_dirty.begin(), virtual_dirty.end());
+    std::sort(file_ids.begin(), file_ids.end());
+    for (const auto &[id, virtual_tag] : virtual_tags) {
+        refresh_virtual_tag(tags.at(id), virtual_tag, file_ids);
+    }
+    virtual_dirty.clear();
+}
+
+bool store_t::set_virtual(tag_t &tag, const virtual_tag_t &virtual_tag) {
+    try {
+        const query_plan_t plan(*this, virtual_tag.rules, virtual_tag.search_file_path, true);
+    } catch (const std::regex_error &e) {
+        error = format_str("virtual tag \"%s\" has a bad regex: %s", tag.name.c_str(), e.what());
+        return false;
+    }
+    virtual_tags[tag.id] = virtual_tag;
+    tags_changed = true;
+    std::vector<file_id_t> file_ids = tag.files;
+    file_ids.reserve(file_ids.size() + file_index.size());
+    for (const auto &[file_id, _] : file_index) {
+        file_ids.push_back(file_id);
+    }
+    refresh_virtual_tag(tag, virtual_tag, file_ids);
+    return true;
+}
+
+void store_t::clear_virtual(tag_t &tag) {
+    if (virtual_tags.erase(tag.id) > 0) {
+        tags_changed = true;
+    }
+}
+
+std::vector<std::pair<tid_t, std::uint64_t>> query_count_t::facets(const store_t &store, std::size_t k) const {
+    /* collected in tags order so the position breaks ties, only the top k then need to be ordered */
+    std::vector<std::pair<tid_t, std::uint64_t>> ret;
+    ret.reserve(by_tag.size());
+    for (const auto &[id, _] : store.tags) {
+        auto it = by_tag.find(id);
+        if (it != by_tag.end()) {
+            ret.emplace_back(id, it->second);
+        }
+    }
+    std::vector<std::uint32_t> order(ret.size());
+    for (std::uint32_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    if (k == 0 || k > order.size()) {
+        k = order.size();
+    }
+    std::partial_sort(order.begin(), order.begin() + k, order.end(), [&ret](std::uint32_t a, std::uint32_t b) {
+        return ret[a].second != ret[b].second ? ret[a].second > ret[b].second : a < b;
+    });
+    std::vector<std::pair<tid_t, std::uint64_t>> top;
+    top.reserve(k);
+    for (std::size_t i = 0; i < k; i++) {
+        top.push_back(ret[order[i]]);
+    }
+    return top;
+}
+
+query_count_t query_t::count(const store_t &store, bool by_tag) const {
+    if (!by_tag && store.file_index.size() == store.file_ordinals) {
+        return query_count_t{.files = run(store).files_returned.count()};
+    }
+    /* what stream would emit, counted per range of the index on every worker and summed */
+    const query_plan_t plan(store, rules, search_file_path);
+    std::vector<const file_info_t *> files;
+    files.reserve(store.file_index.size());
+    for (const auto &[file_id, file_info] : store.file_index) {
+        files.push_back(&file_info);
+    }
+    std::vector<query_count_t> counts(range_count(files.size(), parallel_min_files));
+    std::vector<std::uint64_t> regex_evals(counts.size(), 0);
+    parallel_ranges(files.size(), parallel_min_files, [&](std::size_t part, std::size_t begin, std::size_t end) {
+        query_count_t &count = counts[part];
+        for (std::size_t i = begin; i < end; i++) {
+            const file_info_t &file_info = *files[i];
+            bool matched = false;
+            if (!plan.returns(file_info, matched, regex_evals[part]) || !meta_filter.passes(file_info)) { continue; }
+            count.files++;
+            if (by_tag) {
+                for (const tid_t &id : file_info.tags) {
+                    count.by_tag[id]++;
+                }
+                count.untagged += file_info.tags.empty();
+            }
+        }
+    });
+    profile.files_scanned += files.size();
+    profile.regex_evals += std::accumulate(regex_evals.begin(), regex_evals.end(), std::uint64_t{0});
+    query_count_t ret = std::move(counts[0]);
+    for (std::size_t part = 1; part < counts.size(); part++) {
+        ret.files += counts[part].files;
+        ret.untagged += counts[part].untagged;
+        for (const auto &[id, n] : counts[part].by_tag) {
+            ret.by_tag[id] += n;
+        }
+    }
+    return ret;
+}
+
+std::string query_t::key() const {
+    std::vector<search_rule_t> normal;
+    for (const search_rule_t &rule : rules) {
+        search_rule_t kept{rule.type};
+        switch (rule.type) {
+            case search_rule_type_t::all_list:
+            case search_rule_type_t::all_list_exclude:
+                normal.clear();
+                break;
+            case search_rule_type_t::inode:
+            case search_rule_type_t::inode_exclude:
+                kept.inum = rule.inum;
+                break;
+            default:
+                kept.opt = rule.opt;
+                kept.text = rule.text;
+        }
+        if (!normal.empty() && normal.back().type == kept.type && normal.back().opt == kept.opt && normal.back().text == kept.text && normal.back().inum == kept.inum) {
+            continue;
+        }
+        normal.push_back(kept);
+    }
+    if (normal.empty()) {
+        normal.push_back(search_rule_t{search_rule_type_t::all_list}); /* what no rules means */
+    }
+    std::string ret;
+    bool file_rules = false;
+    for (const search_rule_t &rule : normal) {
+        /* text is length prefixed, it can have any character */
+        ret += format_str("%u,%u,%s,%zu:", static_cast<unsigned>(rule.type), static_cast<unsigned>(rule.opt), file_id_str(rule.inum).c_str(), rule.text.size()) + rule.text + ';';
+        file_rules = file_rules || rule.type == search_rule_type_t::file || rule.type == search_rule_type_t::file_exclude;
+    }
+    if (file_rules && search_file_path) {
+        ret += "path;";
+    }
+    if (!meta_filter.empty()) {
+        const auto opt_str = [](const auto &value) { return value ? std::to_string(value.value()) : std::string(); };
+        ret += "meta:" + opt_str(meta_filter.larger_than) + ',' + opt_str(meta_filter.smaller_than) + ',' + opt_str(meta_filter.modified_after)
+            + ',' + opt_str(meta_filter.modified_before) + ',' + (meta_filter.type ? std::string(1, meta_filter.type.value()) : std::string()) + ';';
+    }
+    return ret;
+}
+
+
+/* [generation];[tags file size],[mtime in ns];[index file and every shard's size],[mtime in ns],...;[device, empty for all]\0
+ * [query key]\0
+ * then for every tag and file the result selects, [t (tag) or f (file)][r (returned), m (matched) or b (both)]:[tag
+ * name or inode number]\0
+ *
+ * (every \0 followed by a \n) */
+query_cache_t::query_cache_t(const store_t &store) : dir(store.index_file + ".querycache") {}
+
+/* the store as of its generation, with the size and mtime of the tags file and of every index shard, as neither a hand
+ * edit nor an older ftag (which doesn't keep the generation) bumps it */
+static std::string store_stamp(const store_t &store) {
+    const auto file_stamp = [](const std::string &filename) {
+        struct stat buffer{};
+        if (!file_exists(filename, &buffer)) { return std::string(","); }
+        return format_str("%lu,%ld", static_cast<unsigned long>(buffer.st_size), static_cast<long>(file_meta_of(buffer).mtime));
+    };
+    std::string ret = format_str("%lu;", static_cast<unsigned long>(store.generation)) + file_stamp(store.tags_file) + ';' + file_stamp(store.shard_file(0));
+    for (const dev_t dev : store.shard_devices()) {
+        ret += ',' + file_stamp(store.shard_file(dev));
+    }
+    return ret + ';' + (store.device ? std::to_string(store.device.value()) : std::string());
+}
+
+static std::string query_cache_file(const std::string &dir, const store_t &store, const std::string &key) {
+    const std::string device = store.device ? std::to_string(store.device.value()) : std::string();
+    return dir + '/' + format_str("%016lx", static_cast<unsigned long>(hash_bytes(key.data(), key.size(), hash_bytes(device.data(), device.size()))));
+}
+
+bool query_cache_t::load(const store_t &store, const query_t &query, query_result_t &result) const {
+    if (!query.cacheable()) { return false; }
+    const std::string key = query.key();
+    const std::string filename = query_cache_file(dir, store, key);
+    if (!file_exists(filename)) { return false; }
+    profile_phase_t phase("load_query_cache");
+    const std::string content = get_file_content(filename);
+    std::vector<std::string_view> records;
+    for (std::size_t begin = 0; begin < content.size();) {
+        const std::size_t end = std::min(content.find(index_delim, begin), content.size());
+        records.emplace_back(content.data() + begin, end - begin);
+        begin = end + index_delim.size();
+    }
+    if (records.size() < 2 || records[0] != store_stamp(store) || records[1] != key) { return false; }
+
+    query_result_t ret = empty_result(store);
+    std::unordered_map<std::string_view, std::uint32_t> tag_ordinals;
+    for (const auto &[id, tag] : store.tags) {
+        tag_ordinals.emplace(tag.name, tag.ordinal);
+    }
+    for (std::size_t ri = 2; ri < records.size(); ri++) {
+        const std::string_view record = records[ri];
+        if (record.size() < 4 || record[2] != ':') { return false; }
+        const bool returned = record[1] != 'm', matched = record[1] != 'r';
+        if (record[0] == 't') {
+            auto it = tag_ordinals.find(record.substr(3));
+            if (it == tag_ordinals.end()) { return false; }
+            ret.tags_returned.set(it->second, returned);
+            ret.tags_matched.set(it->second, matched);
+        } else {
+            file_id_t file_id;
+            if (!parse_file_id(std::string(record.substr(3)), file_id)) { return false; }
+            auto it = store.file_index.find(file_id);
+            if (it == store.file_index.end()) { return false; }
+            ret.files_returned.set(it->second.ordinal, returned);
+            ret.files_matched.set(it->second.ordinal, matched);
+        }
+    }
+    result = std::move(ret);
+    return true;
+}
+
+void query_cache_t::dump(const store_t &store, const query_t &query, const query_result_t &result) const {
+    if (!query.cacheable()) { return; }
+    profile_phase_t phase("dump_query_cache");
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    if (ec) { return; }
+    const std::string key = query.key();
+    const std::string delim(index_delim);
+    std::string content = store_stamp(store) + delim + key + delim;
+    const auto flags = [](bool returned, bool matched) { return returned ? (matched ? 'b' : 'r') : 'm'; };
+    for (const auto &[id, tag] : store.tags) {
+        const bool returned = result.returned(tag), matched = result.matched(tag);
+        if (!returned && !matched) { continue; }
+        content += std::string{'t', flags(returned, matched), ':'} + tag.name + delim;
+    }
+    for (const auto &[file_id, file_info] : store.file_index) {
+        const bool returned = result.returned(file_info), matched = result.matched(file_info);
+        if (!returned && !matched) { continue; }
+        content += std::string{'f', flags(returned, matched), ':'} + file_id_str(file_id) + delim;
+    }
+    /* written aside and renamed over, so a concurrent search reads either the old entry or the new one */
+    const std::string filename = query_cache_file(dir, store, key);
+    const std::string temp_filename = filename + ".tmp" + std::to_string(getpid());
+    {
+        std::ofstream file(temp_filename, std::ios::binary);
+        file << content;
+        if (!file) {
+            std::filesystem::remove(temp_filename, ec);
+            return;
+        }
+    }
+    std::filesystem::rename(temp_filename, filename, ec);
+    profile.bytes_written += content.size();
+
+    /* another search's temp file is only removed once it is old enough to have been left by a crash */
+    const auto now = std::filesystem::file_time_type::clock::now();
+    std::vector<std::pair<std::filesystem::file_time_type, std::filesystem::path>> entries;
+    for (const auto &entry : std::filesystem::directory_iterator(dir, ec)) {
+        const std::filesystem::file_time_type mtime = entry.last_write_time(ec);
+        if (entry.path().filename().string().find(".tmp") != std::string::npos) {
+            if (!ec && now - mtime > temp_max_age) {
+                std::filesystem::remove(entry.path(), ec);
+            }
+            continue;
+        }
+        entries.emplace_back(mtime, entry.path());
+    }
+    if (entries.size() <= max_entries) { return; }
+    std::sort(entries.begin(), entries.end());
+    for (std::size_t i = 0; i < entries.size() - max_entries; i++) {
+        std::filesystem::remove(entries[i].second, ec);
+    }
+}
+
+
+/* --- symlink tree manifest structure ---
+ *
+ * [generation];[tags file size],[mtime in ns];[index file and every shard's size],[mtime in ns],...;\0
+ * then d:[directory, relative to the exported directory]\0 for every directory,
+ * and l:[link, relative to the exported directory]\0[target]\0 for every link
+ *
+ * (every \0 followed by a \n) */
+static const std::string export_manifest_name = ".ftag-export";
+
+bool store_t::export_symlink_tree(const std::filesystem::path &dir, export_stats_t &stats) {
+    const std::string manifest_file = (dir / export_manifest_name).string();
+    const std::string stamp = store_stamp(*this);
+    const std::string delim(index_delim);
+
+    std::set<std::string> old_dirs;
+    std::map<std::string, std::string> old_links;
+    if (file_exists(manifest_file)) {
+        profile_phase_t phase("load_export");
+        const std::string content = get_file_content(manifest_file);
+        std::vector<std::string> records;
+        for (std::size_t begin = 0; begin < content.size();) {
+            const std::size_t end = std::min(content.find(index_delim, begin), content.size());
+            records.push_back(content.substr(begin, end - begin));
+            begin = end + index_delim.size();
+        }
+        for (std::size_t ri = 1; ri < records.size(); ri++) {
+            const std::string &record = records[ri];
+            if (record.starts_with("d:")) {
+                old_dirs.insert(record.substr(2));
+            } else if (record.starts_with("l:") && ri + 1 < records.size()) {
+                old_links[record.substr(2)] = records[++ri];
+            } else {
+                error = format_str("export manifest \"%s\" record %zu could not be parsed", manifest_file.c_str(), ri + 1);
+                return false;
+            }
+        }
+        if (!records.empty() && records[0] == stamp) {
+            stats.links = old_links.size();
+            stats.up_to_date = true;
+            return true;
+        }
+    }
+
+    /* what the tree should be. a tag's directory reserves its subtags' names before its files are named, a file whose
+     * name is taken (or empty) gets its file id appended */
+    std::set<std::string> dirs;
+    std::map<std::string, std::string> links;
+    {
+        profile_phase_t phase("plan_export");
+        const auto name_ok = [this](const tag_t &tag) {
+            if (tag.name == "." || tag.name == ".." || tag.name == export_manifest_name || tag.name.find('/') != std::string::npos) {
+                warn(format_str("tag \"%s\" can't be a directory name, skipping", tag.name.c_str()));
+                return false;
+            }
+            return true;
+        };
+        struct placement_t {
+            tid_t id;
+            std::string path;
+            std::vector<tid_t> chain; /* the supertags it was reached through, so loops end */
+        };
+        std::vector<placement_t> pending;
+        std::unordered_set<tid_t> placed;
+        for (int pass = 0; pass < 2; pass++) {
+            /* tags without enabled supertags first, then the tags only reachable through loops */
+            for (auto it = tags.rbegin(); it != tags.rend(); ++it) {
+                const tag_t &tag = it->second;
+                if (!tag.enabled || placed.contains(tag.id) || (pass == 0 && !enabled_only(tag.super).empty())) { continue; }
+                if (!name_ok(tag)) { continue; }
+                pending.push_back(placement_t{tag.id, tag.name, {}});
+            }
+            while (!pending.empty()) {
+                placement_t placement = std::move(pending.back());
+                pending.pop_back();
+                const tag_t &tag = tags.at(placement.id);
+                placed.insert(tag.id);
+                dirs.insert(placement.path);
+                placement.chain.push_back(tag.id);
+
+                std::unordered_set<std::string> names;
+                const std::vector<tid_t> subs = enabled_only(tag.sub);
+                for (auto sit = subs.rbegin(); sit != subs.rend(); ++sit) {
+                    const tag_t &sub = tags.at(*sit);
+                    if (std::find(placement.chain.begin(), placement.chain.end(), sub.id) != placement.chain.end() || !name_ok(sub)) { continue; }
+                    names.insert(sub.name);
+                    pending.push_back(placement_t{sub.id, placement.path + '/' + sub.name, placement.chain});
+                }
+                std::vector<file_id_t> file_ids = tag.files;
+                std::sort(file_ids.begin(), file_ids.end());
+                for (const file_id_t &file_id : file_ids) {
+                    auto fit = file_index.find(file_id);
+                    if (fit == file_index.end() || fit->second.unresolved()) { continue; }
+                    profile.files_scanned++;
+                    std::string name(fit->second.filename());
+                    if (name.empty() || name == "." || name == ".." || !names.insert(name).second) {
+                        name += '~' + file_id_str(file_id);
+                        names.insert(name);
+                    }
+                    links.emplace(placement.path + '/' + name, fit->second.pathstr);
+                }
+            }
+        }
+    }
+
+    profile_phase_t phase("apply_export");
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    if (ec) {
+        error = format_str("directory \"%s\" could not be made: %s", dir.c_str(), ec.message().c_str());
+        return false;
+    }
+    /* removed before anything is made, a name can go from link to directory or back */
+    for (const auto &[path, target] : old_links) {
+        auto it = links.find(path);
+        if (it != links.end() && it->second == target) { continue; }
+        const std::filesystem::path link = dir / path;
+        if (std::filesystem::is_symlink(std::filesystem::symlink_status(link, ec))) {
+            std::filesystem::remove(link, ec);
+            stats.removed++;
+        }
+    }
+    /* deepest first, and only once empty */
+    for (auto it = old_dirs.rbegin(); it != old_dirs.rend(); ++it) {
+        if (!dirs.contains(*it)) {
+            std::filesystem::remove(dir / *it, ec);
+        }
+    }
+    for (const std::string &path : dirs) {
+        if (old_dirs.contains(path)) { continue; }
+        std::filesystem::create_directory(dir / path, ec);
+        if (ec) {
+            error = format_str("directory \"%s\" could not be made: %s", (dir / path).c_str(), ec.message().c_str());
+            return false;
+        }
+    }
+    std::vector<std::string> skipped;
+    for (const auto &[path, target] : links) {
+        auto it = old_links.find(path);
+        if (it != old_links.end() && it->second == target) { continue; }
+        const std::filesystem::path link = dir / path;
+        std::filesystem::create_symlink(target, link, ec);
+        if (!ec) {
+            stats.created++;
+            continue;
+        }
+        /* a link to the same file is taken over as made, anything else is left */
+        const std::filesystem::file_status status = std::filesystem::symlink_status(link, ec);
+        if (!std::filesystem::exists(status)) {
+            warn(format_str("link \"%s\" could not be made: %s, skipping", link.c_str(), ec.message().c_str()));
+            skipped.push_back(path);
+        } else if (!std::filesystem::is_symlink(status) || std::filesystem::read_symlink(link, ec) != target) {
+            warn(format_str("path \"%s\" is taken by something not made by an export, skipping", link.c_str()));
+            skipped.push_back(path);
+        }
+    }
+    for (const std::string &path : skipped) {
+        links.erase(path);
+    }
+    stats.skipped = skipped.size();
+    stats.links = links.size();
+
+    std::string content = stamp + delim;
+    for (const std::string &path : dirs) {
+        content += "d:" + path + delim;
+    }
+    for (const auto &[path, target] : links) {
+        content += "l:" + path + delim + target + delim;
+    }
+    const std::string temp_filename = manifest_file + ".tmp" + std::to_string(getpid());
+    {
+        std::ofstream file(temp_filename, std::ios::binary);
+        file << content;
+        if (!file) {
+            std::filesystem::remove(temp_filename, ec);
+            error = format_str("export manifest \"%s\" could not be written", manifest_file.c_str());
+            return false;
+        }
+    }
+    std::filesystem::rename(temp_filename, manifest_file, ec);
+    profile.bytes_written += content.size();
+    return true;
+}
+
+
+void sort_files(const store_t &store, std::vector<file_id_t> &file_ids, sort_key_t key, bool reverse) {
+    if (key == sort_key_t::none || file_ids.size() < 2) { return; }
+    profile_phase_t phase("sort");
+    std::vector<const file_info_t *> infos(file_ids.size(), nullptr);
+    for (std::size_t i = 0; i < file_ids.size(); i++) {
+        auto it = store.file_index.find(file_ids[i]);
+        if (it != store.file_index.end()) {
+            infos[i] = &it->second;
+        }
+    }
+    std::vector<std::uint32_t> order(file_ids.size());
+    for (std::uint32_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+
+    if (key == sort_key_t::name || key == sort_key_t::path) {
+        std::vector<std::string_view> keys(file_ids.size());
+        for (std::size_t i = 0; i < keys.size(); i++) {
+            if (infos[i] == nullptr) { continue; }
+            keys[i] = key == sort_key_t::name ? infos[i]->filename() : std::string_view(infos[i]->pathstr);
+        }
+        std::stable_sort(order.begin(), order.end(), [&keys, reverse](std::uint32_t a, std::uint32_t b) {
+            return reverse ? keys[b] < keys[a] : keys[a] < keys[b];
+        });
+    } else {
+        std::vector<std::uint64_t> keys(file_ids.size(), 0);
+        std::vector<std::uint8_t> keyless(file_ids.size(), 0); /* not indexed, or no metadata for size and mtime */
+        const auto flip = [&keys, reverse]() {
+            if (!reverse) { return; }
+            for (std::uint64_t &k : keys) {
+                k = ~k;
+            }
+        };
+        if (key == sort_key_t::inode) { /* two stable passes, the lower half of the key first */
+            for (std::size_t i = 0; i < keys.size(); i++) {
+                keys[i] = file_ids[i].ino;
+            }
+            flip();
+            radix_sort_order(keys, order);
+            for (std::size_t i = 0; i < keys.size(); i++) {
+                keys[i] = file_ids[i].dev;
+            }
+        } else {
+            for (std::size_t i = 0; i < keys.size(); i++) {
+                if (infos[i] == nullptr) {
+                    keyless[i] = 1;
+                    continue;
+                }
+                if (key == sort_key_t::tags) {
+                    keys[i] = infos[i]->tags.size();
+                    continue;
+                }
+                std::optional<file_meta_t> meta = infos[i]->meta;
+                struct stat buffer{};
+                if (!meta && file_exists(infos[i]->pathstr, &buffer)) {
+                    meta = file_meta_of(buffer);
+                }
+                if (!meta) {
+                    keyless[i] = 1;
+                    continue;
+                }
+                /* mtimes before the epoch are negative, the sign bit flipped keeps them first as unsigned keys */
+                keys[i] = key == sort_key_t::size ? meta->size : static_cast<std::uint64_t>(meta->mtime) ^ (std::uint64_t{1} << 63U);
+            }
+        }
+        flip();
+        radix_sort_order(keys, order);
+        /* last either way, rather than as 0 among the real values */
+        std::stable_partition(order.begin(), order.end(), [&keyless](std::uint32_t i) { return keyless[i] == 0; });
+    }
+
+    std::vector<file_id_t> sorted(file_ids.size());
+    for (std::size_t i = 0; i < order.size(); i++) {
+        sorted[i] = file_ids[order[i]];
+    }
+    file_ids.swap(sorted);
+}
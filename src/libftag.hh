@@ -0,0 +1,661 @@
+#ifndef FTAG_LIBFTAG_HH
+#define FTAG_LIBFTAG_HH
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <ranges>
+#include <set>
+#include <span>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <cstdint>
+
+#include <sys/stat.h>
+
+#include "util.hh"
+
+
+/* libftag: a tags file and index file as a store that can be opened, queried, changed and committed in process.
+ * the ftag command (src/ftag.cc) is a wrapper around it
+ *
+ * nothing here exits or prints: calls that can fail return false (or nullptr, or 0) and leave a message in
+ * store_t::error, and warnings go through store_t::warn */
+
+
+/* --- profiling ---
+ * the counters and phases behind ftag --profile, libftag adds to them whether or not profile.enabled is set */
+
+struct profile_t {
+    bool enabled = false;
+    std::string command;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::mutex phases_mutex;
+    std::vector<std::pair<std::string, double>> phases; /* name, seconds, in order of first use */
+    std::atomic<std::uint64_t> files_scanned{0}; /* index entries examined plus directory entries walked */
+    std::atomic<std::uint64_t> stat_calls{0};
+    std::atomic<std::uint64_t> regex_evals{0};
+    std::atomic<std::uint64_t> bytes_written{0}; /* stdout plus the tags and index files */
+    std::atomic<std::uint64_t> allocations{0}; /* left to the program, libftag can't see them */
+
+    void add_phase(const std::string &name, double seconds);
+
+    /* as one JSON object on a line to stderr */
+    void print();
+};
+
+extern profile_t profile; /* NOLINT */
+
+/* times the enclosing scope as phase name, phases with the same name add up */
+struct profile_phase_t {
+    const char *name;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    explicit profile_phase_t(const char *name) : name(name) {}
+    profile_phase_t(const profile_phase_t &) = delete;
+    profile_phase_t &operator=(const profile_phase_t &) = delete;
+
+    ~profile_phase_t() {
+        if (profile.enabled) {
+            const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            profile.add_phase(name, elapsed.count());
+        }
+    }
+};
+
+
+bool file_exists(const char *filename, struct stat *pbuffer = nullptr);
+inline bool file_exists(const std::string &filename, struct stat *pbuffer = nullptr) { return file_exists(filename.c_str(), pbuffer); }
+inline bool file_exists(const std::pmr::string &filename, struct stat *pbuffer = nullptr) { return file_exists(filename.c_str(), pbuffer); }
+
+inline file_id_t file_id_of(const struct stat &buffer) {
+    return file_id_t{buffer.st_dev, buffer.st_ino};
+}
+
+inline file_meta_t file_meta_of(const struct stat &buffer) {
+    return file_meta_t{
+        .size = static_cast<std::uint64_t>(buffer.st_size),
+        .mtime = static_cast<std::int64_t>(buffer.st_mtim.tv_sec) * 1000000000 + buffer.st_mtim.tv_nsec,
+        .type = S_ISREG(buffer.st_mode) ? 'f' : S_ISDIR(buffer.st_mode) ? 'd' : 'o',
+        .mode = static_cast<std::uint32_t>(buffer.st_mode & 07777U)
+    };
+}
+
+/* {} if path could not be stat-ed, meta is filled from the same stat */
+file_id_t path_get_id(const std::filesystem::path &path, file_meta_t *meta = nullptr);
+
+/* files at most 3 of these are hashed whole, larger ones by their first, middle and last fingerprint_sample bytes */
+constexpr std::uint64_t fingerprint_sample = 64 * 1024;
+
+/* the size of the file hashed with its contents (or samples), 0 if it couldn't be read */
+std::uint64_t file_fingerprint(const std::string &pathstr, std::uint64_t size);
+
+/* file_fingerprint of every (path, size), read by at most worker_count() threads at once so only that many files are
+ * open and in flight */
+std::vector<std::uint64_t> fingerprint_files(const std::vector<std::pair<std::string, std::uint64_t>> &files);
+
+
+using tags_map_t = std::map<tid_t, tag_t, tagcmp_t>;
+/* the index as sorted parallel arrays, the file ids and their files in the same order, so a full scan reads both
+ * front to back. lookups search a copy of the ids in eytzinger order (the children of slot k at 2k and 2k + 1, so
+ * every search starts on the same few cache lines). files added since the last merge wait in a buffer and erased
+ * ones are only marked, so iterators and references stay valid until merge, which loading and commit call.
+ * iterates in file id order, each entry a {first, second} like the map it replaces */
+struct file_index_t {
+    using key_type = file_id_t;
+    using mapped_type = file_info_t;
+
+    template <bool Const>
+    struct entry_t {
+        const file_id_t &first;
+        std::conditional_t<Const, const file_info_t, file_info_t> &second;
+    };
+
+    template <bool Const>
+    struct iterator_base_t {
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = entry_t<Const>;
+        using difference_type = std::ptrdiff_t;
+        using reference = entry_t<Const>;
+        using pending_iterator = std::conditional_t<Const, std::map<file_id_t, file_info_t>::const_iterator, std::map<file_id_t, file_info_t>::iterator>;
+
+        struct arrow_t {
+            entry_t<Const> entry;
+            const entry_t<Const> *operator->() const { return &entry; }
+        };
+
+        std::conditional_t<Const, const file_index_t, file_index_t> *index = nullptr;
+        std::size_t pos = 0; /* in the arrays */
+        pending_iterator pending{};
+
+        iterator_base_t() = default;
+        iterator_base_t(decltype(index) index, std::size_t pos, pending_iterator pending) : index(index), pos(pos), pending(pending) {}
+        template <bool Other, typename = std::enable_if_t<Const && !Other>>
+        iterator_base_t(const iterator_base_t<Other> &other) : index(other.index), pos(other.pos), pending(other.pending) {} /* NOLINT */
+
+        /* whether the entry is the arrays' rather than the buffer's */
+        bool in_arrays() const {
+            return pos < index->keys.size() && (pending == index->pending.end() || index->keys[pos] < pending->first);
+        }
+        reference operator*() const {
+            if (in_arrays()) {
+                return {index->keys[pos], index->infos[pos]};
+            }
+            return {pending->first, pending->second};
+        }
+        arrow_t operator->() const { return {**this}; }
+        iterator_base_t &operator++() {
+            if (in_arrays()) {
+                pos = index->next_live(pos + 1);
+            } else {
+                ++pending;
+            }
+            return *this;
+        }
+        iterator_base_t operator++(int) {
+            iterator_base_t ret = *this;
+            ++*this;
+            return ret;
+        }
+        bool operator==(const iterator_base_t &other) const { return pos == other.pos && pending == other.pending; }
+    };
+    using iterator = iterator_base_t<false>;
+    using const_iterator = iterator_base_t<true>;
+
+    iterator begin() { return {this, next_live(0), pending.begin()}; }
+    iterator end() { return {this, keys.size(), pending.end()}; }
+    const_iterator begin() const { return {this, next_live(0), pending.begin()}; }
+    const_iterator end() const { return {this, keys.size(), pending.end()}; }
+    const_iterator cbegin() const { return begin(); }
+    const_iterator cend() const { return end(); }
+
+    std::size_t size() const { return keys.size() - erased + pending.size(); }
+    bool empty() const { return size() == 0; }
+    bool contains(const file_id_t &file_id) const { return find(file_id) != end(); }
+
+    iterator find(const file_id_t &file_id);
+    const_iterator find(const file_id_t &file_id) const;
+    iterator lower_bound(const file_id_t &file_id);
+    const_iterator lower_bound(const file_id_t &file_id) const;
+    iterator upper_bound(const file_id_t &file_id);
+    const_iterator upper_bound(const file_id_t &file_id) const;
+    /* throw std::out_of_range if file_id isn't there */
+    file_info_t &at(const file_id_t &file_id);
+    const file_info_t &at(const file_id_t &file_id) const;
+    /* a default file_info_t is added to the buffer if file_id isn't there */
+    file_info_t &operator[](const file_id_t &file_id);
+
+    void erase(const_iterator it);
+    void erase(const_iterator first, const_iterator last);
+    void clear();
+    /* adds files in one pass, replacing the ones already there with the same id (the last of files wins). merges */
+    void insert(std::vector<file_info_t> files);
+    /* moves the buffered files into the arrays and drops the erased ones */
+    void merge();
+
+private:
+    std::vector<file_id_t> keys; /* sorted */
+    std::vector<file_info_t> infos;
+    std::vector<std::uint8_t> dead; /* erased since the last merge */
+    std::size_t erased = 0;
+    std::vector<file_id_t> layout; /* keys in eytzinger order, from 1 */
+    std::vector<std::uint32_t> layout_pos; /* where each of layout is in keys */
+    std::map<file_id_t, file_info_t> pending;
+
+    std::size_t next_live(std::size_t pos) const {
+        for (; pos < keys.size() && dead[pos] != 0; pos++) {}
+        return pos;
+    }
+    /* the first position in keys not less than file_id, dead or not */
+    std::size_t key_lower_bound(const file_id_t &file_id) const;
+    /* the position of file_id in keys if it's there and not erased, keys.size() otherwise */
+    std::size_t key_find(const file_id_t &file_id) const;
+    void rebuild(std::vector<file_id_t> new_keys, std::vector<file_info_t> new_infos);
+};
+
+/* usage of every tag, see store_t::stats */
+struct tag_stats_t {
+    tid_t id = 0;
+    std::uint64_t files = 0; /* tagged with it directly */
+    std::uint64_t subtree_files = 0; /* tagged with it or any of its subtags (disabled ones too), counted once each */
+    std::uint32_t depth = 0; /* supertag steps up to the nearest tag with no supertags, tags only in loops count from the first of the loop */
+};
+
+struct store_stats_t {
+    std::uint64_t files = 0;
+    std::uint64_t untagged_files = 0;
+    std::uint32_t max_depth = 0;
+    std::vector<tag_stats_t> tags; /* in tags order */
+    /* pairs of tags (positions in tags, first < second) and how many files have both, most files first */
+    std::vector<std::tuple<std::uint32_t, std::uint32_t, std::uint64_t>> co_occurrence;
+};
+
+/* what store_t::export_symlink_tree did */
+struct export_stats_t {
+    std::uint64_t links = 0; /* in the tree once done */
+    std::uint64_t created = 0;
+    std::uint64_t removed = 0;
+    std::uint64_t skipped = 0; /* paths taken by something ftag didn't make, warned about */
+    bool up_to_date = false; /* the tree was exported at this generation already, nothing was looked at */
+};
+
+/* a directory as a walk last saw it */
+struct dir_stamp_t {
+    file_id_t id;
+    std::int64_t mtime = 0; /* ns since the epoch */
+    std::int64_t ctime = 0;
+
+    bool operator==(const dir_stamp_t &) const = default;
+};
+
+/* the directories update -r walked, by path, kept next to the index file (like git's untracked cache). adding,
+ * removing or renaming an entry changes its directory's mtime and ctime, though changes to the files in it or to its
+ * subdirectories' entries don't, so a directory with the same stamp has the same entries and only its subdirectories
+ * and the indexed files in it need another look */
+struct dir_cache_t {
+    std::map<std::string, dir_stamp_t> dirs;
+    bool changed = false;
+
+    /* a missing file is an empty cache, false and error set if it could not be parsed */
+    bool load(const std::string &filename, std::string &error);
+    void dump(const std::string &filename);
+    /* calls emit(path, is_directory) for every directory under root, every other entry in a directory whose stamp
+     * changed since the last walk (or that was never walked) and every path of indexed (sorted) directly in one
+     * whose stamp didn't, then replaces the cached directories under root with the ones walked. directories changed
+     * in the last second aren't cached, they could still change within the same timestamp */
+    void walk(const std::filesystem::path &root, const std::vector<std::string> &indexed, const std::function<void(const std::filesystem::path &path, bool is_directory)> &emit);
+};
+
+/* an index entry found again somewhere else, see store_t::match_by_content and store_t::detect_moves */
+struct relocation_t {
+    file_id_t old_id;
+    file_id_t new_id;
+    std::string pathstr;
+    file_meta_t meta; /* of the file found, fingerprint included */
+};
+
+enum struct search_rule_type_t : std::uint16_t {
+    tag, tag_exclude, file, file_exclude, all, all_exclude,
+    all_list, all_list_exclude,
+    inode, inode_exclude
+};
+
+enum struct search_opt_t : std::uint16_t {
+    exact, text_includes, regex
+};
+
+struct search_rule_t {
+    search_rule_type_t type = search_rule_type_t::tag; /* doesn't matter not used */
+    search_opt_t opt = search_opt_t::exact;
+    std::string text;
+    file_id_t inum; /* dev 0 matches the inode number on any device */
+};
+
+/* "-t", "--tag", "-tr", "--tag-r" and so on (see search --HELP) as a rule type and opt, false with error set if arg is
+ * not a search rule flag */
+bool parse_search_flag(const std::string &arg, search_rule_type_t &type, search_opt_t &opt, std::string &error);
+/* the short flag parse_search_flag takes for rule, without its text */
+std::string search_flag(const search_rule_t &rule);
+
+/* the search a virtual tag keeps the result of as its files, see store_t::set_virtual */
+struct virtual_tag_t {
+    std::vector<search_rule_t> rules;
+    bool search_file_path = false;
+};
+
+enum struct lock_type_t {
+    none,
+    shared,
+    exclusive,
+};
+
+/* loops in the tag graph are discouraged but are allowed, including a tag having a supertag be itself
+ *
+ * the index is sharded per device: files of device d are in "[index_file].[d]", and index_file itself only has files
+ * with no device yet (dev 0). file_index is ordered by device first, so every shard is a contiguous range of it */
+struct store_t {
+    std::string tags_file;
+    std::string index_file;
+    /* set before open/load to only load this device's shard (and index_file), files of other devices are then left
+     * out of file_index and searches but stay referenced in the tags file */
+    std::optional<dev_t> device;
+
+    /* where the loaded files' paths and tag lists live, freed all at once by the next load or with the store instead of
+     * path by path. monotonic resources aren't thread safe, so every chunk of an index file parses into its own, and the
+     * tag lists go to link_resources[ino % their count] for the thread that links those files. before file_index so
+     * they outlive it */
+    std::deque<std::pmr::monotonic_buffer_resource> load_resources;
+    std::vector<std::pmr::memory_resource *> link_resources;
+
+    std::vector<tid_t> parsed_order; /* tag ids in the order they were read or created */
+    std::unordered_map<tid_t, std::uint32_t> tag_ordinals; /* position of every id in parsed_order, what tags is ordered by */
+    tags_map_t tags{tagcmp_t{&tag_ordinals}};
+    file_index_t file_index;
+    std::uint32_t file_ordinals = 0; /* given out to files as they are read or added, one past the last */
+    /* the tags whose files are what a search returns. their files are saved like any tag's, the mutations below note
+     * which files they might change (the file, or every file under a tag whose name, edges or state changed) and
+     * refresh_virtual tests just those against every search. virtual tags' searches don't see virtual tags */
+    std::map<tid_t, virtual_tag_t> virtual_tags;
+    std::unordered_set<file_id_t> virtual_dirty;
+
+    bool tags_changed = false; /* what commit writes, set by the mutations below */
+    std::set<dev_t> shards_changed;
+
+    /* processes share a store through flock on "[index_file].lock", which also holds its generation: how many
+     * commits it has seen. load takes a shared lock while it reads and commit an exclusive one while it writes,
+     * unless one is held already, so readers never see a half written store. commit fails if the generation changed
+     * since the last load, so hold the exclusive lock from before load to after commit to change the store without
+     * that (and with other writers waiting instead). the time spent waiting for locks is profiled as lock_wait */
+    lock_type_t held_lock = lock_type_t::none;
+    int lock_fd = -1;
+    std::uint64_t generation = 0; /* as of the last load or commit */
+
+    std::string error; /* why the last call that failed did */
+    std::function<void(const std::string &)> warn = [](const std::string &) {};
+
+    store_t() = default;
+    /* tags keeps a pointer to tag_ordinals */
+    store_t(const store_t &) = delete;
+    store_t &operator=(const store_t &) = delete;
+    ~store_t();
+
+    /* sets the files and loads them, missing files load as empty. exclusive keeps the exclusive lock from before
+     * loading until unlock, for changing the store */
+    bool open(const std::string &tags_file, const std::string &index_file, bool exclusive = false);
+    /* (re)reads both files, dropping anything not committed */
+    bool load();
+    /* refreshes the virtual tags, then writes whichever files were changed since the last load or commit, false (and
+     * nothing written) if another process committed in between */
+    bool commit();
+    /* blocks until the lock is taken, turning a held one into the other type. a lock file that can't be created
+     * (read-only directory) only fails for an exclusive lock */
+    bool lock(lock_type_t type);
+    void unlock();
+    /* (re)reads one shard on its own, relinking its files to the tags already loaded */
+    bool load_shard(dev_t dev);
+    /* replace the files (written aside and renamed over them), dump_index writes every loaded shard. false with
+     * error set if one couldn't be written, it is then left as it was */
+    bool dump_tags();
+    bool dump_index();
+    /* a shard left with no files has its file removed */
+    bool dump_shard(dev_t dev);
+    /* for completion, neither needs the store loaded, only tags_file and index_file set. tag_names reads
+     * "[tags_file].names", the sorted names dump_tags writes next to the tags file, and scans the tags file's declaring
+     * lines instead (caching them again) if the tags file changed since. indexed_paths reads the path of every record
+     * of the index shards (only device's when set), paths with a newline left out */
+    bool tag_names(name_table_t &names);
+    bool indexed_paths(name_table_t &names);
+
+    std::string shard_file(dev_t dev) const;
+    /* the devices that have a shard file next to index_file */
+    std::vector<dev_t> shard_devices() const;
+    auto shard(dev_t dev) const {
+        return std::ranges::subrange(file_index.lower_bound(file_id_t{dev, 0}), file_index.upper_bound(file_id_t{dev, static_cast<ino_t>(-1)}));
+    }
+
+    /* --- lookups --- */
+
+    tag_t *find_tag(const std::string &name);
+    /* finds a file in the index by its path, {} if not there */
+    file_id_t find_path(const std::filesystem::path &path) const;
+    /* the index entry for file_id: file_id itself, else a dev 0 entry with its inode number, else (when file_id has
+     * dev 0, like an inode number given alone) the first entry with its inode number on any device. {} if none */
+    file_id_t find_id(const file_id_t &file_id) const;
+    /* find_id of what is at path on disk */
+    file_id_t find_on_disk(const std::filesystem::path &path) const;
+    bool contains(file_id_t file_id) const;
+    std::vector<tid_t> enabled_only(std::span<const tid_t> tagids) const;
+    /* if either side of the super/sub link exists */
+    bool has_super(const tag_t &tag, const tag_t &super) const;
+    /* if either side of the tag/file link exists */
+    bool has_file(const tag_t &tag, file_id_t file_id) const;
+    /* computed in one pass over file_index, co-occurrence is kept sparse so it only grows with the pairs that exist */
+    store_stats_t stats(bool co_occurrence = true) const;
+    /* builds under dir a directory for every enabled tag, nested in its enabled supertags' (one copy under each), of
+     * symlinks named after its files pointing at their paths. what was made is recorded with the generation in
+     * "[dir]/.ftag-export", and the next export only removes and creates the links and directories that differ from
+     * it, or does nothing at the same generation. anything else in dir is left alone. false (and error set) if dir or
+     * a directory in it could not be made */
+    bool export_symlink_tree(const std::filesystem::path &dir, export_stats_t &stats);
+
+    /* --- mutations --- */
+
+    tag_t *create_tag(const std::string &name, const std::optional<color_t> &color = {});
+    /* false with error set if a virtual tag's search names it */
+    bool delete_tag(const tag_t &tag);
+    void set_enabled(tag_t &tag, bool enabled);
+    void set_color(tag_t &tag, const std::optional<color_t> &color);
+    /* the virtual tags' searches that name it exactly are renamed along */
+    bool rename_tag(tag_t &tag, const std::string &name);
+    /* these return whether anything changed */
+    bool add_super(tag_t &tag, tag_t &super);
+    bool remove_super(tag_t &tag, tag_t &super);
+    void remove_all_super(tag_t &tag);
+    void remove_all_sub(tag_t &tag);
+
+    /* pathstr empty for an unresolved file, false if file_id is already indexed */
+    bool add_file(file_id_t file_id, const std::string &pathstr, const std::optional<file_meta_t> &meta = std::nullopt);
+    /* also untags it everywhere, false if it was not indexed */
+    bool remove_file(file_id_t file_id);
+    /* remove_file for many at once, every tag losing files is filtered in one pass. returns how many were indexed */
+    std::size_t remove_files(const std::vector<file_id_t> &file_ids);
+    /* meta replaces the cached metadata when given, the shard is only dumped again if either changed */
+    bool set_path(file_id_t file_id, const std::string &pathstr, const std::optional<file_meta_t> &meta = std::nullopt);
+    /* moves the index entry and every tag of oldino to newino, newino must not be indexed. also how a dev 0 entry
+     * gets its device */
+    bool replace_id(file_id_t oldino, file_id_t newino);
+    /* takes the content fingerprint of every regular file of file_ids with cached metadata (others are skipped),
+     * in parallel, returns how many were taken */
+    std::size_t fingerprint(const std::vector<file_id_t> &file_ids);
+    /* pairs indexed files with a fingerprint whose path is gone or now has another inode number (orphans) with the
+     * regular files under dir with the same size and fingerprint. only files of an orphan's size are hashed, and
+     * orphans or files matching more than one of the other are warned about and left out. a dev 0 entry still at its
+     * path is returned as well, with the device it has on disk */
+    std::vector<relocation_t> match_by_content(const std::filesystem::path &dir);
+    /* finds where the files of stale entries (path gone, unresolved, or now another inode number) went by walking
+     * roots once, in parallel, looking every file's inode number up in the stale entries. a dev 0 entry matches its
+     * inode number on any device, and an entry with cached metadata only a file of the same type (a reused inode
+     * number of the same type can't be told apart). a dev 0 entry still at its path isn't stale, it is returned in
+     * place with the device it has on disk. stale entries not found go in missing */
+    std::vector<relocation_t> detect_moves(const std::vector<std::filesystem::path> &roots, std::vector<file_id_t> &missing);
+    /* makes tag virtual (or changes its search), replacing its files with what the search returns. false if a rule
+     * has a bad regex */
+    bool set_virtual(tag_t &tag, const virtual_tag_t &virtual_tag);
+    /* tag keeps its files as a normal tag */
+    void clear_virtual(tag_t &tag);
+    /* brings every virtual tag up to date with the files changed since the last refresh */
+    void refresh_virtual();
+    bool tag_file(tag_t &tag, file_id_t file_id);
+    bool untag_file(tag_t &tag, file_id_t file_id);
+    /* tag_file and untag_file for many files at once, in O(files + tag.files) rather than O(files * tag.files): a
+     * tag's files are hashed once and removed in one pass. the files skipped (not indexed, already tagged or repeated
+     * for tag_files, not tagged or repeated for untag_files) go in skipped, returns how many changed */
+    std::size_t tag_files(tag_t &tag, const std::vector<file_id_t> &file_ids, std::vector<file_id_t> *skipped = nullptr);
+    std::size_t untag_files(tag_t &tag, const std::vector<file_id_t> &file_ids, std::vector<file_id_t> *skipped = nullptr);
+
+private:
+    tid_t generate_unique_tid() const;
+    /* note what virtual tags might have to look at again */
+    void touch_file(file_id_t file_id);
+    void touch_tag(const tag_t &tag);
+    void refresh_virtual_tag(tag_t &tag, const virtual_tag_t &virtual_tag, const std::vector<file_id_t> &file_ids);
+};
+
+
+/* the values of a store map whose ordinal bit is set, in the store map's order */
+template <typename From>
+struct selected_range_t {
+    struct iterator_t {
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = typename From::mapped_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const value_type *;
+        using reference = const value_type &;
+
+        typename From::const_iterator it, end;
+        const bitset_t *selected = nullptr;
+
+        void settle() {
+            for (; it != end && !selected->test(it->second.ordinal); ++it) {}
+        }
+
+        reference operator*() const { return it->second; }
+        pointer operator->() const { return &it->second; }
+        iterator_t &operator++() {
+            ++it;
+            settle();
+            return *this;
+        }
+        iterator_t operator++(int) {
+            iterator_t ret = *this;
+            ++*this;
+            return ret;
+        }
+        bool operator==(const iterator_t &other) const { return it == other.it; }
+    };
+
+    const bitset_t *selected;
+    const From *from;
+
+    iterator_t begin() const {
+        iterator_t ret{from->begin(), from->end(), selected};
+        ret.settle();
+        return ret;
+    }
+
+    iterator_t end() const {
+        return iterator_t{from->end(), from->end(), selected};
+    }
+};
+
+/* returned is everything a query selected, matched is what it selected directly rather than through a tag or
+ * subtag. one bit per tag and file ordinal of the store, files not in the index are never selected */
+struct query_result_t {
+    const store_t *store = nullptr;
+    bitset_t tags_returned;
+    bitset_t tags_matched;
+    bitset_t files_returned;
+    bitset_t files_matched;
+
+    using tag_range_t = selected_range_t<tags_map_t>;
+    using file_range_t = selected_range_t<file_index_t>;
+
+    tag_range_t tags() const { return {&tags_returned, &store->tags}; }
+    tag_range_t matched_tags() const { return {&tags_matched, &store->tags}; }
+    file_range_t files() const { return {&files_returned, &store->file_index}; }
+    file_range_t matched_files() const { return {&files_matched, &store->file_index}; }
+
+    bool returned(const tag_t &tag) const { return tags_returned.test(tag.ordinal); }
+    bool matched(const tag_t &tag) const { return tags_matched.test(tag.ordinal); }
+    bool returned(const file_info_t &file_info) const { return files_returned.test(file_info.ordinal); }
+    bool matched(const file_info_t &file_info) const { return files_matched.test(file_info.ordinal); }
+};
+
+/* how many files a query returns, without the files */
+struct query_count_t {
+    std::uint64_t files = 0;
+    std::unordered_map<tid_t, std::uint64_t> by_tag; /* returned files that have the tag, only with by_tag */
+    std::uint64_t untagged = 0; /* returned files with no tags, only with by_tag */
+
+    /* the k tags (all of them with k 0) the most returned files have, most first and ties in tags order, i.e. "n of
+     * these files also have tag x". only with by_tag */
+    std::vector<std::pair<tid_t, std::uint64_t>> facets(const store_t &store, std::size_t k = 0) const;
+};
+
+/* what the cached metadata of a returned file must be, applied after the rules, files without cached metadata never
+ * pass one. no filesystem access */
+struct meta_filter_t {
+    std::optional<std::uint64_t> larger_than; /* bytes, exclusive like the rest */
+    std::optional<std::uint64_t> smaller_than;
+    std::optional<std::int64_t> modified_after; /* ns since the epoch */
+    std::optional<std::int64_t> modified_before;
+    std::optional<char> type; /* as file_meta_t::type */
+
+    bool empty() const {
+        return !larger_than && !smaller_than && !modified_after && !modified_before && !type;
+    }
+
+    bool passes(const file_info_t &file_info) const;
+};
+
+/* rules apply in order, later ones overriding earlier ones for the tags and files they select, and no rules at all
+ * is the same as all_list(). a bad regex throws std::regex_error from run */
+struct query_t {
+    std::vector<search_rule_t> rules;
+    bool search_file_path = false; /* file rules match the whole path instead of the filename */
+    meta_filter_t meta_filter;
+
+    query_t &add(const search_rule_t &rule);
+    query_t &tag(const std::string &text, search_opt_t opt = search_opt_t::exact);
+    query_t &tag_exclude(const std::string &text, search_opt_t opt = search_opt_t::exact);
+    query_t &all(const std::string &text, search_opt_t opt = search_opt_t::exact);
+    query_t &all_exclude(const std::string &text, search_opt_t opt = search_opt_t::exact);
+    query_t &file(const std::string &text, search_opt_t opt = search_opt_t::exact);
+    query_t &file_exclude(const std::string &text, search_opt_t opt = search_opt_t::exact);
+    query_t &inode(file_id_t inum);
+    query_t &inode_exclude(file_id_t inum);
+    query_t &all_list();
+    query_t &all_list_exclude();
+    query_t &by_path(bool search_file_path = true);
+    query_t &filter(const meta_filter_t &meta_filter);
+
+    /* rules that test every file (file rules) split the index in ranges tested on every worker */
+    query_result_t run(const store_t &store) const;
+    /* calls emit for every file run would return, in file_index order, without building the result maps. the rules
+     * are evaluated per file, tag rules having selected their tags up front, so the first file is emitted after a pass
+     * over the tags rather than over the whole index. matched is what files_matched would say. stops once emit returns
+     * false, returns how many files were emitted */
+    std::size_t stream(const store_t &store, const std::function<bool(const file_info_t &file_info, bool matched)> &emit) const;
+    /* stream without emitting anything, so in no order: the index is split in ranges counted on every worker. without
+     * by_tag, and while every file ordinal is still an indexed file (nothing removed since the load), a popcount of
+     * run's returned files instead */
+    query_count_t count(const store_t &store, bool by_tag = false) const;
+    /* the same for queries that select the same, the rules before the last all_list(_exclude) (which overrides them
+     * all) and repeated rules left out */
+    std::string key() const;
+    /* whether a query cache may keep its result. not with a time filter, whose relative times are taken from now so
+     * the same flags give a different key every run */
+    bool cacheable() const {
+        return !meta_filter.modified_after && !meta_filter.modified_before;
+    }
+};
+
+/* results of run by query key and store, one file per query in "[index_file].querycache", so a query is answered
+ * without evaluating it again until the store changes. an entry only hits for the generation (see store_t::lock)
+ * and the tags and index files' sizes and mtimes it was saved with, so every commit (or hand edit, or write by an
+ * older ftag) misses all of them. the least recently saved entries past max_entries are removed, and temp files
+ * older than temp_max_age. queries that aren't cacheable always miss and are never saved */
+struct query_cache_t {
+    std::string dir;
+    std::size_t max_entries = 64;
+    std::chrono::seconds temp_max_age{60};
+
+    explicit query_cache_t(const store_t &store);
+    /* false on a miss */
+    bool load(const store_t &store, const query_t &query, query_result_t &result) const;
+    void dump(const store_t &store, const query_t &query, const query_result_t &result) const;
+};
+
+enum struct sort_key_t : std::uint16_t {
+    none, name, path, size, mtime, tags, inode
+};
+
+/* orders file_ids by key, ties keeping their order (reverse flips the keys, not the ties). every key is taken once
+ * per file into a flat array, numeric ones are radix sorted. size and mtime come from the cached metadata, files
+ * without it are stat-ed once and files that can't be go last, reversed or not */
+void sort_files(const store_t &store, std::vector<file_id_t> &file_ids, sort_key_t key, bool reverse = false);
+
+#endif
@@ -0,0 +1,330 @@
+#include "util.hh"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include <cctype>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+
+bool path_ok(std::string_view pathstr) {
+    try {
+        const std::filesystem::path p = std::filesystem::path(pathstr);
+    } catch (const std::exception &e) {
+        return false;
+    }
+    return true;
+}
+
+std::string_view path_filename(std::string_view pathstr) {
+    std::size_t slash = pathstr.rfind('/');
+    return slash == std::string_view::npos ? pathstr : pathstr.substr(slash + 1);
+}
+
+std::string file_id_str(const file_id_t &file_id) {
+    if (file_id.dev == 0) {
+        return std::to_string(file_id.ino);
+    }
+    return std::to_string(file_id.dev) + ':' + std::to_string(file_id.ino);
+}
+
+bool parse_file_id(const std::string &s, file_id_t &file_id) {
+    file_id_t ret;
+    const char *p = s.c_str();
+    char *end = nullptr;
+    std::size_t colon_pos = s.find(':');
+    if (colon_pos != std::string::npos) {
+        ret.dev = std::strtoull(p, &end, 0);
+        if (end != p + colon_pos || colon_pos == 0) { return false; }
+        p = end + 1;
+    }
+    ret.ino = std::strtoull(p, &end, 0);
+    if (end == p || *end != '\0' || ret.ino == 0) { return false; }
+    file_id = ret;
+    return true;
+}
+
+bool tagcmp_t::operator()(const tid_t &a, const tid_t &b) const {
+    if (ordinals == nullptr) { return a < b; }
+    auto ait = ordinals->find(a), bit = ordinals->find(b);
+    if (ait == ordinals->end() || bit == ordinals->end()) { return ait != ordinals->end() && bit == ordinals->end(); }
+    return ait->second < bit->second;
+}
+
+void bitset_t::fill(std::size_t n, bool value) {
+    std::fill(words.begin(), words.begin() + static_cast<std::ptrdiff_t>(n / 64), value ? ~std::uint64_t{0} : 0);
+    for (std::size_t i = n / 64 * 64; i < n; i++) {
+        set(i, value);
+    }
+}
+
+std::size_t bitset_t::count() const {
+    std::size_t ret = 0;
+    for (const std::uint64_t &word : words) {
+        ret += std::popcount(word);
+    }
+    return ret;
+}
+
+std::uint64_t hash_bytes(const void *data, std::size_t size, std::uint64_t seed) {
+    constexpr std::uint64_t k1 = 0x9E3779B97F4A7C15ULL, k2 = 0xC2B2AE3D27D4EB4FULL;
+    const auto *p = static_cast<const unsigned char *>(data);
+    std::uint64_t h = seed ^ (size * k1);
+    std::size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        std::uint64_t w = 0;
+        std::memcpy(&w, p + i, 8);
+        h ^= w * k2;
+        h = ((h << 31U) | (h >> 33U)) * k1;
+    }
+    std::uint64_t tail = 0;
+    for (std::size_t t = 0; i + t < size; t++) {
+        tail |= static_cast<std::uint64_t>(p[i + t]) << (8 * t);
+    }
+    h ^= tail * k2;
+    /* murmur3's finalizer so every input bit reaches every output bit */
+    h ^= h >> 33U;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33U;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33U;
+    return h;
+}
+
+void radix_sort_order(const std::vector<std::uint64_t> &keys, std::vector<std::uint32_t> &order) {
+    /* keys travel with their index so the passes read memory in order, and every pass's counts come from one read */
+    std::vector<std::pair<std::uint64_t, std::uint32_t>> items(order.size()), buffer(order.size());
+    std::vector<std::array<std::size_t, 256>> counts(8, std::array<std::size_t, 256>{});
+    std::uint64_t differ = 0;
+    for (std::size_t i = 0; i < order.size(); i++) {
+        const std::uint64_t key = keys[order[i]];
+        items[i] = {key, order[i]};
+        differ |= key ^ items[0].first;
+        for (std::uint32_t d = 0; d < 8; d++) {
+            counts[d][(key >> (d * 8)) & 0xFFU]++;
+        }
+    }
+    for (std::uint32_t d = 0; d < 8; d++) {
+        const std::uint32_t shift = d * 8;
+        if (((differ >> shift) & 0xFFU) == 0) { continue; }
+        std::size_t pos = 0;
+        for (std::size_t &count : counts[d]) {
+            const std::size_t n = count;
+            count = pos;
+            pos += n;
+        }
+        for (const auto &item : items) {
+            buffer[counts[d][(item.first >> shift) & 0xFFU]++] = item;
+        }
+        items.swap(buffer);
+    }
+    for (std::size_t i = 0; i < order.size(); i++) {
+        order[i] = items[i].second;
+    }
+}
+
+name_table_t name_table_t::build(std::vector<std::string> names) {
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+    name_table_t ret;
+    std::size_t size = 0;
+    for (const std::string &name : names) {
+        size += name.size() + 1;
+    }
+    ret.text.reserve(size);
+    ret.starts.reserve(names.size());
+    for (const std::string &name : names) {
+        ret.starts.push_back(ret.text.size());
+        ret.text += name;
+        ret.text += '\n';
+    }
+    return ret;
+}
+
+bool name_table_t::assign(std::string text) {
+    if (!text.empty() && text.back() != '\n') { return false; }
+    std::vector<std::size_t> new_starts;
+    std::string_view last;
+    for (std::size_t begin = 0; begin < text.size();) {
+        const std::size_t end = text.find('\n', begin);
+        const std::string_view name(text.data() + begin, end - begin);
+        if (!new_starts.empty() && name <= last) { return false; }
+        new_starts.push_back(begin);
+        last = name;
+        begin = end + 1;
+    }
+    this->text = std::move(text);
+    starts = std::move(new_starts);
+    return true;
+}
+
+std::string_view name_table_t::at(std::size_t i) const {
+    const std::size_t begin = starts[i];
+    const std::size_t end = i + 1 < starts.size() ? starts[i + 1] - 1 : text.size() - 1;
+    return {text.data() + begin, end - begin};
+}
+
+std::vector<std::string_view> name_table_t::complete(std::string_view prefix, std::size_t limit) const {
+    /* the names starting with prefix are a run, beginning at the first name not less than it */
+    std::size_t lo = 0, hi = starts.size();
+    while (lo < hi) {
+        const std::size_t mid = lo + (hi - lo) / 2;
+        if (at(mid) < prefix) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    std::vector<std::string_view> ret;
+    for (std::size_t i = lo; i < starts.size() && (limit == 0 || ret.size() < limit); i++) {
+        const std::string_view name = at(i);
+        if (!name.starts_with(prefix)) { break; }
+        ret.push_back(name);
+    }
+    return ret;
+}
+
+void split(const std::string &s, const std::string &delim, std::vector<std::string> &outs, std::uint32_t n) {
+    std::size_t last = 0, next = 0;
+    while ((next = s.find(delim, last)) != std::string::npos) {
+        outs.push_back(s.substr(last, next - last));
+        if (n > 0 && outs.size() >= n) { break; }
+        last = next + delim.size();
+    }
+    if (last != s.size()) { outs.push_back(s.substr(last, s.size())); }
+}
+
+void split_no_rep_delims(const std::string &s, const std::string &delim, std::vector<std::string> &outs, std::uint32_t n) {
+    std::size_t last = 0, next = 0;
+    while ((next = s.find(delim, last)) != std::string::npos) {
+        outs.push_back(s.substr(last, next - last));
+        if (n > 0 && outs.size() >= n) { break; }
+        last = next + delim.size();
+        for (; last < s.size(); last += delim.size()) {
+            if (s.compare(last, delim.size(), delim) != 0) { break; }
+        }
+    }
+    if (last != s.size()) { outs.push_back(s.substr(last, s.size())); }
+}
+
+static bool is_space(char c) {
+    return std::isspace(static_cast<unsigned char>(c));
+}
+
+void remove_whitespace(std::string &str) {
+    str.erase(std::remove_if(str.begin(), str.end(), is_space), str.end());
+}
+
+void trim_whitespace(std::string &str) {
+    str.erase(std::find_if_not(str.rbegin(), str.rend(), is_space).base(), str.end());
+    str.erase(str.begin(), std::find_if_not(str.begin(), str.end(), is_space));
+}
+
+std::string get_file_content(const std::string &filename) {
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    if (!file) { return {}; }
+    std::string text(static_cast<std::size_t>(file.tellg()), '\0');
+    file.seekg(0);
+    file.read(text.data(), static_cast<std::streamsize>(text.size()));
+    text.resize(static_cast<std::size_t>(file.gcount()));
+    return text;
+}
+
+std::string format_str(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    va_list args_copy;
+    va_copy(args_copy, args);
+    std::string ret(std::max(0, std::vsnprintf(nullptr, 0, fmt, args_copy)), '\0');
+    va_end(args_copy);
+    std::vsnprintf(ret.data(), ret.size() + 1, fmt, args);
+    va_end(args);
+    return ret;
+}
+
+std::string json_str(const std::string &s) {
+    std::string ret = "\"";
+    for (const char &c : s) {
+        if (c == '"' || c == '\\') {
+            ret += '\\';
+            ret += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            ret += format_str("\\u%04x", c);
+        } else {
+            ret += c;
+        }
+    }
+    return ret + '"';
+}
+
+bool parse_size(const std::string &s, std::uint64_t &size) {
+    if (s.empty() || !std::isdigit(static_cast<unsigned char>(s[0]))) { return false; }
+    char *end = nullptr;
+    std::uint64_t n = std::strtoull(s.c_str(), &end, 10);
+    const std::string suffix = end;
+    static const std::string units = "kmgt";
+    if (!suffix.empty()) {
+        const std::size_t unit = units.find(static_cast<char>(std::tolower(static_cast<unsigned char>(suffix[0]))));
+        if (suffix.size() != 1 || unit == std::string::npos) { return false; }
+        n <<= 10U * (unit + 1);
+    }
+    size = n;
+    return true;
+}
+
+bool parse_time(const std::string &s, std::int64_t &ns) {
+    constexpr std::int64_t ns_per_s = 1000000000;
+    if (s.empty()) { return false; }
+    char *end = nullptr;
+    if (s[0] == '@') {
+        const std::int64_t secs = std::strtoll(s.c_str() + 1, &end, 10);
+        if (end == s.c_str() + 1 || *end != '\0') { return false; }
+        ns = secs * ns_per_s;
+        return true;
+    }
+    const std::uint64_t n = std::strtoull(s.c_str(), &end, 10);
+    if (end != s.c_str() && end[0] != '\0' && end[1] == '\0' && std::isdigit(static_cast<unsigned char>(s[0]))) {
+        static const std::map<char, std::int64_t> secs_per = {{'s', 1}, {'m', 60}, {'h', 3600}, {'d', 86400}, {'w', 604800}};
+        auto it = secs_per.find(end[0]);
+        if (it == secs_per.end()) { return false; }
+        const auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        ns = now - static_cast<std::int64_t>(n) * it->second * ns_per_s;
+        return true;
+    }
+    std::tm tm{};
+    const char *rest = strptime(s.c_str(), "%Y-%m-%d", &tm);
+    if (rest != nullptr && *rest == ' ') {
+        const char *time_rest = strptime(rest + 1, "%H:%M:%S", &tm);
+        rest = time_rest != nullptr ? time_rest : strptime(rest + 1, "%H:%M", &tm);
+    }
+    if (rest == nullptr || *rest != '\0') { return false; }
+    tm.tm_isdst = -1;
+    const std::time_t secs = std::mktime(&tm);
+    if (secs == -1) { return false; }
+    ns = static_cast<std::int64_t>(secs) * ns_per_s;
+    return true;
+}
+
+std::int32_t hex_to_rgb(const std::string &s, color_t &color) {
+    return sscanf(s.c_str(), "%2hx%2hx%2hx", &color.r, &color.g, &color.b); /* NOLINT */
+}
+
+std::string rgb_to_hex(const color_t &color) {
+    std::stringstream s;
+    s << std::setfill('0') << std::setw(6) << std::hex;
+    s << (color.r << 16 | color.g << 8 | color.b);
+    return s.str();
+}
+
+bool tag_name_bad(const std::string &tname) {
+    return tname[0] == '-' || tname[0] == '=' || tname.find_first_of(" ()[]:") != std::string::npos;
+}
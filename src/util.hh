@@ -0,0 +1,216 @@
+#ifndef FTAG_UTIL_HH
+#define FTAG_UTIL_HH
+
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <cstdint>
+
+#include <sys/types.h>
+
+
+/* the primitives ftag runs per line, per tag and per file, kept apart from main() so bench/micro.cc can time them */
+
+struct color_t {
+    std::uint16_t r = 0, g = 0, b = 0;
+};
+
+/* 0 is an invalid value for both tids and inode number numbers */
+using tid_t = std::uint64_t; /* temporary, changes every run */
+
+/* a file as stat identifies it, inode numbers alone collide across filesystems. dev 0 is a file indexed before
+ * devices were kept (or by bare inode number), which update and fix give its device once they find it on disk */
+struct file_id_t {
+    dev_t dev = 0;
+    ino_t ino = 0;
+
+    explicit operator bool() const {
+        return ino != 0;
+    }
+
+    auto operator<=>(const file_id_t &) const = default;
+};
+
+template <>
+struct std::hash<file_id_t> {
+    std::size_t operator()(const file_id_t &file_id) const noexcept {
+        return std::hash<std::uint64_t>{}(static_cast<std::uint64_t>(file_id.ino) ^ (static_cast<std::uint64_t>(file_id.dev) << 40U));
+    }
+};
+
+/* "[device]:[inode number]", just "[inode number]" for dev 0 */
+std::string file_id_str(const file_id_t &file_id);
+
+/* takes what file_id_str gives, false if s is anything else or the inode number is 0 */
+bool parse_file_id(const std::string &s, file_id_t &file_id);
+
+struct tag_t {
+    std::uint64_t id = 0;
+    std::string name; /* can't have spaces, parens, square brackets, colons, and cannot start with a dash or an equals sign (that starts a virtual tag's rule line in the tags file), encourages plain naming style something-like-this */
+    std::optional<color_t> color;
+    std::vector<tid_t> sub;
+    std::vector<tid_t> super;
+    std::vector<file_id_t> files;
+    bool enabled = true;
+    std::uint32_t ordinal = 0; /* its position in the order the store read or created tags, see bitset_t */
+};
+
+bool path_ok(std::string_view pathstr);
+
+/* what std::filesystem::path(pathstr).filename() gives, without constructing a path */
+std::string_view path_filename(std::string_view pathstr);
+
+/* what stat said about a file when it was last added or updated, kept in the index so searches never stat */
+struct file_meta_t {
+    std::uint64_t size = 0;
+    std::int64_t mtime = 0; /* ns since the epoch */
+    char type = 'f'; /* f regular file, d directory, o anything else */
+    std::uint32_t mode = 0; /* permission bits */
+    std::uint64_t fingerprint = 0; /* of the contents of a regular file, 0 if not taken, see file_fingerprint */
+
+    bool operator==(const file_meta_t &) const = default;
+};
+
+/* a loaded store gives pathstr and tags its own memory resource, see store_t::load_resources */
+struct file_info_t {
+    file_id_t file_id;
+    std::pmr::string pathstr;
+    std::pmr::vector<tid_t> tags;
+    std::optional<file_meta_t> meta; /* none for files indexed before metadata was kept, until they are updated */
+    std::uint32_t ordinal = 0; /* dense number the store gave it when it was read or added, see bitset_t */
+
+    bool unresolved() const {
+        return pathstr.empty();
+    }
+
+    /* caching? why not! clearly checking if pathstr is ok is extremely expensive... */
+    bool pathstr_ok() const {
+        static std::pmr::string last_pathstr;
+        static bool last_ok = false;
+        if (last_pathstr != pathstr) {
+            last_pathstr = pathstr;
+            last_ok = path_ok(pathstr);
+        }
+        return last_ok;
+    }
+
+    /* views into pathstr, so only valid until it changes */
+    std::string_view filename() const {
+        return path_filename(pathstr);
+    }
+
+    std::filesystem::path path() const {
+        static std::pmr::string last_pathstr;
+        static std::filesystem::path last_path;
+        if (last_pathstr != pathstr) {
+            last_pathstr = pathstr;
+            last_path = std::filesystem::path(pathstr);
+        }
+        return last_path;
+    }
+};
+
+
+/* orders tag ids by their ordinal in ordinals (the order they were read from the tags file), ids not in it go last.
+ * have to use a cmp struct here instead of normal lambda cmp because of storage/lifetime bs */
+struct tagcmp_t {
+    const std::unordered_map<tid_t, std::uint32_t> *ordinals = nullptr;
+
+    bool operator()(const tid_t &a, const tid_t &b) const;
+};
+
+/* one bit per tag or file ordinal, what a search keeps per tag and file instead of a node each. bits past the end
+ * test false, so ordinals given out after it was sized read as unset */
+struct bitset_t {
+    std::vector<std::uint64_t> words;
+
+    bitset_t() = default;
+    explicit bitset_t(std::size_t n) : words((n + 63) / 64, 0) {}
+
+    bool test(std::size_t i) const {
+        return i / 64 < words.size() && ((words[i / 64] >> (i % 64)) & 1U) != 0;
+    }
+    void set(std::size_t i, bool value = true) {
+        const std::uint64_t bit = std::uint64_t{1} << (i % 64);
+        words[i / 64] = value ? words[i / 64] | bit : words[i / 64] & ~bit;
+    }
+    /* every bit up to n */
+    void fill(std::size_t n, bool value);
+    std::size_t count() const;
+};
+
+
+/* fast non-cryptographic 64 bit hash, 8 bytes at a time */
+std::uint64_t hash_bytes(const void *data, std::size_t size, std::uint64_t seed = 0);
+
+/* reorders order (indices into keys) by keys[order[i]] ascending, stably, 8 bits at a time from the lowest, skipping
+ * the bytes every key has the same */
+void radix_sort_order(const std::vector<std::uint64_t> &keys, std::vector<std::uint32_t> &order);
+
+/* names sorted in one buffer, each ended by a \n, looked up by prefix with a binary search. names can't have \n */
+struct name_table_t {
+    std::string text;
+    std::vector<std::size_t> starts; /* where each name begins in text */
+
+    /* sorts names and leaves out repeats */
+    static name_table_t build(std::vector<std::string> names);
+    /* takes text as build lays it out, false if it isn't (unsorted or not ended by a \n) */
+    bool assign(std::string text);
+    std::size_t size() const {
+        return starts.size();
+    }
+    std::string_view at(std::size_t i) const;
+    /* the names starting with prefix, in order, at most limit of them (0 for no limit) */
+    std::vector<std::string_view> complete(std::string_view prefix, std::size_t limit = 0) const;
+};
+
+
+template <class Key, class Tp, class Compare>
+bool map_contains(const std::map<Key, Tp, Compare> &m, const Key &key) {
+    return m.find(key) != m.end();
+}
+
+template <class Key, class Tp, class Compare>
+bool map_contains(const std::unordered_map<Key, Tp, Compare> &m, const Key &key) {
+    return m.find(key) != m.end();
+}
+
+
+void split(const std::string &s, const std::string &delim, std::vector<std::string> &outs, std::uint32_t n = 0);
+
+/* same output for "a,,b,c" as normal split on "a,b,c" both with delim "," */
+void split_no_rep_delims(const std::string &s, const std::string &delim, std::vector<std::string> &outs, std::uint32_t n = 0);
+
+void remove_whitespace(std::string &str);
+
+void trim_whitespace(std::string &str);
+
+std::string get_file_content(const std::string &filename);
+
+/* printf into a std::string */
+std::string format_str(const char *fmt, ...);
+
+/* s as a quoted JSON string */
+std::string json_str(const std::string &s);
+
+/* "<n>[k|m|g|t]" in bytes, the suffixes being powers of 1024 (either case) */
+bool parse_size(const std::string &s, std::uint64_t &size);
+
+/* "<n><s|m|h|d|w>" as that long before now, "YYYY-MM-DD[ HH:MM[:SS]]" in local time or "@<seconds since the epoch>",
+ * into ns since the epoch */
+bool parse_time(const std::string &s, std::int64_t &ns);
+
+std::int32_t hex_to_rgb(const std::string &s, color_t &color);
+
+std::string rgb_to_hex(const color_t &color);
+
+bool tag_name_bad(const std::string &tname);
+
+#endif
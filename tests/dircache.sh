@@ -0,0 +1,48 @@
+# update -r remembers the directories it walked in "<index file>.dircache" and reads them back on the next -r
+
+mkdir -p tree/a/deep tree/b
+echo one > tree/a/x.txt
+echo two > tree/a/deep/y.txt
+echo three > tree/b/z.txt
+# a directory changed (mtime or ctime) within the last second isn't remembered, it could still change in the same tick
+age_dirs() {
+    sleep 1.1
+}
+age_dirs
+dev=$(stat -c %d tree)
+
+ftag add -r tree
+ftag update -r tree
+expect "update -r writes the directory cache" "yes" "$([ -f .fileindex.dircache ] && echo yes)"
+expect "every directory walked is remembered" "$(find "$PWD/tree" -type d | sort)" "$(records .fileindex.dircache | sed 's/^[^:]*:[^:]*://' | sort)"
+expect "a record holds the device, inode number, mtime and ctime" \
+    "$dev:$(stat -c %i tree/a);$(stat -c %Y tree/a)[0-9]*;$(stat -c %Z tree/a)[0-9]*:$PWD/tree/a" \
+    "$(records .fileindex.dircache | grep "tree/a$" | sed -E 's/;([0-9]+)[0-9]{9};([0-9]+)[0-9]{9}:/;\1[0-9]*;\2[0-9]*:/')"
+before=$(records .fileindex.dircache)
+
+# in an unchanged directory an indexed file edited in place is still found, without listing the directory
+echo "one, edited" > tree/a/x.txt
+ftag update -r tree
+expect "a file edited in an unchanged directory gets its new size" "12" \
+    "$(records ".fileindex.$dev" | grep "tree/a/x.txt$" | cut -d';' -f2)"
+expect "the cache read back is written out the same" "$before" "$(records .fileindex.dircache)"
+
+# a renamed file changes its directory, which is listed again
+mv tree/a/deep/y.txt tree/a/deep/w.txt
+age_dirs
+ftag update -r tree
+expect "a file renamed in a changed directory gets its new path" \
+    "$(printf 'tree/a/deep/w.txt\ntree/a/x.txt\ntree/b/z.txt')" "$(paths)"
+expect "the changed directory's new stamp is remembered" "$(stat -c %Y tree/a/deep)" \
+    "$(records .fileindex.dircache | grep "tree/a/deep$" | sed -E 's/^[^;]*;([0-9]+)[0-9]{9};.*/\1/')"
+
+# a removed directory is dropped, --full starts over from every directory there is
+rm -r tree/b
+age_dirs
+ftag update -r tree 2> /dev/null
+expect "a removed directory is forgotten" "" "$(records .fileindex.dircache | grep "tree/b$")"
+ftag update -r --full tree 2> /dev/null
+expect "--full remembers every directory again" "$(find "$PWD/tree" -type d | sort)" "$(records .fileindex.dircache | sed 's/^[^:]*:[^:]*://' | sort)"
+
+printf 'not a record\0\n' > .fileindex.dircache
+expect_fail "a damaged cache is an error" ftag update -r tree
@@ -0,0 +1,51 @@
+# export --symlink-tree records what it made in "<dir>/.ftag-export" and reads it back to only change what changed
+
+mkdir -p tree/x tree/y
+echo a > tree/x/a.txt
+echo b > tree/x/same.txt
+echo c > tree/y/same.txt
+echo d > tree/y/d.txt
+dev=$(stat -c %d tree)
+ftag add -r tree
+ftag tag create photos
+ftag tag create beach
+ftag tag edit beach -as photos
+ftag tag add photos -f tree/x/a.txt tree/x/same.txt tree/y/same.txt
+ftag tag add beach -f tree/y/d.txt
+
+# the links under out, "<link> -> <target>", sorted
+links() {
+    find out -type l -printf '%P -> %l\n' | sort
+}
+# the manifest's records past its stamp, a link's target joined onto it the same way
+manifest() {
+    records out/.ftag-export | tail -n +2 | sed -n '/^d:/p; /^l:/{N; s/^l:\(.*\)\n/\1 -> /p}' | sort
+}
+
+expect "the first export makes every link" "export: 4 links, 4 created, 0 removed" "$(ftag export --symlink-tree out)"
+same=$(stat -c %i tree/y/same.txt)
+expect "tags are nested directories of links, a taken name gets the inode number" \
+    "$(printf '%s\n' "photos/a.txt -> $PWD/tree/x/a.txt" "photos/beach/d.txt -> $PWD/tree/y/d.txt" \
+        "photos/same.txt -> $PWD/tree/x/same.txt" "photos/same.txt~$dev:$same -> $PWD/tree/y/same.txt")" \
+    "$(links)"
+expect "the manifest records every directory and link made" \
+    "$( (printf '%s\n' "d:photos" "d:photos/beach"; links) | sort)" "$(manifest)"
+expect "the manifest starts with the store stamp" "$(cat .fileindex.lock);" "$(records out/.ftag-export | head -n 1 | cut -d';' -f1);"
+
+expect "exporting an unchanged store reads the manifest back and stops" "export: 4 links, up to date" "$(ftag export --symlink-tree out)"
+echo >> main.tags
+expect "a hand edit of the tags file is a change" "export: 4 links, 0 created, 0 removed" "$(ftag export --symlink-tree out)"
+
+echo mine > out/photos/notes.txt
+ftag tag rm photos -f tree/x/a.txt
+ftag tag edit beach -rs photos
+expect "exporting again only changes what changed" "export: 3 links, 1 created, 2 removed" "$(ftag export --symlink-tree out)"
+expect "the links follow the store" \
+    "$(printf '%s\n' "beach/d.txt -> $PWD/tree/y/d.txt" "photos/same.txt -> $PWD/tree/x/same.txt" "photos/same.txt~$dev:$same -> $PWD/tree/y/same.txt")" \
+    "$(links)"
+expect "and so does the manifest" "$( (printf '%s\n' "d:beach" "d:photos"; links) | sort)" "$(manifest)"
+expect "files not made by an export are left alone" "mine" "$(cat out/photos/notes.txt)"
+expect "a directory no longer made is removed" "" "$(ls -d out/photos/beach 2> /dev/null)"
+
+printf 'stamp\0\nx:nonsense\0\n' > out/.ftag-export
+expect_fail "a damaged manifest is an error" ftag export --symlink-tree out
@@ -0,0 +1,42 @@
+# every change writes the sorted tag names to "<tags file>.names", which complete reads back
+
+mkdir -p tree/sub
+echo a > tree/apple.txt
+echo b > tree/sub/apricot.txt
+ftag add -r tree
+for tag in pear apple apricot banana; do
+    ftag tag create "$tag"
+done
+ftag tag edit banana -as apple
+
+stamp() {
+    printf '%s;%s\n' "$(stat -c %s main.tags)" "$(stat -c %Y main.tags)"
+}
+
+expect "the names file is the tags file's stamp and the sorted names" \
+    "$(stamp; printf '%s\n' apple apricot banana pear)" \
+    "$(sed -E '1s/^([0-9]+;[0-9]+)[0-9]{9}$/\1/' main.tags.names)"
+expect "complete reads the names back by prefix" "$(printf 'apple\napricot')" "$(ftag complete ap)"
+expect "an empty prefix is every name" "$(printf 'apple\napricot\nbanana\npear')" "$(ftag complete '')"
+expect "--limit stops early" "apple" "$(ftag complete --limit 1 a)"
+expect "a comma list completes its last tag" "$(printf 'pear,apple\npear,apricot')" "$(ftag complete pear,ap)"
+expect "no match is no output" "" "$(ftag complete zz)"
+
+ftag tag edit apricot -n cherry
+ftag tag delete pear
+expect "a rename and delete rewrite it" "$(stamp; printf '%s\n' apple banana cherry)" \
+    "$(sed -E '1s/^([0-9]+;[0-9]+)[0-9]{9}$/\1/' main.tags.names)"
+
+# a tags file edited by hand since is scanned once and the names file rewritten
+sleep 0.01
+printf 'avocado\n' >> main.tags
+expect "a hand edit of the tags file is seen" "$(printf 'apple\navocado')" "$(ftag complete a)"
+expect "and the names file is rewritten for it" "$(stamp; printf '%s\n' apple avocado banana cherry)" \
+    "$(sed -E '1s/^([0-9]+;[0-9]+)[0-9]{9}$/\1/' main.tags.names)"
+rm main.tags.names
+expect "a missing names file is rebuilt" "banana" "$(ftag complete b)"
+
+expect "--paths completes indexed paths" "$(printf '%s\n' "$PWD/tree/apple.txt" "$PWD/tree/sub/apricot.txt")" "$(ftag complete --paths "$PWD/tree/")"
+cd tree
+expect "relative ones from the current directory" "sub/apricot.txt" "$(ftag complete --paths sub/)"
+cd ..
@@ -0,0 +1,59 @@
+# search saves its results in "<index file>.querycache" and reads them back until the store changes
+
+mkdir -p tree
+for f in a b c; do echo "$f" > "tree/$f.txt"; done
+dev=$(stat -c %d tree)
+ftag add -r tree
+ftag tag create t
+ftag tag add t -f tree/a.txt tree/b.txt
+
+# like paths, without --no-cache and --stream (which never reads the cache)
+cached() {
+    ftag search --files-only --full-path-only --no-formatting "$@" | sed "s#^ *\"##; s#\"\$##; s#^$PWD/##" | grep -v "^$" | sort
+}
+entry() {
+    records "$(ls .fileindex.querycache/* | grep -v '\.tmp')"
+}
+
+expect "a search returns its files" "$(printf 'tree/a.txt\ntree/b.txt')" "$(cached -t t)"
+expect "and saves one entry" "1" "$(ls .fileindex.querycache | wc -l)"
+expect "the entry holds the store stamp, query key, tags and files" \
+    "$(printf '0,0,0,1:t;\ntb:t\nfr:%s:%s\nfr:%s:%s' "$dev" "$(stat -c %i tree/a.txt)" "$dev" "$(stat -c %i tree/b.txt)")" \
+    "$(entry | tail -n +2)"
+expect "the stamp has the generation and the tags and index files' sizes and mtimes" \
+    "$(cat .fileindex.lock);$(stat -c %s main.tags),$(stat -c %Y main.tags)[0-9]*;,,$(stat -c %s ".fileindex.$dev"),$(stat -c %Y ".fileindex.$dev")[0-9]*;" \
+    "$(entry | head -n 1 | sed -E 's/,([0-9]+)[0-9]{9}/,\1[0-9]*/g')"
+
+# the entry is what the next search returns, edited here so that a hit shows
+file=$(ls .fileindex.querycache/*)
+sed -i "/^fr:$dev:$(stat -c %i tree/b.txt)/,+1d" "$file"
+expect "the same search reads the entry back" "tree/a.txt" "$(cached -t t)"
+expect "--no-cache evaluates it" "$(printf 'tree/a.txt\ntree/b.txt')" "$(cached --no-cache -t t)"
+
+ftag tag add t -f tree/c.txt
+expect "a commit misses" "$(printf 'tree/a.txt\ntree/b.txt\ntree/c.txt')" "$(cached -t t)"
+
+sleep 0.01
+sed -i "/:$(stat -c %i tree/c.txt)$/d" main.tags
+expect "a hand edit of the tags file misses" "$(printf 'tree/a.txt\ntree/b.txt')" "$(cached -t t)"
+
+expect "a search by path saves that nothing matches" "" "$(cached -fs d.txt)"
+mv tree/a.txt tree/d.txt
+sleep 0.01
+sed -i "s#tree/a.txt#tree/d.txt#" ".fileindex.$dev"
+expect "a hand edit of an index shard misses" "tree/d.txt" "$(cached -fs d.txt)"
+
+rm -r .fileindex.querycache
+cached --modified-after 2000-01-01 -t t > /dev/null
+expect "a search with a time filter isn't saved" "" "$(ls .fileindex.querycache 2> /dev/null)"
+
+# another search's temp file is only removed once it is old, the oldest entries past 64 are removed
+mkdir -p .fileindex.querycache
+: > .fileindex.querycache/0000000000000000.tmp1
+: > .fileindex.querycache/0000000000000000.tmp2
+touch -d '2 minutes ago' .fileindex.querycache/0000000000000000.tmp2
+for i in $(seq 1 70); do
+    cached -fs "$i" > /dev/null
+done
+expect "a fresh temp file is kept, an old one removed" "0000000000000000.tmp1" "$(ls .fileindex.querycache | grep '\.tmp')"
+expect "at most 64 entries are kept" "64" "$(ls .fileindex.querycache | grep -vc '\.tmp')"
@@ -0,0 +1,125 @@
+#!/usr/bin/env bash
+# behavior tests for ftag, build first with ./compile.sh
+#
+# every tests/<name>.sh runs against the ftag binary in a fresh store of its own: it writes files through ftag, reads
+# them back through ftag (and as text, where the format is the point) and checks what it got with expect. prints one
+# line per failed expectation and a summary, exits 1 if any failed
+
+set -eu
+
+ftag="bin/ftag"
+keep=0
+
+usage() {
+    cat <<USAGE
+usage: $0 [flags] [name] ...
+
+runs tests/<name>.sh for every name, or every test
+
+flags:
+    -b <ftag>      : ftag binary to test (default $ftag)
+    -k             : keeps the work directory of every test, prints where
+USAGE
+}
+
+while getopts "b:kh" opt; do
+    case "$opt" in
+        b) ftag="$OPTARG" ;;
+        k) keep=1 ;;
+        h) usage; exit 0 ;;
+        *) usage; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+if [ ! -x "$ftag" ]; then
+    echo "$0: \"$ftag\" not found, run ./compile.sh first" >&2
+    exit 1
+fi
+ftag="$(cd "$(dirname "$ftag")" && pwd)/$(basename "$ftag")"
+tests_dir="$(cd "$(dirname "$0")" && pwd)"
+
+names=("$@")
+if [ ${#names[@]} -eq 0 ]; then
+    for file in "$tests_dir"/*.sh; do
+        name="$(basename "$file" .sh)"
+        if [ "$name" != run ]; then
+            names+=("$name")
+        fi
+    done
+fi
+
+# helpers for the tests, which run in their work directory with the store in it
+
+# ftag <args>, the binary under test
+ftag() {
+    "$ftag" "$@"
+}
+
+# expect <what> <expected> <actual>
+expect() {
+    checks=$((checks + 1))
+    if [ "$2" != "$3" ]; then
+        failed=$((failed + 1))
+        printf '%s: %s\n    expected: %s\n    got:      %s\n' "$test" "$1" "${2//$'\n'/$'\n              '}" "${3//$'\n'/$'\n              '}"
+    fi
+}
+
+# expect_fail <what> <command> [args] ..., the command has to exit non zero
+expect_fail() {
+    local what="$1"
+    shift
+    checks=$((checks + 1))
+    if "$@" > /dev/null 2>&1; then
+        failed=$((failed + 1))
+        printf '%s: %s\n    expected it to fail, it succeeded\n' "$test" "$what"
+    fi
+}
+
+# records <file>, the \0 separated records of an ftag file one per line (the \n after every \0 dropped)
+records() {
+    tr -d '\n' < "$1" | tr '\0' '\n'
+}
+
+# paths <ftag search flags>, the paths a search returns relative to the work directory, sorted, one per line
+paths() {
+    ftag search --no-cache --stream --full-path-only --no-formatting "$@" | sed "s#^\"##; s#\"\$##; s#^$PWD/##" | sort
+}
+
+total_checks=0
+total_failed=0
+for test in "${names[@]}"; do
+    if [ ! -f "$tests_dir/$test.sh" ]; then
+        echo "$0: test \"$test\" not found" >&2
+        exit 1
+    fi
+    work="$(cd "$(mktemp -d)" && pwd -P)"
+    checks=0
+    failed=0
+    (
+        cd "$work"
+        export HOME="$work"
+        export FTAG_TAGS_FILE="$work/main.tags"
+        export FTAG_INDEX_FILE="$work/.fileindex"
+        mkdir -p tree
+        # shellcheck disable=SC1090
+        . "$tests_dir/$test.sh"
+        echo "$checks $failed" > "$work/.result"
+    ) || echo "$test: stopped early, exit $?"
+    if [ -f "$work/.result" ]; then
+        read -r checks failed < "$work/.result"
+    else
+        failed=$((failed + 1))
+    fi
+    echo "$test: $((checks - failed))/$checks passed"
+    total_checks=$((total_checks + checks))
+    total_failed=$((total_failed + failed))
+    if [ "$keep" = 1 ]; then
+        echo "$test: kept \"$work\""
+    else
+        rm -rf "$work"
+    fi
+done
+
+echo "$((total_checks - total_failed))/$total_checks passed"
+[ "$total_failed" -eq 0 ]
@@ -0,0 +1,54 @@
+# the index is written as one shard per device, "<index file>.<device>", and read back from them
+
+mkdir -p "tree/sub dir"
+echo one > tree/a.txt
+echo two > "tree/sub dir/b;c:d.txt"
+echo three > "tree/sub dir/e f.txt"
+dev=$(stat -c %d tree)
+
+ftag add -r tree
+expect "add -r writes the device's shard" "yes" "$([ -f ".fileindex.$dev" ] && echo yes)"
+expect "add -r leaves the unsharded index file empty" "" "$(records .fileindex 2>/dev/null)"
+expect "the shard has every file with its path" \
+    "$(find "$PWD/tree" -type f | sort)" "$(records ".fileindex.$dev" | sed 's/^[^:]*://' | sort)"
+ino=$(stat -c %i tree/a.txt)
+expect "a record holds inode number, size, mtime, type and mode" \
+    "$ino;4;$(stat -c %Y tree/a.txt)[0-9]*;f;644:$PWD/tree/a.txt" \
+    "$(records ".fileindex.$dev" | grep "^$ino;" | sed -E 's/;([0-9]+)[0-9]{9};/;\1[0-9]*;/')"
+
+ftag tag create t
+ftag tag add t -f tree/a.txt "tree/sub dir/b;c:d.txt"
+expect "the tags file names files by device and inode number" \
+    "$(printf '  -%s:%s\n' "$dev" "$ino" "$dev" "$(stat -c %i "tree/sub dir/b;c:d.txt")")" "$(grep '^  -' main.tags)"
+expect "files read back from the shard" "$(printf 'tree/a.txt\ntree/sub dir/b;c:d.txt')" "$(paths -t t)"
+
+before=$(records ".fileindex.$dev")
+ftag rm -f "tree/sub dir/e f.txt"
+expect "rm rewrites the shard without the file" \
+    "$(grep -v "e f.txt" <<< "$before")" "$(records ".fileindex.$dev")"
+expect "no temp file is left next to the shard" "" "$(ls -a | grep '\.tmp')"
+
+# a file on another device goes in a shard of its own
+other=$(mktemp -d -p /dev/shm 2>/dev/null || true)
+if [ -n "$other" ] && [ "$(stat -c %d "$other")" != "$dev" ]; then
+    echo four > "$other/g.txt"
+    ftag add -f "$other/g.txt"
+    ftag tag add t -f "$other/g.txt"
+    other_dev=$(stat -c %d "$other")
+    expect "a second device gets its own shard" "$other/g.txt" "$(records ".fileindex.$other_dev" | sed 's/^[^:]*://')"
+    expect "the first shard is untouched" "$(grep -v "e f.txt" <<< "$before")" "$(records ".fileindex.$dev")"
+    expect "files are read back from both shards" "$(printf '%s\ntree/a.txt\ntree/sub dir/b;c:d.txt' "$other/g.txt")" "$(paths -t t)"
+    rm -rf "$other"
+fi
+
+# an index from before devices were kept is the unsharded file with bare inode numbers, update -dm gives them their
+# device
+rm -f .fileindex.*
+printf '%s:%s\0\n' "$ino" "$PWD/tree/a.txt" > .fileindex
+printf 't\n  -%s\n' "$ino" > main.tags
+expect "a dev 0 entry is read from the unsharded file" "tree/a.txt" "$(paths -t t)"
+expect "update -dm finds a dev 0 entry in place" "update: 0 moved, 0 still missing" "$(ftag update -dm tree)"
+expect "the entry moves to its device's shard" "$ino" "$(records ".fileindex.$dev" | sed 's/[;:].*//')"
+expect "the unsharded file is emptied" "" "$(records .fileindex)"
+expect "the tags file names it by device" "  -$dev:$ino" "$(grep '^  -' main.tags)"
+expect "it is still tagged" "tree/a.txt" "$(paths -t t)"
@@ -0,0 +1,59 @@
+# a virtual tag's search is saved in the tags file as "= <flag> <text>" lines and its files follow every change
+
+mkdir -p tree
+for f in a b c d; do echo "$f" > "tree/$f.txt"; done
+dev=$(stat -c %d tree)
+ino() {
+    stat -c %i "tree/$1.txt"
+}
+# block <tag>, the tag's line in the tags file and the indented ones under it
+block() {
+    awk -v tag="$1" '/^[^ ]/ { p = $1 == tag } p' main.tags
+}
+ftag add -r tree
+ftag tag create project
+ftag tag create archived
+ftag tag add project -f tree/a.txt tree/b.txt tree/c.txt
+ftag tag add archived -f tree/c.txt
+
+ftag tag virtual active -t project -te archived
+expect "the search is saved as = lines followed by its files" \
+    "$(printf 'active\n  = -t project\n  = -te archived\n  -%s:%s\n  -%s:%s' "$dev" "$(ino a)" "$dev" "$(ino b)")" \
+    "$(block active)"
+expect "it returns what the search does" "$(printf 'tree/a.txt\ntree/b.txt')" "$(paths -t active)"
+before=$(block active)
+ftag tag create other
+expect "the = lines are read back and written out the same" "$before" "$(block active)"
+
+ftag tag add project -f tree/d.txt
+expect "tagging a file refreshes it" "$(printf 'tree/a.txt\ntree/b.txt\ntree/d.txt')" "$(paths -t active)"
+ftag tag rm project -f tree/a.txt
+expect "untagging a file refreshes it" "$(printf 'tree/b.txt\ntree/d.txt')" "$(paths -t active)"
+ftag tag add archived -f tree/b.txt
+expect "tagging with an excluded tag refreshes it" "tree/d.txt" "$(paths -t active)"
+expect "the refreshed files are saved" "  -$dev:$(ino d)" "$(block active | grep '^  -')"
+
+ftag tag edit project -n work
+expect "renaming a tag renames it in the search" "$(printf '  = -t work\n  = -te archived')" "$(block active | grep '^  =')"
+expect "and keeps its files" "tree/d.txt" "$(paths -t active)"
+ftag tag add work -f tree/a.txt
+expect "the renamed search is what refreshes it" "$(printf 'tree/a.txt\ntree/d.txt')" "$(paths -t active)"
+
+expect_fail "a tag named in a search can't be deleted" ftag tag delete archived
+expect "and is left as it was" "$(printf 'tree/b.txt\ntree/c.txt')" "$(paths -t archived)"
+ftag tag virtual active -t work
+ftag tag delete archived
+expect "once the search no longer names it, it can" "" "$(grep '^archived' main.tags)"
+expect "the virtual tag keeps its new search's files" "$(printf 'tree/a.txt\ntree/b.txt\ntree/c.txt\ntree/d.txt')" "$(paths -t active)"
+ftag tag rm work -f tree/b.txt
+expect "and follows it" "$(printf 'tree/a.txt\ntree/c.txt\ntree/d.txt')" "$(paths -t active)"
+
+# a hand written virtual tag is read back, the next change refreshes the files it could affect
+printf 'project\n  -%s:%s\nvirtual\n  = -t project\n  -%s:%s\n' "$dev" "$(ino c)" "$dev" "$(ino c)" > main.tags
+expect "a hand written virtual tag is read back" "tree/c.txt" "$(paths -t virtual)"
+ftag tag add project -f tree/b.txt
+expect "the next change refreshes its files" "$(printf 'tree/b.txt\ntree/c.txt')" "$(paths -t virtual)"
+expect "and saves them under its search" "$(printf 'virtual\n  = -t project\n  -%s:%s\n  -%s:%s' "$dev" "$(ino c)" "$dev" "$(ino b)")" "$(block virtual)"
+
+expect_fail "a virtual tag can't be tagged by hand" ftag tag add virtual -f tree/a.txt
+expect_fail "a tag name can't start with =" ftag tag create =x